@@ -0,0 +1,501 @@
+/*
+* Vulkan barrier planner
+*
+* Tracks the access state of buffers and images across the passes of a frame
+* and derives the minimal set of barriers from the reads and writes each pass declares
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	/**
+	* @brief Derives and records the barriers between passes from declared resource accesses
+	*
+	* Usage per pass: declare all accesses with read() and write(), then call flush() before recording the pass.
+	* All barriers of one pass boundary are issued with a single vkCmdPipelineBarrier2KHR call, or a single
+	* vkCmdPipelineBarrier call if synchronization2 is not available.
+	*
+	* Barriers are only issued where needed:
+	* - Read after write: memory dependency, unless the write is already visible to the reading stages
+	* - Write after read: execution dependency only
+	* - Write after write: memory dependency
+	* - Image layout changes: always
+	*/
+	class BarrierPlanner
+	{
+	public:
+		typedef uint32_t Resource;
+
+	private:
+		struct State
+		{
+			std::string name;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkImage image = VK_NULL_HANDLE;
+			bool isImage = false;
+			VkImageSubresourceRange subresourceRange{};
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			// Stages and accesses of the last write
+			VkPipelineStageFlags2KHR writeStages = 0;
+			VkAccessFlags2KHR writeAccess = 0;
+			// Stages that read since the last write
+			VkPipelineStageFlags2KHR readStages = 0;
+			// Stages and accesses the last write has been made visible to
+			VkPipelineStageFlags2KHR visibleStages = 0;
+			VkAccessFlags2KHR visibleAccess = 0;
+		};
+
+		struct Access
+		{
+			VkPipelineStageFlags2KHR stages = 0;
+			VkAccessFlags2KHR access = 0;
+			// Stages and accesses of the writes among them
+			VkPipelineStageFlags2KHR writeStages = 0;
+			VkAccessFlags2KHR writeAccess = 0;
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			bool discard = false;
+		};
+
+		std::vector<State> states;
+		// Accesses declared for the next pass, sorted by resource so that the recorded barriers are deterministic
+		std::map<Resource, Access> pending;
+		PFN_vkCmdPipelineBarrier2KHR vkCmdPipelineBarrier2KHR = VK_NULL_HANDLE;
+		std::stringstream plan;
+		bool hasFrameState = false;
+
+		static std::string flagNames(uint64_t flags, const std::vector<std::pair<uint64_t, const char*>>& names)
+		{
+			if (flags == 0) {
+				return "NONE";
+			}
+			std::string result;
+			for (auto& name : names) {
+				if ((flags & name.first) == name.first) {
+					result += (result.empty() ? "" : "|") + std::string(name.second);
+					flags &= ~name.first;
+				}
+			}
+			if (flags != 0) {
+				std::stringstream ss;
+				ss << std::hex << "0x" << flags;
+				result += (result.empty() ? "" : "|") + ss.str();
+			}
+			return result;
+		}
+
+		static std::string stageNames(VkPipelineStageFlags2KHR stages)
+		{
+			return flagNames(stages, {
+				{ VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR, "DRAW_INDIRECT" },
+				{ VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT_KHR, "VERTEX_INPUT" },
+				{ VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR, "VERTEX_SHADER" },
+				{ VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR, "EARLY_FRAGMENT_TESTS" },
+				{ VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, "FRAGMENT_SHADER" },
+				{ VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR, "LATE_FRAGMENT_TESTS" },
+				{ VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, "COLOR_ATTACHMENT_OUTPUT" },
+				{ VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, "COMPUTE_SHADER" },
+				{ VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, "TRANSFER" },
+				{ VK_PIPELINE_STAGE_2_HOST_BIT_KHR, "HOST" },
+				{ VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, "ALL_COMMANDS" },
+			});
+		}
+
+		static std::string accessNames(VkAccessFlags2KHR access)
+		{
+			return flagNames(access, {
+				{ VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR, "INDIRECT_COMMAND_READ" },
+				{ VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT_KHR, "VERTEX_ATTRIBUTE_READ" },
+				{ VK_ACCESS_2_UNIFORM_READ_BIT_KHR, "UNIFORM_READ" },
+				{ VK_ACCESS_2_SHADER_READ_BIT_KHR, "SHADER_READ" },
+				{ VK_ACCESS_2_SHADER_WRITE_BIT_KHR, "SHADER_WRITE" },
+				{ VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR, "SHADER_SAMPLED_READ" },
+				{ VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR, "SHADER_STORAGE_READ" },
+				{ VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR, "SHADER_STORAGE_WRITE" },
+				{ VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT_KHR, "COLOR_ATTACHMENT_READ" },
+				{ VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR, "COLOR_ATTACHMENT_WRITE" },
+				{ VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR, "DEPTH_STENCIL_ATTACHMENT_READ" },
+				{ VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR, "DEPTH_STENCIL_ATTACHMENT_WRITE" },
+				{ VK_ACCESS_2_TRANSFER_READ_BIT_KHR, "TRANSFER_READ" },
+				{ VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR, "TRANSFER_WRITE" },
+			});
+		}
+
+		static std::string layoutName(VkImageLayout layout)
+		{
+			switch (layout)
+			{
+			case VK_IMAGE_LAYOUT_UNDEFINED: return "UNDEFINED";
+			case VK_IMAGE_LAYOUT_GENERAL: return "GENERAL";
+			case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: return "COLOR_ATTACHMENT_OPTIMAL";
+			case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL: return "DEPTH_STENCIL_ATTACHMENT_OPTIMAL";
+			case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL: return "DEPTH_STENCIL_READ_ONLY_OPTIMAL";
+			case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: return "SHADER_READ_ONLY_OPTIMAL";
+			case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: return "TRANSFER_SRC_OPTIMAL";
+			case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: return "TRANSFER_DST_OPTIMAL";
+			case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: return "PRESENT_SRC";
+			default: return std::to_string(layout);
+			}
+		}
+
+		/** @brief Maps synchronization2 access flags to the ones available for vkCmdPipelineBarrier */
+		static VkAccessFlags legacyAccess(VkAccessFlags2KHR access)
+		{
+			if (access & (VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR)) {
+				access |= VK_ACCESS_2_SHADER_READ_BIT_KHR;
+			}
+			if (access & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR) {
+				access |= VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+			}
+			return static_cast<VkAccessFlags>(access & 0xFFFFFFFFull);
+		}
+
+		void declare(Resource resource, VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access, VkImageLayout layout, bool write, bool discard)
+		{
+			assert(resource < states.size());
+			Access& pendingAccess = pending[resource];
+			// Different layouts within one pass can't be satisfied
+			assert(pendingAccess.stages == 0 || pendingAccess.layout == layout);
+			pendingAccess.stages |= stages;
+			pendingAccess.access |= access;
+			pendingAccess.layout = layout;
+			if (write) {
+				pendingAccess.writeStages |= stages;
+				pendingAccess.writeAccess |= writeAccessMask(access);
+			}
+			pendingAccess.discard |= discard;
+		}
+
+	public:
+		/** @brief Only writes have to be made available by a barrier */
+		static VkAccessFlags2KHR writeAccessMask(VkAccessFlags2KHR access)
+		{
+			return access & (VK_ACCESS_2_SHADER_WRITE_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR |
+				VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR | VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR | VK_ACCESS_2_HOST_WRITE_BIT_KHR | VK_ACCESS_2_MEMORY_WRITE_BIT_KHR);
+		}
+
+		/**
+		* @param vkCmdPipelineBarrier2KHR Function pointer of vkCmdPipelineBarrier2KHR, barriers are issued with vkCmdPipelineBarrier if null
+		*/
+		void setPipelineBarrier2(PFN_vkCmdPipelineBarrier2KHR vkCmdPipelineBarrier2KHR)
+		{
+			this->vkCmdPipelineBarrier2KHR = vkCmdPipelineBarrier2KHR;
+		}
+
+		/**
+		* Add a buffer, the whole buffer is tracked as one resource
+		*
+		* @return Handle used to declare accesses to the buffer
+		*/
+		Resource addBuffer(const std::string& name, VkBuffer buffer)
+		{
+			State state;
+			state.name = name;
+			state.buffer = buffer;
+			states.push_back(state);
+			return static_cast<Resource>(states.size() - 1);
+		}
+
+		/**
+		* Add an image
+		*
+		* @param aspectMask Aspects of the first mip level and array layer tracked as one resource
+		* @param layout Current layout of the image
+		*
+		* @return Handle used to declare accesses to the image
+		*/
+		Resource addImage(const std::string& name, VkImage image, VkImageAspectFlags aspectMask, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED)
+		{
+			State state;
+			state.name = name;
+			state.image = image;
+			state.isImage = true;
+			state.subresourceRange = { aspectMask, 0, 1, 0, 1 };
+			state.layout = layout;
+			states.push_back(state);
+			return static_cast<Resource>(states.size() - 1);
+		}
+
+		/** @brief Replace the handle of a recreated image, its contents and layout are undefined */
+		void setImage(Resource resource, VkImage image)
+		{
+			if (states[resource].image != image) {
+				states[resource].image = image;
+				states[resource].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			}
+		}
+
+		/** @brief Replace the handle of a recreated buffer */
+		void setBuffer(Resource resource, VkBuffer buffer)
+		{
+			states[resource].buffer = buffer;
+		}
+
+		/**
+		* Set the layout an image has been transitioned to outside of the planner, e.g. by a render pass
+		*
+		* @param stages Stages the image was last accessed by
+		* @param access Writes of the last access
+		* @param visibleStages Stages the writes have already been made visible to, e.g. by an external subpass dependency
+		* @param visibleAccess Accesses of these stages the writes are visible to
+		*/
+		void setLayout(Resource resource, VkImageLayout layout, VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access,
+			VkPipelineStageFlags2KHR visibleStages = 0, VkAccessFlags2KHR visibleAccess = 0)
+		{
+			State& state = states[resource];
+			state.layout = layout;
+			state.writeStages = stages;
+			state.writeAccess = writeAccessMask(access);
+			state.readStages = 0;
+			state.visibleStages = visibleStages;
+			state.visibleAccess = visibleAccess;
+		}
+
+		/**
+		* Take over the memory of another resource, e.g. an image placed in the same memory as a previous one
+		*
+		* The next write to the resource waits for all accesses to the previous one, its contents are undefined
+		*/
+		void alias(Resource resource, Resource previous)
+		{
+			State& state = states[resource];
+			const State& previousState = states[previous];
+			state.readStages |= previousState.writeStages | previousState.readStages;
+			state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			state.visibleStages = 0;
+			state.visibleAccess = 0;
+		}
+
+		/**
+		* Declare a read of the next pass
+		*
+		* @param layout Layout the image has to be in, ignored for buffers
+		*/
+		void read(Resource resource, VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED)
+		{
+			declare(resource, stages, access, layout, false, false);
+		}
+
+		/**
+		* Declare a write of the next pass, read-modify-writes also pass the read access
+		*
+		* @param layout Layout the image has to be in, ignored for buffers
+		* @param discard The previous contents are not needed, images are transitioned from VK_IMAGE_LAYOUT_UNDEFINED
+		*/
+		void write(Resource resource, VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED, bool discard = false)
+		{
+			declare(resource, stages, access, layout, true, discard);
+		}
+
+		/** @brief Start a new frame, the plan only holds the barriers of the most recently recorded frame */
+		void beginFrame()
+		{
+			plan.str("");
+			plan.clear();
+		}
+
+		/** @brief Mark the end of a frame, the resource states now hold the state a frame leaves behind */
+		void endFrame()
+		{
+			hasFrameState = true;
+		}
+
+		/** @brief True if a full frame has been planned, so the first pass of a frame also knows the accesses of the previous one */
+		bool frameStateKnown() const
+		{
+			return hasFrameState;
+		}
+
+		/**
+		* Record the barriers needed by the accesses declared since the last flush
+		*
+		* @param commandBuffer Command buffer to record the barriers to
+		* @param pass Name of the pass, used in the barrier plan
+		*/
+		void flush(VkCommandBuffer commandBuffer, const std::string& pass)
+		{
+			std::vector<VkBufferMemoryBarrier2KHR> bufferBarriers;
+			std::vector<VkImageMemoryBarrier2KHR> imageBarriers;
+			std::stringstream passPlan;
+
+			for (auto& entry : pending)
+			{
+				State& state = states[entry.first];
+				const Access& access = entry.second;
+				const bool isImage = state.isImage;
+				const VkImageLayout newLayout = (isImage && access.layout != VK_IMAGE_LAYOUT_UNDEFINED) ? access.layout : state.layout;
+				const VkImageLayout oldLayout = (isImage && access.discard) ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+				const bool layoutChange = isImage && (newLayout != oldLayout);
+
+				VkPipelineStageFlags2KHR srcStages = 0;
+				VkAccessFlags2KHR srcAccess = 0;
+				bool barrier = layoutChange;
+				const bool write = (access.writeStages != 0);
+				if (write || layoutChange)
+				{
+					// Write after write needs the previous writes to be available, write after read only has to wait for the reads
+					srcStages = state.writeStages | state.readStages;
+					srcAccess = state.writeAccess;
+					barrier |= (srcStages != 0);
+				}
+				else if (state.writeStages != 0 && (((access.stages & ~state.visibleStages) != 0) || ((access.access & ~state.visibleAccess) != 0)))
+				{
+					// Read after a write that has not been made visible to this pass yet
+					srcStages = state.writeStages;
+					srcAccess = state.writeAccess;
+					barrier = true;
+				}
+
+				if (barrier)
+				{
+					if (isImage)
+					{
+						VkImageMemoryBarrier2KHR imageBarrier{};
+						imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+						imageBarrier.srcStageMask = srcStages;
+						imageBarrier.srcAccessMask = srcAccess;
+						imageBarrier.dstStageMask = access.stages;
+						imageBarrier.dstAccessMask = access.access;
+						imageBarrier.oldLayout = oldLayout;
+						imageBarrier.newLayout = newLayout;
+						imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+						imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+						imageBarrier.image = state.image;
+						imageBarrier.subresourceRange = state.subresourceRange;
+						imageBarriers.push_back(imageBarrier);
+					}
+					else
+					{
+						VkBufferMemoryBarrier2KHR bufferBarrier{};
+						bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR;
+						bufferBarrier.srcStageMask = srcStages;
+						bufferBarrier.srcAccessMask = srcAccess;
+						bufferBarrier.dstStageMask = access.stages;
+						bufferBarrier.dstAccessMask = access.access;
+						bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+						bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+						bufferBarrier.buffer = state.buffer;
+						bufferBarrier.offset = 0;
+						bufferBarrier.size = VK_WHOLE_SIZE;
+						bufferBarriers.push_back(bufferBarrier);
+					}
+
+					passPlan << "  " << (isImage ? "image  " : "buffer ") << state.name << ": "
+						<< stageNames(srcStages) << " (" << accessNames(srcAccess) << ") -> "
+						<< stageNames(access.stages) << " (" << accessNames(access.access) << ")";
+					if (layoutChange) {
+						passPlan << " " << layoutName(oldLayout) << " -> " << layoutName(newLayout);
+					}
+					passPlan << "\n";
+				}
+
+				// Update the tracked state
+				if (write)
+				{
+					// Not visible to any stage until the next barrier, other reads of this pass may still be in flight
+					state.writeStages = access.writeStages;
+					state.writeAccess = access.writeAccess;
+					state.readStages = access.stages;
+					state.visibleStages = 0;
+					state.visibleAccess = 0;
+				}
+				else if (layoutChange)
+				{
+					// A layout transition counts as a write, which is visible to the stages of this pass
+					state.writeStages = access.stages;
+					state.writeAccess = 0;
+					state.readStages = access.stages;
+					state.visibleStages = access.stages;
+					state.visibleAccess = access.access;
+				}
+				else
+				{
+					state.readStages |= access.stages;
+					state.visibleStages |= access.stages;
+					state.visibleAccess |= access.access;
+				}
+				state.layout = newLayout;
+			}
+			pending.clear();
+
+			plan << pass << ": " << (bufferBarriers.size() + imageBarriers.size()) << " barrier(s)\n" << passPlan.str();
+
+			if (bufferBarriers.empty() && imageBarriers.empty())
+			{
+				return;
+			}
+
+			if (vkCmdPipelineBarrier2KHR)
+			{
+				VkDependencyInfoKHR dependencyInfo{};
+				dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+				dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size());
+				dependencyInfo.pBufferMemoryBarriers = bufferBarriers.data();
+				dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+				dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+				vkCmdPipelineBarrier2KHR(commandBuffer, &dependencyInfo);
+				return;
+			}
+
+			// Without synchronization2 the stage masks are shared by all barriers of the call
+			VkPipelineStageFlags srcStageMask = 0;
+			VkPipelineStageFlags dstStageMask = 0;
+			std::vector<VkBufferMemoryBarrier> legacyBufferBarriers;
+			std::vector<VkImageMemoryBarrier> legacyImageBarriers;
+			for (auto& barrier : bufferBarriers)
+			{
+				srcStageMask |= static_cast<VkPipelineStageFlags>(barrier.srcStageMask);
+				dstStageMask |= static_cast<VkPipelineStageFlags>(barrier.dstStageMask);
+				VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+				bufferBarrier.srcAccessMask = legacyAccess(barrier.srcAccessMask);
+				bufferBarrier.dstAccessMask = legacyAccess(barrier.dstAccessMask);
+				bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				bufferBarrier.buffer = barrier.buffer;
+				bufferBarrier.offset = barrier.offset;
+				bufferBarrier.size = barrier.size;
+				legacyBufferBarriers.push_back(bufferBarrier);
+			}
+			for (auto& barrier : imageBarriers)
+			{
+				srcStageMask |= static_cast<VkPipelineStageFlags>(barrier.srcStageMask);
+				dstStageMask |= static_cast<VkPipelineStageFlags>(barrier.dstStageMask);
+				VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+				imageBarrier.srcAccessMask = legacyAccess(barrier.srcAccessMask);
+				imageBarrier.dstAccessMask = legacyAccess(barrier.dstAccessMask);
+				imageBarrier.oldLayout = barrier.oldLayout;
+				imageBarrier.newLayout = barrier.newLayout;
+				imageBarrier.image = barrier.image;
+				imageBarrier.subresourceRange = barrier.subresourceRange;
+				legacyImageBarriers.push_back(imageBarrier);
+			}
+			// An empty source scope is expressed with the top of pipe stage in Vulkan 1.0
+			if (srcStageMask == 0) {
+				srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			}
+			vkCmdPipelineBarrier(
+				commandBuffer,
+				srcStageMask,
+				dstStageMask,
+				0,
+				0, nullptr,
+				static_cast<uint32_t>(legacyBufferBarriers.size()), legacyBufferBarriers.data(),
+				static_cast<uint32_t>(legacyImageBarriers.size()), legacyImageBarriers.data());
+		}
+
+		/** @brief Barriers of the most recently recorded frame, one block per pass */
+		std::string getPlan() const
+		{
+			return plan.str();
+		}
+	};
+}
@@ -0,0 +1,265 @@
+/*
+* Vulkan radix sort
+*
+* GPU sort of 32 bit keys with 32 bit values, for e.g. depth sorting and spatial binning
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	/**
+	* @brief LSD radix sort of key-value pairs with compute shaders, see data/shaders/glsl/base/radixsort.h
+	*
+	* Usage: create() the pipelines and scratch buffers for a maximum element count, bind the key, value and count
+	* buffers with setBuffers() and record() the sort. The element count is read from the count buffer when the
+	* commands execute, so it can be written by earlier GPU work, and is clamped to the maximum.
+	*
+	* The sort runs four passes of 8 bits. Each pass counts the digits per block of BLOCK_SIZE elements, scans the
+	* counts per digit across the blocks and scatters the blocks in order, so equal keys keep their order. The passes
+	* alternate between the bound buffers and the scratch copies, the sorted result ends up in the bound buffers.
+	*
+	* The recorded commands start with a compute shader read of the keys, values and count, and end with a compute
+	* shader write of the keys and values. Barriers between the passes are recorded by the sort.
+	*/
+	class RadixSort
+	{
+	public:
+		static const uint32_t WORKGROUP_SIZE = 256;
+		static const uint32_t BLOCK_SIZE = WORKGROUP_SIZE * 16;
+		static const uint32_t BINS = 256;
+		static const uint32_t PASS_COUNT = 4;
+
+	private:
+		struct PushConstants {
+			uint32_t shift;
+			uint32_t countIndex;
+			uint32_t maxCount;
+		};
+
+		// Descriptor bindings of radixsort.h
+		enum Binding : uint32_t {
+			BINDING_STATE = 0,
+			BINDING_KEYS_IN = 1,
+			BINDING_VALUES_IN = 2,
+			BINDING_KEYS_OUT = 3,
+			BINDING_VALUES_OUT = 4,
+			BINDING_BLOCK_HISTOGRAMS = 5,
+			BINDING_DIGIT_TOTALS = 6,
+			BINDING_COUNT = 7,
+			BINDING_MAX_ENUM = 8
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		uint32_t maxCount = 0;
+		uint32_t countIndex = 0;
+
+		struct {
+			// Keys and values of the odd passes
+			vks::Buffer keys;
+			vks::Buffer values;
+			// Digit counts of each block, scanned to the block offsets
+			vks::Buffer blockHistograms;
+			vks::Buffer digitTotals;
+			// Indirect dispatch of the block kernels followed by the element count
+			vks::Buffer state;
+		} scratch;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		// Bound buffers to scratch for the even passes, and back for the odd ones
+		std::array<VkDescriptorSet, 2> descriptorSets{};
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		struct {
+			VkPipeline setup = VK_NULL_HANDLE;
+			VkPipeline histogram = VK_NULL_HANDLE;
+			VkPipeline scan = VK_NULL_HANDLE;
+			VkPipeline scatter = VK_NULL_HANDLE;
+		} pipelines;
+
+		VkPipeline createPipeline(const std::string& fileName, VkPipelineCache pipelineCache)
+		{
+			VkPipelineShaderStageCreateInfo shaderStage{};
+			shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+			shaderStage.module = vks::tools::loadShader(androidApp->activity->assetManager, fileName.c_str(), device->logicalDevice);
+#else
+			shaderStage.module = vks::tools::loadShader(fileName.c_str(), device->logicalDevice);
+#endif
+			shaderStage.pName = "main";
+			if (shaderStage.module == VK_NULL_HANDLE) {
+				vks::tools::exitFatal("Could not load radix sort shader \"" + fileName + "\"", -1);
+			}
+			VkComputePipelineCreateInfo pipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+			pipelineCreateInfo.stage = shaderStage;
+			VkPipeline pipeline;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
+			vkDestroyShaderModule(device->logicalDevice, shaderStage.module, nullptr);
+			return pipeline;
+		}
+
+		// Makes the compute shader writes of the previous kernel visible to the next one, and the dispatch arguments to the indirect dispatches
+		void computeBarrier(VkCommandBuffer commandBuffer, bool indirect = false)
+		{
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | (indirect ? VK_ACCESS_INDIRECT_COMMAND_READ_BIT : 0);
+			const VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | (indirect ? VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT : 0);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStageMask, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		void pushConstants(VkCommandBuffer commandBuffer, uint32_t shift)
+		{
+			PushConstants constants = { shift, countIndex, maxCount };
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		}
+
+	public:
+		// Block count of the scratch histograms, with one histogram of BINS counts per block
+		static uint32_t blockCount(uint32_t elementCount)
+		{
+			return (elementCount + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		}
+
+		// Device memory used for the scratch buffers of a maximum element count
+		static VkDeviceSize scratchSize(uint32_t maxElementCount)
+		{
+			return (VkDeviceSize)maxElementCount * 2 * sizeof(uint32_t) + (VkDeviceSize)std::max(blockCount(maxElementCount), 1u) * BINS * sizeof(uint32_t)
+				+ BINS * sizeof(uint32_t) + 4 * sizeof(uint32_t);
+		}
+
+		uint32_t maxElementCount() const
+		{
+			return maxCount;
+		}
+
+		// shadersPath is the directory of the radixsort_*.comp.spv files, e.g. getShadersPath() + "base/"
+		void create(vks::VulkanDevice* device, const std::string& shadersPath, uint32_t maxElementCount, VkPipelineCache pipelineCache = VK_NULL_HANDLE)
+		{
+			this->device = device;
+			maxCount = maxElementCount;
+
+			const VkDeviceSize elementsSize = (VkDeviceSize)std::max(maxCount, 1u) * sizeof(uint32_t);
+			const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+			VK_CHECK_RESULT(device->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &scratch.keys, elementsSize));
+			VK_CHECK_RESULT(device->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &scratch.values, elementsSize));
+			VK_CHECK_RESULT(device->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &scratch.blockHistograms, (VkDeviceSize)std::max(blockCount(maxCount), 1u) * BINS * sizeof(uint32_t)));
+			VK_CHECK_RESULT(device->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &scratch.digitTotals, BINS * sizeof(uint32_t)));
+			VK_CHECK_RESULT(device->createBuffer(usage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &scratch.state, 4 * sizeof(uint32_t)));
+
+			std::vector<VkDescriptorPoolSize> poolSizes = {
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_MAX_ENUM * static_cast<uint32_t>(descriptorSets.size()))
+			};
+			VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, static_cast<uint32_t>(descriptorSets.size()));
+			VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
+			for (uint32_t binding = 0; binding < BINDING_MAX_ENUM; binding++) {
+				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, binding));
+			}
+			VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayout, nullptr, &descriptorSetLayout));
+
+			std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, descriptorSetLayout };
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, descriptorSets.data()));
+
+			VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+			VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+			pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+			pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+
+			pipelines.setup = createPipeline(shadersPath + "radixsort_setup.comp.spv", pipelineCache);
+			pipelines.histogram = createPipeline(shadersPath + "radixsort_histogram.comp.spv", pipelineCache);
+			pipelines.scan = createPipeline(shadersPath + "radixsort_scan.comp.spv", pipelineCache);
+			pipelines.scatter = createPipeline(shadersPath + "radixsort_scatter.comp.spv", pipelineCache);
+		}
+
+		void destroy()
+		{
+			if (!device) {
+				return;
+			}
+			scratch.keys.destroy();
+			scratch.values.destroy();
+			scratch.blockHistograms.destroy();
+			scratch.digitTotals.destroy();
+			scratch.state.destroy();
+			vkDestroyPipeline(device->logicalDevice, pipelines.setup, nullptr);
+			vkDestroyPipeline(device->logicalDevice, pipelines.histogram, nullptr);
+			vkDestroyPipeline(device->logicalDevice, pipelines.scan, nullptr);
+			vkDestroyPipeline(device->logicalDevice, pipelines.scatter, nullptr);
+			vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
+			vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+			device = nullptr;
+		}
+
+		// Binds the buffers to sort, which need to hold the maximum element count and have storage buffer usage
+		// The element count is the uint32 at countOffset (a multiple of 4) in countBuffer
+		// Updates the descriptors, so the recorded sorts must not be executing
+		void setBuffers(VkBuffer keys, VkBuffer values, VkBuffer countBuffer, VkDeviceSize countOffset)
+		{
+			countIndex = static_cast<uint32_t>(countOffset / sizeof(uint32_t));
+			VkDescriptorBufferInfo keysInfo = { keys, 0, VK_WHOLE_SIZE };
+			VkDescriptorBufferInfo valuesInfo = { values, 0, VK_WHOLE_SIZE };
+			VkDescriptorBufferInfo countInfo = { countBuffer, 0, VK_WHOLE_SIZE };
+			for (size_t i = 0; i < descriptorSets.size(); i++) {
+				const bool toScratch = (i == 0);
+				std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+					vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_STATE, &scratch.state.descriptor),
+					vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_KEYS_IN, toScratch ? &keysInfo : &scratch.keys.descriptor),
+					vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_VALUES_IN, toScratch ? &valuesInfo : &scratch.values.descriptor),
+					vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_KEYS_OUT, toScratch ? &scratch.keys.descriptor : &keysInfo),
+					vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_VALUES_OUT, toScratch ? &scratch.values.descriptor : &valuesInfo),
+					vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_BLOCK_HISTOGRAMS, &scratch.blockHistograms.descriptor),
+					vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_DIGIT_TOTALS, &scratch.digitTotals.descriptor),
+					vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_COUNT, &countInfo)
+				};
+				vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+			}
+		}
+
+		void record(VkCommandBuffer commandBuffer)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[0], 0, nullptr);
+			pushConstants(commandBuffer, 0);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.setup);
+			vkCmdDispatch(commandBuffer, 1, 1, 1);
+			computeBarrier(commandBuffer, true);
+
+			for (uint32_t pass = 0; pass < PASS_COUNT; pass++) {
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[pass % 2], 0, nullptr);
+				pushConstants(commandBuffer, pass * 8);
+
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.histogram);
+				vkCmdDispatchIndirect(commandBuffer, scratch.state.buffer, 0);
+				computeBarrier(commandBuffer);
+
+				// One work group per digit
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.scan);
+				vkCmdDispatch(commandBuffer, BINS, 1, 1);
+				computeBarrier(commandBuffer);
+
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.scatter);
+				vkCmdDispatchIndirect(commandBuffer, scratch.state.buffer, 0);
+				if (pass + 1 < PASS_COUNT) {
+					computeBarrier(commandBuffer);
+				}
+			}
+		}
+	};
+}
@@ -0,0 +1,460 @@
+/*
+* Vulkan readback
+*
+* Asynchronous copies of buffers and images to host memory, written to disk without stalling the frame
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanTools.h"
+#include "threadpool.hpp"
+
+namespace vks
+{
+	/**
+	* @brief Readback file, see Readback for writing it
+	*
+	* File format, all values little endian:
+	* - Header: char magic[8] "VKSDUMP", uint32 version, uint32 chunk count, uint64 frame
+	* - Chunk header: char name[32] (zero terminated), uint32 type (ChunkType), uint32 format (VkFormat of images, 0 otherwise),
+	*   uint32 width, uint32 height (images, 0 otherwise), uint64 size, followed by size bytes of chunk data
+	*
+	* Buffers are stored as they are in device memory, images as tightly packed texels of the copied aspect in the
+	* layout of vkCmdCopyImageToBuffer, host data as it was passed. bin/decode-readback.py decodes the files offline.
+	*/
+	struct ReadbackFile
+	{
+		static const uint32_t VERSION = 1;
+
+		enum ChunkType : uint32_t {
+			CHUNK_BUFFER = 0,
+			CHUNK_IMAGE = 1,
+			CHUNK_HOST = 2
+		};
+
+		struct Header {
+			char magic[8];
+			uint32_t version;
+			uint32_t chunkCount;
+			uint64_t frame;
+		};
+
+		struct ChunkHeader {
+			char name[32];
+			uint32_t type;
+			uint32_t format;
+			uint32_t width;
+			uint32_t height;
+			uint64_t size;
+		};
+
+		struct Chunk {
+			ChunkHeader header;
+			std::vector<uint8_t> data;
+		};
+
+		uint64_t frame = 0;
+		std::vector<Chunk> chunks;
+
+		static const char* magic()
+		{
+			return "VKSDUMP";
+		}
+
+		// Returns the chunk with the given name, or nullptr if the file doesn't contain it
+		const Chunk* find(const std::string& name) const
+		{
+			for (auto& chunk : chunks) {
+				if (name == chunk.header.name) {
+					return &chunk;
+				}
+			}
+			return nullptr;
+		}
+
+		bool load(const std::string& path)
+		{
+			std::ifstream is(path, std::ios::binary);
+			if (!is.is_open()) {
+				std::cerr << "Error: Could not open readback file \"" << path << "\"\n";
+				return false;
+			}
+			Header header;
+			is.read(reinterpret_cast<char*>(&header), sizeof(header));
+			if (!is || memcmp(header.magic, magic(), sizeof(header.magic)) != 0) {
+				std::cerr << "Error: \"" << path << "\" is not a readback file\n";
+				return false;
+			}
+			if (header.version != VERSION) {
+				std::cerr << "Error: Readback file \"" << path << "\" has version " << header.version << ", expected " << VERSION << "\n";
+				return false;
+			}
+			frame = header.frame;
+			chunks.resize(header.chunkCount);
+			for (auto& chunk : chunks) {
+				is.read(reinterpret_cast<char*>(&chunk.header), sizeof(chunk.header));
+				chunk.header.name[sizeof(chunk.header.name) - 1] = '\0';
+				chunk.data.resize(is ? static_cast<size_t>(chunk.header.size) : 0);
+				is.read(reinterpret_cast<char*>(chunk.data.data()), chunk.data.size());
+				if (!is) {
+					std::cerr << "Error: Readback file \"" << path << "\" is truncated\n";
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+
+	static_assert(sizeof(ReadbackFile::Header) == 24, "Readback file header must not contain padding");
+	static_assert(sizeof(ReadbackFile::ChunkHeader) == 56, "Readback chunk header must not contain padding");
+
+	/**
+	* @brief Copies buffers and images to host memory and writes them to a readback file, without waiting for the GPU
+	*
+	* Usage: describe the resources of a capture with a Request and submit() it after the frame that produced them.
+	* The copies of each queue are recorded into one command buffer, submitted to that queue with a fence. Resources
+	* are captured on the queue that owns them, in the state the submits before the capture left them. The capture
+	* waits for all prior work of its queue and later submits wait for the capture, so it sees one consistent frame.
+	*
+	* update() polls the fences once per frame and hands finished captures to a writer thread. Host data is copied when
+	* the request is submitted.
+	*/
+	class Readback
+	{
+	public:
+		// Queue a resource is captured on, and a command pool of its queue family
+		// The optional semaphore is signaled once the copies on the queue are done, so that work on other queues can
+		// wait for the capture to finish reading the resources. All sources of a request with the same queue need to match.
+		struct Source {
+			VkQueue queue;
+			VkCommandPool commandPool;
+			VkSemaphore signalSemaphore;
+		};
+
+		class Request
+		{
+			friend class Readback;
+			struct Item {
+				ReadbackFile::ChunkHeader header{};
+				Source source{};
+				VkBuffer buffer = VK_NULL_HANDLE;
+				VkDeviceSize offset = 0;
+				VkImage image = VK_NULL_HANDLE;
+				VkImageAspectFlags aspectMask = 0;
+				VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+				std::vector<uint8_t> hostData;
+			};
+			std::string path;
+			uint64_t frame;
+			std::vector<Item> items;
+
+			Item& addItem(const std::string& name, ReadbackFile::ChunkType type, VkDeviceSize size)
+			{
+				items.emplace_back();
+				Item& item = items.back();
+				strncpy(item.header.name, name.c_str(), sizeof(item.header.name) - 1);
+				item.header.type = type;
+				item.header.size = size;
+				return item;
+			}
+
+		public:
+			Request(const std::string& path, uint64_t frame) : path(path), frame(frame) {}
+
+			void addBuffer(const Source& source, const std::string& name, VkBuffer buffer, VkDeviceSize size, VkDeviceSize offset = 0)
+			{
+				Item& item = addItem(name, ReadbackFile::CHUNK_BUFFER, size);
+				item.source = source;
+				item.buffer = buffer;
+				item.offset = offset;
+			}
+
+			// The image needs to be in layout when the capture is submitted and is returned to it afterwards
+			// aspectMask selects the single aspect that is copied, e.g. the depth of a depth stencil image
+			void addImage(const Source& source, const std::string& name, VkImage image, VkFormat format, VkImageAspectFlags aspectMask, uint32_t width, uint32_t height, VkImageLayout layout)
+			{
+				const uint32_t texelSize = Readback::texelSize(format, aspectMask);
+				if (texelSize == 0) {
+					vks::tools::exitFatal("Readback of image \"" + name + "\" with format " + std::to_string(format) + " is not supported", -1);
+				}
+				Item& item = addItem(name, ReadbackFile::CHUNK_IMAGE, (VkDeviceSize)width * height * texelSize);
+				item.header.format = format;
+				item.header.width = width;
+				item.header.height = height;
+				item.source = source;
+				item.image = image;
+				item.aspectMask = aspectMask;
+				item.layout = layout;
+			}
+
+			void addHostData(const std::string& name, const void* data, size_t size)
+			{
+				Item& item = addItem(name, ReadbackFile::CHUNK_HOST, size);
+				item.hostData.assign(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+			}
+		};
+
+	private:
+		struct Submission {
+			VkCommandPool commandPool;
+			VkCommandBuffer commandBuffer;
+			VkFence fence;
+		};
+
+		struct Capture {
+			std::string path;
+			uint64_t frame = 0;
+			std::vector<Request::Item> items;
+			// Staging buffer of each item, unused for host data
+			std::vector<vks::Buffer> staging;
+			std::vector<Submission> submissions;
+			bool writing = false;
+			std::atomic<bool> written{ false };
+			bool succeeded = false;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		std::list<Capture> captures;
+		std::unique_ptr<vks::Thread> writer;
+
+		static bool hasStencil(VkFormat format)
+		{
+			return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_S8_UINT;
+		}
+
+		static void write(Capture* capture)
+		{
+			std::ofstream os(capture->path, std::ios::binary);
+			ReadbackFile::Header header{};
+			memcpy(header.magic, ReadbackFile::magic(), strlen(ReadbackFile::magic()));
+			header.version = ReadbackFile::VERSION;
+			header.chunkCount = static_cast<uint32_t>(capture->items.size());
+			header.frame = capture->frame;
+			os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			for (size_t i = 0; i < capture->items.size(); i++) {
+				const Request::Item& item = capture->items[i];
+				const void* data = item.header.type == ReadbackFile::CHUNK_HOST ? item.hostData.data() : capture->staging[i].mapped;
+				os.write(reinterpret_cast<const char*>(&item.header), sizeof(item.header));
+				os.write(static_cast<const char*>(data), item.header.size);
+			}
+			capture->succeeded = os.good();
+		}
+
+		void release(Capture& capture)
+		{
+			for (auto& staging : capture.staging) {
+				staging.destroy();
+			}
+			for (auto& submission : capture.submissions) {
+				vkFreeCommandBuffers(device->logicalDevice, submission.commandPool, 1, &submission.commandBuffer);
+				vkDestroyFence(device->logicalDevice, submission.fence, nullptr);
+			}
+		}
+
+	public:
+		// Size of a texel of the given aspect as copied to a buffer, 0 for formats that are not supported
+		static uint32_t texelSize(VkFormat format, VkImageAspectFlags aspectMask)
+		{
+			if (aspectMask == VK_IMAGE_ASPECT_STENCIL_BIT) {
+				return hasStencil(format) ? 1 : 0;
+			}
+			switch (format) {
+			case VK_FORMAT_D16_UNORM:
+			case VK_FORMAT_D16_UNORM_S8_UINT:
+				return 2;
+			// The depth aspect of the packed 24 bit formats is copied to the lower bits of 32 bit texels
+			case VK_FORMAT_X8_D24_UNORM_PACK32:
+			case VK_FORMAT_D24_UNORM_S8_UINT:
+			case VK_FORMAT_D32_SFLOAT:
+			case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			case VK_FORMAT_R8G8B8A8_UNORM:
+			case VK_FORMAT_R8G8B8A8_SRGB:
+			case VK_FORMAT_B8G8R8A8_UNORM:
+			case VK_FORMAT_B8G8R8A8_SRGB:
+			case VK_FORMAT_R32_SFLOAT:
+			case VK_FORMAT_R32_UINT:
+				return 4;
+			case VK_FORMAT_R16G16B16A16_SFLOAT:
+				return 8;
+			case VK_FORMAT_R32G32B32A32_SFLOAT:
+				return 16;
+			default:
+				return 0;
+			}
+		}
+
+		void create(vks::VulkanDevice* device)
+		{
+			this->device = device;
+			writer.reset(new vks::Thread());
+		}
+
+		// Finishes and writes all pending captures
+		void destroy()
+		{
+			if (!device) {
+				return;
+			}
+			for (auto& capture : captures) {
+				for (auto& submission : capture.submissions) {
+					VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &submission.fence, VK_TRUE, UINT64_MAX));
+				}
+			}
+			update();
+			writer->wait();
+			update();
+			writer.reset();
+			device = nullptr;
+		}
+
+		void submit(const Request& request)
+		{
+			captures.emplace_back();
+			Capture& capture = captures.back();
+			capture.path = request.path;
+			capture.frame = request.frame;
+			capture.items = request.items;
+			capture.staging.resize(capture.items.size());
+
+			// One command buffer per queue, in the order the queues are first used by the request
+			std::vector<Source> sources;
+			for (auto& item : capture.items) {
+				if (item.header.type == ReadbackFile::CHUNK_HOST) {
+					continue;
+				}
+				bool known = false;
+				for (auto& source : sources) {
+					known |= source.queue == item.source.queue;
+				}
+				if (!known) {
+					sources.push_back(item.source);
+				}
+			}
+
+			for (auto& source : sources) {
+				Submission submission{ source.commandPool, VK_NULL_HANDLE, VK_NULL_HANDLE };
+				submission.commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, source.commandPool, true);
+
+				// Images of this queue
+				std::vector<VkImageMemoryBarrier> toTransfer;
+				std::vector<VkImageMemoryBarrier> fromTransfer;
+				for (auto& item : capture.items) {
+					if (item.header.type != ReadbackFile::CHUNK_IMAGE || item.source.queue != source.queue) {
+						continue;
+					}
+					VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+					imageBarrier.image = item.image;
+					// Layout transitions of depth stencil images include both aspects
+					const bool depthStencil = hasStencil((VkFormat)item.header.format) && item.aspectMask != VK_IMAGE_ASPECT_COLOR_BIT;
+					imageBarrier.subresourceRange = { depthStencil ? (VkImageAspectFlags)(VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT) : item.aspectMask, 0, 1, 0, 1 };
+					imageBarrier.oldLayout = item.layout;
+					imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+					imageBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+					imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+					toTransfer.push_back(imageBarrier);
+					imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+					imageBarrier.newLayout = item.layout;
+					imageBarrier.srcAccessMask = 0;
+					imageBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+					fromTransfer.push_back(imageBarrier);
+				}
+
+				// Wait for all prior work of the queue
+				VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+				memoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				vkCmdPipelineBarrier(submission.commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+					1, &memoryBarrier, 0, nullptr, static_cast<uint32_t>(toTransfer.size()), toTransfer.data());
+
+				for (size_t i = 0; i < capture.items.size(); i++) {
+					const Request::Item& item = capture.items[i];
+					if (item.header.type == ReadbackFile::CHUNK_HOST || item.source.queue != source.queue) {
+						continue;
+					}
+					VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &capture.staging[i], item.header.size));
+					VK_CHECK_RESULT(capture.staging[i].map());
+					if (item.header.type == ReadbackFile::CHUNK_BUFFER) {
+						VkBufferCopy region = { item.offset, 0, item.header.size };
+						vkCmdCopyBuffer(submission.commandBuffer, item.buffer, capture.staging[i].buffer, 1, &region);
+					} else {
+						VkBufferImageCopy region{};
+						region.imageSubresource = { item.aspectMask, 0, 0, 1 };
+						region.imageExtent = { item.header.width, item.header.height, 1 };
+						vkCmdCopyImageToBuffer(submission.commandBuffer, item.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, capture.staging[i].buffer, 1, &region);
+					}
+				}
+
+				// Make the copies visible to the host, and let later work of the queue wait for the reads
+				memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+				vkCmdPipelineBarrier(submission.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+					1, &memoryBarrier, 0, nullptr, static_cast<uint32_t>(fromTransfer.size()), fromTransfer.data());
+				VK_CHECK_RESULT(vkEndCommandBuffer(submission.commandBuffer));
+
+				VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo();
+				VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceInfo, nullptr, &submission.fence));
+				VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+				submitInfo.commandBufferCount = 1;
+				submitInfo.pCommandBuffers = &submission.commandBuffer;
+				if (source.signalSemaphore != VK_NULL_HANDLE) {
+					submitInfo.signalSemaphoreCount = 1;
+					submitInfo.pSignalSemaphores = &source.signalSemaphore;
+				}
+				VK_CHECK_RESULT(vkQueueSubmit(source.queue, 1, &submitInfo, submission.fence));
+				capture.submissions.push_back(submission);
+			}
+		}
+
+		// Hands captures the GPU has finished to the writer thread and releases written ones, call once per frame
+		void update()
+		{
+			for (auto it = captures.begin(); it != captures.end();) {
+				Capture& capture = *it;
+				if (!capture.writing) {
+					bool complete = true;
+					for (auto& submission : capture.submissions) {
+						complete &= vkGetFenceStatus(device->logicalDevice, submission.fence) == VK_SUCCESS;
+					}
+					if (complete) {
+						capture.writing = true;
+						Capture* pending = &capture;
+						writer->addJob([pending] {
+							write(pending);
+							pending->written = true;
+						});
+					}
+				}
+				if (capture.written) {
+					if (capture.succeeded) {
+						std::cout << "Readback of frame " << capture.frame << " written to \"" << capture.path << "\"\n";
+					} else {
+						std::cerr << "Error: Could not write readback file \"" << capture.path << "\"\n";
+					}
+					release(capture);
+					it = captures.erase(it);
+				} else {
+					++it;
+				}
+			}
+		}
+
+		// Number of captures not yet written
+		uint32_t pending() const
+		{
+			return static_cast<uint32_t>(captures.size());
+		}
+	};
+}
@@ -0,0 +1,560 @@
+/*
+* Vulkan render graph
+*
+* Passes declare the buffers and images they read and write. From these the graph derives the barriers
+* and layout transitions between the passes, culls passes whose results are never used and places
+* transient images with disjoint lifetimes in the same memory
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+#include "VulkanBarrierPlanner.hpp"
+
+namespace vks
+{
+	/**
+	* @brief Frame description made of passes with declared resource accesses
+	*
+	* Setup: import the persistent buffers and images, create the transient images, add the passes in
+	* execution order and declare their accesses. compile() culls the unused passes and (re)creates the
+	* transient images, execute() records one frame. A frame can be split into several command buffers at
+	* submit boundaries, so that its parts can be submitted with different semaphores.
+	*
+	* A pass is kept if it has side effects, writes an imported resource or writes a transient image that
+	* a later kept pass reads. Transient images are only valid within a frame, their first access has to be
+	* a write. Images whose first and last use don't overlap share one memory allocation.
+	*/
+	class RenderGraph
+	{
+	public:
+		typedef uint32_t Resource;
+		typedef uint32_t Pass;
+		typedef std::function<void(VkCommandBuffer commandBuffer, uint32_t index)> RecordFunction;
+
+		/** @brief Description of a transient image, which has the size passed to compile() */
+		struct ImageDesc
+		{
+			VkFormat format;
+			VkImageUsageFlags usage;
+			VkImageAspectFlags aspectMask;
+		};
+
+	private:
+		struct ResourceEntry
+		{
+			std::string name;
+			bool transient = false;
+			ImageDesc desc{};
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			VkMemoryRequirements memReqs{};
+			BarrierPlanner::Resource planned = 0;
+			// First and last kept pass using the resource, -1 if it is unused
+			int32_t firstPass = -1;
+			int32_t lastPass = -1;
+			// Memory block of a transient image
+			int32_t block = -1;
+		};
+
+		struct Use
+		{
+			Resource resource;
+			VkPipelineStageFlags2KHR stages;
+			VkAccessFlags2KHR access;
+			VkImageLayout layout;
+			bool write;
+			bool discard;
+		};
+
+		struct LayoutChange
+		{
+			Resource resource;
+			VkImageLayout layout;
+			VkPipelineStageFlags2KHR stages;
+			VkAccessFlags2KHR access;
+			VkPipelineStageFlags2KHR visibleStages;
+			VkAccessFlags2KHR visibleAccess;
+		};
+
+		struct PassEntry
+		{
+			std::string name;
+			RecordFunction record;
+			std::vector<Use> uses;
+			std::vector<LayoutChange> layoutChanges;
+			bool sideEffect = false;
+			bool enabled = true;
+			bool culled = false;
+			// The following passes are recorded into the next command buffer
+			bool submitBoundary = false;
+		};
+
+		struct MemoryBlock
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0;
+			uint32_t memoryTypeBits = ~0u;
+			int32_t lastPass = -1;
+			std::vector<Resource> resources;
+			// Resource that last used the memory, its accesses have to finish before the next one writes it
+			int32_t holder = -1;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		BarrierPlanner planner;
+		std::vector<ResourceEntry> resources;
+		std::vector<PassEntry> passes;
+		std::vector<MemoryBlock> blocks;
+		// Extent and lifetimes the transient images were created for
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<int32_t> compiledLifetimes;
+
+		bool readsContents(VkAccessFlags2KHR access) const
+		{
+			return (access & ~BarrierPlanner::writeAccessMask(access)) != 0;
+		}
+
+		void destroyTransients()
+		{
+			for (auto& resource : resources)
+			{
+				if (!resource.transient) {
+					continue;
+				}
+				if (resource.view != VK_NULL_HANDLE) {
+					vkDestroyImageView(device->logicalDevice, resource.view, nullptr);
+				}
+				if (resource.image != VK_NULL_HANDLE) {
+					vkDestroyImage(device->logicalDevice, resource.image, nullptr);
+				}
+				resource.image = VK_NULL_HANDLE;
+				resource.view = VK_NULL_HANDLE;
+				resource.block = -1;
+			}
+			for (auto& block : blocks) {
+				vkFreeMemory(device->logicalDevice, block.memory, nullptr);
+			}
+			blocks.clear();
+		}
+
+		void createTransients()
+		{
+			std::vector<Resource> used;
+			for (Resource r = 0; r < resources.size(); r++)
+			{
+				ResourceEntry& resource = resources[r];
+				if (!resource.transient || resource.firstPass < 0) {
+					continue;
+				}
+				VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
+				imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+				imageCreateInfo.format = resource.desc.format;
+				imageCreateInfo.extent = { width, height, 1 };
+				imageCreateInfo.mipLevels = 1;
+				imageCreateInfo.arrayLayers = 1;
+				imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+				imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+				imageCreateInfo.usage = resource.desc.usage;
+				VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &resource.image));
+				vkGetImageMemoryRequirements(device->logicalDevice, resource.image, &resource.memReqs);
+				planner.setImage(resource.planned, resource.image);
+				used.push_back(r);
+			}
+
+			// Greedy interval assignment: an image goes to the first block whose last user is done before the image is first used
+			std::sort(used.begin(), used.end(), [this](Resource a, Resource b) { return resources[a].firstPass < resources[b].firstPass; });
+			for (Resource r : used)
+			{
+				ResourceEntry& resource = resources[r];
+				for (size_t b = 0; b < blocks.size() && resource.block < 0; b++)
+				{
+					MemoryBlock& block = blocks[b];
+					if (block.lastPass < resource.firstPass && (block.memoryTypeBits & resource.memReqs.memoryTypeBits) != 0) {
+						resource.block = static_cast<int32_t>(b);
+					}
+				}
+				if (resource.block < 0)
+				{
+					blocks.push_back(MemoryBlock());
+					resource.block = static_cast<int32_t>(blocks.size() - 1);
+				}
+				MemoryBlock& block = blocks[resource.block];
+				block.size = std::max(block.size, resource.memReqs.size);
+				block.memoryTypeBits &= resource.memReqs.memoryTypeBits;
+				block.lastPass = resource.lastPass;
+				block.resources.push_back(r);
+			}
+
+			// All images of a block are bound at offset zero, which satisfies any alignment
+			for (auto& block : blocks)
+			{
+				VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+				memAlloc.allocationSize = block.size;
+				memAlloc.memoryTypeIndex = device->getMemoryType(block.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+				VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &block.memory));
+				for (Resource r : block.resources)
+				{
+					ResourceEntry& resource = resources[r];
+					VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, resource.image, block.memory, 0));
+
+					VkImageViewCreateInfo imageView = vks::initializers::imageViewCreateInfo();
+					imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+					imageView.format = resource.desc.format;
+					imageView.subresourceRange = { resource.desc.aspectMask, 0, 1, 0, 1 };
+					imageView.image = resource.image;
+					VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &imageView, nullptr, &resource.view));
+				}
+			}
+		}
+
+		Use& addUse(Pass pass, Resource resource, VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access, VkImageLayout layout, bool write, bool discard)
+		{
+			assert(pass < passes.size() && resource < resources.size());
+			passes[pass].uses.push_back({ resource, stages, access, layout, write, discard });
+			return passes[pass].uses.back();
+		}
+
+	public:
+		/**
+		* @param device Device the transient images are created on
+		* @param vkCmdPipelineBarrier2KHR Function pointer of vkCmdPipelineBarrier2KHR, barriers are issued with vkCmdPipelineBarrier if null
+		*/
+		void setDevice(vks::VulkanDevice* device, PFN_vkCmdPipelineBarrier2KHR vkCmdPipelineBarrier2KHR)
+		{
+			this->device = device;
+			planner.setPipelineBarrier2(vkCmdPipelineBarrier2KHR);
+		}
+
+		/** @brief Add a buffer that is owned outside of the graph */
+		Resource importBuffer(const std::string& name, VkBuffer buffer)
+		{
+			ResourceEntry resource;
+			resource.name = name;
+			resource.planned = planner.addBuffer(name, buffer);
+			resources.push_back(resource);
+			return static_cast<Resource>(resources.size() - 1);
+		}
+
+		/** @brief Add an image that is owned outside of the graph, its contents are kept across frames */
+		Resource importImage(const std::string& name, VkImage image, VkImageAspectFlags aspectMask, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED)
+		{
+			ResourceEntry resource;
+			resource.name = name;
+			resource.image = image;
+			resource.planned = planner.addImage(name, image, aspectMask, layout);
+			resources.push_back(resource);
+			return static_cast<Resource>(resources.size() - 1);
+		}
+
+		/** @brief Replace the handle of a recreated imported image */
+		void setImportedImage(Resource resource, VkImage image)
+		{
+			assert(!resources[resource].transient);
+			resources[resource].image = image;
+			planner.setImage(resources[resource].planned, image);
+		}
+
+		/** @brief Add an image that is created by the graph and only lives within a frame */
+		Resource createImage(const std::string& name, const ImageDesc& desc)
+		{
+			ResourceEntry resource;
+			resource.name = name;
+			resource.transient = true;
+			resource.desc = desc;
+			resource.planned = planner.addImage(name, VK_NULL_HANDLE, desc.aspectMask);
+			resources.push_back(resource);
+			return static_cast<Resource>(resources.size() - 1);
+		}
+
+		/** @brief Image of a resource, transient images are null until compiled and change when recompiled */
+		VkImage getImage(Resource resource) const
+		{
+			return resources[resource].image;
+		}
+
+		/** @brief View of a transient image, null until compiled */
+		VkImageView getImageView(Resource resource) const
+		{
+			return resources[resource].view;
+		}
+
+		/**
+		* Add a pass, passes are executed in the order they are added
+		*
+		* @param record Records the commands of the pass, gets the index of the command buffer passed to execute()
+		*/
+		Pass addPass(const std::string& name, RecordFunction record)
+		{
+			PassEntry pass;
+			pass.name = name;
+			pass.record = record;
+			passes.push_back(pass);
+			return static_cast<Pass>(passes.size() - 1);
+		}
+
+		/**
+		* Declare a read of a pass
+		*
+		* @param layout Layout the image has to be in, ignored for buffers
+		*/
+		void read(Pass pass, Resource resource, VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED)
+		{
+			addUse(pass, resource, stages, access, layout, false, false);
+		}
+
+		/**
+		* Declare a write of a pass, read-modify-writes also pass the read access
+		*
+		* @param layout Layout the image has to be in, ignored for buffers
+		* @param discard The previous contents are not needed, always the case for the first write of a transient image
+		*/
+		void write(Pass pass, Resource resource, VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED, bool discard = false)
+		{
+			addUse(pass, resource, stages, access, layout, true, discard);
+		}
+
+		/**
+		* Declare the layout a pass leaves an image in, for transitions done by a render pass
+		*
+		* @param stages Stages the image was last accessed by
+		* @param access Writes of the last access
+		* @param visibleStages Stages an external subpass dependency of the render pass already made the writes visible to
+		* @param visibleAccess Accesses of these stages covered by the dependency
+		*/
+		void setLayoutAfter(Pass pass, Resource resource, VkImageLayout layout, VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access,
+			VkPipelineStageFlags2KHR visibleStages = 0, VkAccessFlags2KHR visibleAccess = 0)
+		{
+			passes[pass].layoutChanges.push_back({ resource, layout, stages, access, visibleStages, visibleAccess });
+		}
+
+		/** @brief Keep a pass even if none of its writes are used, e.g. for timestamps or presentation */
+		void setSideEffect(Pass pass)
+		{
+			passes[pass].sideEffect = true;
+		}
+
+		/**
+		* End the command buffer of a frame after a pass, the following passes are recorded into the next one
+		*
+		* Applies even if the pass is culled. The barriers between the parts rely on them being submitted to the same queue in order.
+		*/
+		void setSubmitBoundary(Pass pass)
+		{
+			passes[pass].submitBoundary = true;
+		}
+
+		/** @brief Number of command buffers execute() records a frame into */
+		uint32_t getSubmitCount() const
+		{
+			uint32_t count = 1;
+			for (auto& pass : passes) {
+				count += pass.submitBoundary ? 1 : 0;
+			}
+			return count;
+		}
+
+		/** @brief Disabled passes are culled, the graph has to be compiled again after changing this */
+		void setEnabled(Pass pass, bool enabled)
+		{
+			passes[pass].enabled = enabled;
+		}
+
+		/**
+		* Cull the unused passes and create the transient images
+		*
+		* The transient images are only recreated if the extent or their lifetimes changed. As the old images may
+		* still be used by submitted command buffers, the device is waited for in that case.
+		*/
+		void compile(uint32_t width, uint32_t height)
+		{
+			// Culling, from the last pass to the first
+			std::vector<bool> needed(resources.size(), false);
+			for (int32_t p = static_cast<int32_t>(passes.size()) - 1; p >= 0; p--)
+			{
+				PassEntry& pass = passes[p];
+				bool live = pass.sideEffect;
+				for (auto& use : pass.uses) {
+					live |= use.write && (!resources[use.resource].transient || needed[use.resource]);
+				}
+				pass.culled = !pass.enabled || !live;
+				if (pass.culled) {
+					continue;
+				}
+				// Writes that don't read the previous contents end the dependency on earlier passes
+				for (auto& use : pass.uses) {
+					if (use.write && !readsContents(use.access)) {
+						needed[use.resource] = false;
+					}
+				}
+				for (auto& use : pass.uses) {
+					if (!use.write || readsContents(use.access)) {
+						needed[use.resource] = true;
+					}
+				}
+			}
+
+			// Lifetimes in kept passes
+			std::vector<int32_t> lifetimes;
+			for (auto& resource : resources)
+			{
+				resource.firstPass = -1;
+				resource.lastPass = -1;
+			}
+			for (int32_t p = 0; p < static_cast<int32_t>(passes.size()); p++)
+			{
+				if (passes[p].culled) {
+					continue;
+				}
+				for (auto& use : passes[p].uses)
+				{
+					ResourceEntry& resource = resources[use.resource];
+					if (resource.firstPass < 0) {
+						resource.firstPass = p;
+					}
+					resource.lastPass = p;
+				}
+			}
+			for (auto& resource : resources)
+			{
+				if (resource.transient) {
+					lifetimes.push_back(resource.firstPass);
+					lifetimes.push_back(resource.lastPass);
+				}
+			}
+
+			if (width == this->width && height == this->height && lifetimes == compiledLifetimes) {
+				return;
+			}
+			if (!blocks.empty()) {
+				vkDeviceWaitIdle(device->logicalDevice);
+			}
+			destroyTransients();
+			this->width = width;
+			this->height = height;
+			compiledLifetimes = lifetimes;
+			createTransients();
+		}
+
+		/**
+		* Record the kept passes with the barriers between them
+		*
+		* @param commandBuffers One begun command buffer per part of the frame, see getSubmitCount().
+		* If there are fewer, the remaining parts are recorded into the last one.
+		* @param index Passed on to the record functions of the passes
+		*/
+		void execute(const std::vector<VkCommandBuffer>& commandBuffers, uint32_t index)
+		{
+			assert(!commandBuffers.empty());
+			size_t part = 0;
+			planner.beginFrame();
+			for (int32_t p = 0; p < static_cast<int32_t>(passes.size()); p++)
+			{
+				PassEntry& pass = passes[p];
+				VkCommandBuffer commandBuffer = commandBuffers[std::min(part, commandBuffers.size() - 1)];
+				if (pass.submitBoundary) {
+					part++;
+				}
+				if (pass.culled) {
+					continue;
+				}
+				for (auto& use : pass.uses)
+				{
+					ResourceEntry& resource = resources[use.resource];
+					bool discard = use.discard;
+					if (resource.transient && resource.firstPass == p)
+					{
+						// The contents of a transient image don't survive the frame, and the memory may
+						// have been used by another image since the last frame
+						discard = true;
+						MemoryBlock& block = blocks[resource.block];
+						if (block.holder >= 0 && block.holder != static_cast<int32_t>(use.resource)) {
+							planner.alias(resource.planned, resources[block.holder].planned);
+						}
+						block.holder = use.resource;
+					}
+					if (use.write) {
+						planner.write(resource.planned, use.stages, use.access, use.layout, discard);
+					} else {
+						planner.read(resource.planned, use.stages, use.access, use.layout);
+					}
+				}
+				planner.flush(commandBuffer, pass.name);
+				pass.record(commandBuffer, index);
+				for (auto& change : pass.layoutChanges) {
+					planner.setLayout(resources[change.resource].planned, change.layout, change.stages, change.access, change.visibleStages, change.visibleAccess);
+				}
+			}
+			planner.endFrame();
+		}
+
+		/** @brief Record all parts of a frame into one command buffer */
+		void execute(VkCommandBuffer commandBuffer, uint32_t index)
+		{
+			execute(std::vector<VkCommandBuffer>{ commandBuffer }, index);
+		}
+
+		/** @brief True if a full frame has been recorded, so the first pass of a frame also knows the accesses of the previous one */
+		bool frameStateKnown() const
+		{
+			return planner.frameStateKnown();
+		}
+
+		/** @brief Passes, transient memory and the barriers of the most recently recorded frame */
+		std::string getPlan() const
+		{
+			std::stringstream plan;
+			plan << "Passes:\n";
+			for (auto& pass : passes) {
+				plan << "  " << pass.name << (pass.culled ? " (culled)" : "") << "\n";
+				if (pass.submitBoundary) {
+					plan << "  -- submit --\n";
+				}
+			}
+
+			VkDeviceSize aliasedSize = 0;
+			VkDeviceSize unaliasedSize = 0;
+			plan << "Transient images:\n";
+			for (auto& resource : resources)
+			{
+				if (!resource.transient) {
+					continue;
+				}
+				plan << "  " << resource.name << ": ";
+				if (resource.firstPass < 0) {
+					plan << "unused\n";
+					continue;
+				}
+				plan << passes[resource.firstPass].name << " - " << passes[resource.lastPass].name
+					<< ", block " << resource.block << ", " << resource.memReqs.size / 1024 << " KB\n";
+				unaliasedSize += resource.memReqs.size;
+			}
+			for (auto& block : blocks) {
+				aliasedSize += block.size;
+			}
+			plan << "Transient memory: " << aliasedSize / 1024 << " KB in " << blocks.size() << " block(s), "
+				<< unaliasedSize / 1024 << " KB without aliasing\n";
+
+			plan << "Barriers:\n" << planner.getPlan();
+			return plan.str();
+		}
+
+		/** @brief Destroy the transient images, the device has to be idle */
+		void destroy()
+		{
+			if (device) {
+				destroyTransients();
+			}
+		}
+	};
+}
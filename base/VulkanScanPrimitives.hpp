@@ -0,0 +1,380 @@
+/*
+* Vulkan scan primitives
+*
+* Prefix scans, stream compaction and segmented reduction of uint32 buffers with compute shaders
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	/**
+	* @brief Scans, stream compaction and segmented reduction over buffers with indirect counts, see data/shaders/glsl/base/scan.h
+	*
+	* Usage: create() the pipelines and scratch buffers for a maximum element count, describe an operation on its
+	* buffers with exclusiveScan(), inclusiveScan(), compact() or segmentedReduce() and record() it. An operation
+	* keeps its buffers bound, so it can be recorded every frame. Element and segment counts are read from a count
+	* buffer when the commands execute, so they can be written by earlier GPU work, and are clamped to the maximum.
+	*
+	* Scans and compaction reduce then scan: the blocks are summed, the block sums are scanned by a single work group
+	* and the blocks are scanned again from their offsets. This reads the input twice, decoupled look-back would read
+	* it once but relies on forward progress between work groups, which Vulkan doesn't guarantee.
+	* The segmented reduction sums each segment with one work group.
+	*
+	* The work group size is the smallest multiple of the subgroup size of at least 256 invocations. If the device
+	* supports subgroup arithmetic in compute shaders and the instance was created for Vulkan 1.1, the work groups scan
+	* within the subgroups first (the .subgroup.spv shader variants), otherwise in shared memory.
+	*
+	* Operations share the scratch buffers, record() separates them with barriers. The recorded commands start with
+	* compute shader reads of the inputs and counts and end with compute shader writes of the outputs and totals.
+	*/
+	class ScanPrimitives
+	{
+	public:
+		// Elements per invocation of the block kernels
+		static const uint32_t ITEMS = 8;
+
+		enum Mode : uint32_t {
+			MODE_EXCLUSIVE = 0,
+			MODE_INCLUSIVE = 1,
+			MODE_COMPACT = 2,
+			MODE_SEGMENTS = 3
+		};
+
+		// Subgroup capabilities of the device, from VkPhysicalDeviceSubgroupProperties, a size of zero if unknown
+		struct Subgroups {
+			uint32_t size;
+			bool arithmetic;
+		};
+
+		struct Operation {
+			Mode mode;
+			VkDescriptorSet descriptorSet;
+			uint32_t countIndex;
+			uint32_t totalIndex;
+		};
+
+		/** @brief Host implementations of the operations, for validating the GPU results */
+		struct Reference
+		{
+			static void exclusiveScan(const std::vector<uint32_t>& input, uint32_t count, std::vector<uint32_t>& output)
+			{
+				output.resize(count);
+				uint32_t sum = 0;
+				for (uint32_t i = 0; i < count; i++) {
+					output[i] = sum;
+					sum += input[i];
+				}
+			}
+
+			static void inclusiveScan(const std::vector<uint32_t>& input, uint32_t count, std::vector<uint32_t>& output)
+			{
+				output.resize(count);
+				uint32_t sum = 0;
+				for (uint32_t i = 0; i < count; i++) {
+					sum += input[i];
+					output[i] = sum;
+				}
+			}
+
+			static void compact(const std::vector<uint32_t>& input, const std::vector<uint32_t>& flags, uint32_t count, std::vector<uint32_t>& output)
+			{
+				output.clear();
+				for (uint32_t i = 0; i < count; i++) {
+					if (flags[i] != 0) {
+						output.push_back(input[i]);
+					}
+				}
+			}
+
+			static void segmentedReduce(const std::vector<uint32_t>& input, const std::vector<uint32_t>& segmentOffsets, uint32_t segmentCount, std::vector<uint32_t>& output)
+			{
+				output.assign(segmentCount, 0);
+				for (uint32_t segment = 0; segment < segmentCount; segment++) {
+					for (uint32_t i = segmentOffsets[segment]; i < segmentOffsets[segment + 1]; i++) {
+						output[segment] += input[i];
+					}
+				}
+			}
+		};
+
+	private:
+		struct PushConstants {
+			uint32_t countIndex;
+			uint32_t maxCount;
+			uint32_t totalIndex;
+			uint32_t blockSize;
+		};
+
+		// Specialization constants of all kernels
+		struct KernelConstants {
+			uint32_t mode;
+			uint32_t workgroupSize;
+		};
+
+		// Descriptor bindings of scan.h
+		enum Binding : uint32_t {
+			BINDING_STATE = 0,
+			BINDING_INPUT = 1,
+			BINDING_FLAGS = 2,
+			BINDING_OUTPUT = 3,
+			BINDING_BLOCK_SUMS = 4,
+			BINDING_COUNTS = 5,
+			BINDING_TOTALS = 6,
+			BINDING_SEGMENT_OFFSETS = 7,
+			BINDING_MAX_ENUM = 8
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		uint32_t maxCount = 0;
+		uint32_t workgroupSize = 256;
+		bool subgroupArithmetic = false;
+
+		struct {
+			vks::Buffer blockSums;
+			// Indirect dispatch of the block kernels followed by the element count
+			vks::Buffer state;
+			// Totals of operations without a totals buffer
+			vks::Buffer totals;
+		} scratch;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		struct {
+			VkPipeline setupBlocks = VK_NULL_HANDLE;
+			VkPipeline setupSegments = VK_NULL_HANDLE;
+			VkPipeline reduce = VK_NULL_HANDLE;
+			VkPipeline reduceFlags = VK_NULL_HANDLE;
+			VkPipeline scanBlocks = VK_NULL_HANDLE;
+			// Indexed by mode
+			std::array<VkPipeline, 3> downsweep{};
+			VkPipeline segments = VK_NULL_HANDLE;
+		} pipelines;
+
+		VkPipeline createPipeline(const std::string& fileName, Mode mode, VkPipelineCache pipelineCache)
+		{
+			VkPipelineShaderStageCreateInfo shaderStage{};
+			shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+			shaderStage.module = vks::tools::loadShader(androidApp->activity->assetManager, fileName.c_str(), device->logicalDevice);
+#else
+			shaderStage.module = vks::tools::loadShader(fileName.c_str(), device->logicalDevice);
+#endif
+			shaderStage.pName = "main";
+			if (shaderStage.module == VK_NULL_HANDLE) {
+				vks::tools::exitFatal("Could not load scan shader \"" + fileName + "\"", -1);
+			}
+			const KernelConstants constants = { mode, workgroupSize };
+			const std::array<VkSpecializationMapEntry, 2> specializationMapEntries = {
+				vks::initializers::specializationMapEntry(0, offsetof(KernelConstants, mode), sizeof(uint32_t)),
+				vks::initializers::specializationMapEntry(1, offsetof(KernelConstants, workgroupSize), sizeof(uint32_t))
+			};
+			VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(static_cast<uint32_t>(specializationMapEntries.size()),
+				specializationMapEntries.data(), sizeof(constants), &constants);
+			shaderStage.pSpecializationInfo = &specializationInfo;
+			VkComputePipelineCreateInfo pipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+			pipelineCreateInfo.stage = shaderStage;
+			VkPipeline pipeline;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
+			vkDestroyShaderModule(device->logicalDevice, shaderStage.module, nullptr);
+			return pipeline;
+		}
+
+		// Makes the compute shader writes of the previous kernel visible to the next one, and the dispatch arguments to the indirect dispatches
+		void computeBarrier(VkCommandBuffer commandBuffer, bool indirect = false)
+		{
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | (indirect ? VK_ACCESS_INDIRECT_COMMAND_READ_BIT : 0);
+			const VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | (indirect ? VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT : 0);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStageMask, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		// Unused bindings of an operation point at one of its other buffers
+		Operation createOperation(Mode mode, VkBuffer input, VkBuffer flags, VkBuffer output, VkBuffer segmentOffsets,
+			VkBuffer countBuffer, VkDeviceSize countOffset, VkBuffer totals, VkDeviceSize totalOffset)
+		{
+			Operation operation{};
+			operation.mode = mode;
+			operation.countIndex = static_cast<uint32_t>(countOffset / sizeof(uint32_t));
+			operation.totalIndex = static_cast<uint32_t>(totalOffset / sizeof(uint32_t));
+
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &operation.descriptorSet));
+
+			VkDescriptorBufferInfo inputInfo = { input, 0, VK_WHOLE_SIZE };
+			VkDescriptorBufferInfo flagsInfo = { flags != VK_NULL_HANDLE ? flags : input, 0, VK_WHOLE_SIZE };
+			VkDescriptorBufferInfo outputInfo = { output, 0, VK_WHOLE_SIZE };
+			VkDescriptorBufferInfo countInfo = { countBuffer, 0, VK_WHOLE_SIZE };
+			VkDescriptorBufferInfo totalsInfo = { totals != VK_NULL_HANDLE ? totals : scratch.totals.buffer, 0, VK_WHOLE_SIZE };
+			VkDescriptorBufferInfo segmentOffsetsInfo = { segmentOffsets != VK_NULL_HANDLE ? segmentOffsets : input, 0, VK_WHOLE_SIZE };
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+				vks::initializers::writeDescriptorSet(operation.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_STATE, &scratch.state.descriptor),
+				vks::initializers::writeDescriptorSet(operation.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_INPUT, &inputInfo),
+				vks::initializers::writeDescriptorSet(operation.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_FLAGS, &flagsInfo),
+				vks::initializers::writeDescriptorSet(operation.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_OUTPUT, &outputInfo),
+				vks::initializers::writeDescriptorSet(operation.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_BLOCK_SUMS, &scratch.blockSums.descriptor),
+				vks::initializers::writeDescriptorSet(operation.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_COUNTS, &countInfo),
+				vks::initializers::writeDescriptorSet(operation.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_TOTALS, &totalsInfo),
+				vks::initializers::writeDescriptorSet(operation.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_SEGMENT_OFFSETS, &segmentOffsetsInfo)
+			};
+			vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+			return operation;
+		}
+
+	public:
+		uint32_t getWorkgroupSize() const
+		{
+			return workgroupSize;
+		}
+
+		bool usesSubgroupArithmetic() const
+		{
+			return subgroupArithmetic;
+		}
+
+		// shadersPath is the directory of the scan_*.comp.spv files, e.g. getShadersPath() + "base/"
+		// maxOperations is the number of operations that can be described, each one allocates a descriptor set
+		void create(vks::VulkanDevice* device, const std::string& shadersPath, uint32_t maxElementCount, uint32_t maxOperations, Subgroups subgroups, VkPipelineCache pipelineCache = VK_NULL_HANDLE)
+		{
+			this->device = device;
+			maxCount = maxElementCount;
+
+			// Full subgroups, so that each one can scan with subgroup arithmetic
+			workgroupSize = 256;
+			if (subgroups.size > 0) {
+				workgroupSize = ((workgroupSize + subgroups.size - 1) / subgroups.size) * subgroups.size;
+			}
+			workgroupSize = std::min(workgroupSize, device->properties.limits.maxComputeWorkGroupSize[0]);
+			subgroupArithmetic = subgroups.arithmetic && subgroups.size > 0 && workgroupSize % subgroups.size == 0;
+
+			const uint32_t blockCount = std::max((maxCount + workgroupSize * ITEMS - 1) / (workgroupSize * ITEMS), 1u);
+			const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+			VK_CHECK_RESULT(device->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &scratch.blockSums, blockCount * sizeof(uint32_t)));
+			VK_CHECK_RESULT(device->createBuffer(usage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &scratch.state, 4 * sizeof(uint32_t)));
+			VK_CHECK_RESULT(device->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &scratch.totals, sizeof(uint32_t)));
+
+			std::vector<VkDescriptorPoolSize> poolSizes = {
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_MAX_ENUM * maxOperations)
+			};
+			VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, maxOperations);
+			VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
+			for (uint32_t binding = 0; binding < BINDING_MAX_ENUM; binding++) {
+				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, binding));
+			}
+			VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayout, nullptr, &descriptorSetLayout));
+
+			VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+			VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+			pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+			pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+
+			const std::string variant = subgroupArithmetic ? ".subgroup.spv" : ".spv";
+			pipelines.setupBlocks = createPipeline(shadersPath + "scan_setup.comp.spv", MODE_EXCLUSIVE, pipelineCache);
+			pipelines.setupSegments = createPipeline(shadersPath + "scan_setup.comp.spv", MODE_SEGMENTS, pipelineCache);
+			pipelines.reduce = createPipeline(shadersPath + "scan_reduce.comp" + variant, MODE_EXCLUSIVE, pipelineCache);
+			pipelines.reduceFlags = createPipeline(shadersPath + "scan_reduce.comp" + variant, MODE_COMPACT, pipelineCache);
+			pipelines.scanBlocks = createPipeline(shadersPath + "scan_blocks.comp" + variant, MODE_EXCLUSIVE, pipelineCache);
+			for (uint32_t mode = MODE_EXCLUSIVE; mode <= MODE_COMPACT; mode++) {
+				pipelines.downsweep[mode] = createPipeline(shadersPath + "scan_downsweep.comp" + variant, static_cast<Mode>(mode), pipelineCache);
+			}
+			pipelines.segments = createPipeline(shadersPath + "scan_segments.comp" + variant, MODE_SEGMENTS, pipelineCache);
+		}
+
+		void destroy()
+		{
+			if (!device) {
+				return;
+			}
+			scratch.blockSums.destroy();
+			scratch.state.destroy();
+			scratch.totals.destroy();
+			vkDestroyPipeline(device->logicalDevice, pipelines.setupBlocks, nullptr);
+			vkDestroyPipeline(device->logicalDevice, pipelines.setupSegments, nullptr);
+			vkDestroyPipeline(device->logicalDevice, pipelines.reduce, nullptr);
+			vkDestroyPipeline(device->logicalDevice, pipelines.reduceFlags, nullptr);
+			vkDestroyPipeline(device->logicalDevice, pipelines.scanBlocks, nullptr);
+			for (auto pipeline : pipelines.downsweep) {
+				vkDestroyPipeline(device->logicalDevice, pipeline, nullptr);
+			}
+			vkDestroyPipeline(device->logicalDevice, pipelines.segments, nullptr);
+			vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
+			vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+			device = nullptr;
+		}
+
+		// The buffers need storage buffer usage, counts and totals are uint32 at offsets that are multiples of 4
+		// The element count is read from countBuffer at countOffset, the sum of all elements is written to totals at
+		// totalOffset if a totals buffer is given
+		Operation exclusiveScan(VkBuffer input, VkBuffer output, VkBuffer countBuffer, VkDeviceSize countOffset, VkBuffer totals = VK_NULL_HANDLE, VkDeviceSize totalOffset = 0)
+		{
+			return createOperation(MODE_EXCLUSIVE, input, VK_NULL_HANDLE, output, VK_NULL_HANDLE, countBuffer, countOffset, totals, totalOffset);
+		}
+
+		Operation inclusiveScan(VkBuffer input, VkBuffer output, VkBuffer countBuffer, VkDeviceSize countOffset, VkBuffer totals = VK_NULL_HANDLE, VkDeviceSize totalOffset = 0)
+		{
+			return createOperation(MODE_INCLUSIVE, input, VK_NULL_HANDLE, output, VK_NULL_HANDLE, countBuffer, countOffset, totals, totalOffset);
+		}
+
+		// Writes the elements of input with a non zero flag to output, in order, and their number to totals
+		Operation compact(VkBuffer input, VkBuffer flags, VkBuffer output, VkBuffer countBuffer, VkDeviceSize countOffset, VkBuffer totals, VkDeviceSize totalOffset)
+		{
+			return createOperation(MODE_COMPACT, input, flags, output, VK_NULL_HANDLE, countBuffer, countOffset, totals, totalOffset);
+		}
+
+		// Writes the sum of each segment to output, segment i covers the elements segmentOffsets[i] to segmentOffsets[i + 1]
+		// The segment count is read from countBuffer at countOffset, segmentOffsets holds one more offset than segments
+		Operation segmentedReduce(VkBuffer input, VkBuffer segmentOffsets, VkBuffer output, VkBuffer countBuffer, VkDeviceSize countOffset)
+		{
+			return createOperation(MODE_SEGMENTS, input, VK_NULL_HANDLE, output, segmentOffsets, countBuffer, countOffset, VK_NULL_HANDLE, 0);
+		}
+
+		void record(VkCommandBuffer commandBuffer, const Operation& operation)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &operation.descriptorSet, 0, nullptr);
+			const PushConstants constants = { operation.countIndex, maxCount, operation.totalIndex, workgroupSize * ITEMS };
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+			const bool segments = (operation.mode == MODE_SEGMENTS);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, segments ? pipelines.setupSegments : pipelines.setupBlocks);
+			vkCmdDispatch(commandBuffer, 1, 1, 1);
+			computeBarrier(commandBuffer, true);
+
+			if (segments) {
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.segments);
+				vkCmdDispatchIndirect(commandBuffer, scratch.state.buffer, 0);
+				return;
+			}
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, operation.mode == MODE_COMPACT ? pipelines.reduceFlags : pipelines.reduce);
+			vkCmdDispatchIndirect(commandBuffer, scratch.state.buffer, 0);
+			computeBarrier(commandBuffer);
+
+			// A single work group
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.scanBlocks);
+			vkCmdDispatch(commandBuffer, 1, 1, 1);
+			computeBarrier(commandBuffer);
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.downsweep[operation.mode]);
+			vkCmdDispatchIndirect(commandBuffer, scratch.state.buffer, 0);
+		}
+	};
+}
@@ -508,4 +508,9 @@ namespace vks
 		ImGui::TextV(formatstr, args);
 		va_end(args);
 	}
+
+	void UIOverlay::plotLines(const char* caption, const std::vector<float>& values, const char* overlayText)
+	{
+		ImGui::PlotLines(caption, values.data(), static_cast<int>(values.size()), 0, overlayText, FLT_MAX, FLT_MAX, ImVec2(0.0f, 40.0f * scale));
+	}
 }
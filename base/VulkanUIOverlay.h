@@ -88,5 +88,6 @@ namespace vks
 		bool comboBox(const char* caption, int32_t* itemindex, std::vector<std::string> items);
 		bool button(const char* caption);
 		void text(const char* formatstr, ...);
+		void plotLines(const char* caption, const std::vector<float>& values, const char* overlayText = nullptr);
 	};
 }
@@ -29,6 +29,13 @@ namespace vks
 		std::vector<double> frameTimes;
 		std::string filename = "";
 
+		// Optional values written as additional columns next to the frame times, set while rendering a frame
+		// Values that lag behind their frame, e.g. statistics read back from the GPU, are aligned by frameValueLatency
+		std::vector<std::string> frameValueNames;
+		std::vector<double> frameValues;
+		uint32_t frameValueLatency = 0;
+		std::vector<std::vector<double>> recordedFrameValues;
+
 		double runtime = 0.0;
 		uint32_t frameCount = 0;
 
@@ -61,6 +68,9 @@ namespace vks
 					auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
 					runtime += tDiff;
 					frameTimes.push_back(tDiff);
+					if (!frameValueNames.empty()) {
+						recordedFrameValues.push_back(frameValues);
+					}
 					frameCount++;
 					if (outputFrames != -1 && outputFrames == frameCount) break;
 				};
@@ -81,9 +91,23 @@ namespace vks
 				result << deviceProps.deviceName << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << frameCount / (runtime / 1000.0) << "\n";
 
 				if (outputFrameTimes) {
-					result << "\n" << "frame,ms" << "\n";
+					result << "\n" << "frame,ms";
+					for (auto& name : frameValueNames) {
+						result << "," << name;
+					}
+					result << "\n";
 					for (size_t i = 0; i < frameTimes.size(); i++) {
-						result << i << "," << frameTimes[i] << "\n";
+						result << i << "," << frameTimes[i];
+						if (!frameValueNames.empty()) {
+							const size_t valueFrame = i + frameValueLatency;
+							for (size_t j = 0; j < frameValueNames.size(); j++) {
+								result << ",";
+								if (valueFrame < recordedFrameValues.size() && j < recordedFrameValues[valueFrame].size()) {
+									result << recordedFrameValues[valueFrame][j];
+								}
+							}
+						}
+						result << "\n";
 					}
 					double tMin = *std::min_element(frameTimes.begin(), frameTimes.end());
 					double tMax = *std::max_element(frameTimes.begin(), frameTimes.end());
@@ -775,15 +775,8 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 	settings.validation = enableValidation;
 	
 	// Command line arguments
+	// The help is printed by initVulkan, after the constructor of the example has added its options
 	commandLineParser.parse(args);
-	if (commandLineParser.isSet("help")) {
-#if defined(_WIN32)
-		setupConsole("Vulkan example");
-#endif
-		commandLineParser.printHelp();
-		std::cin.get();
-		exit(0);
-	}
 	if (commandLineParser.isSet("validation")) {
 		settings.validation = true;
 	}
@@ -938,6 +931,15 @@ bool VulkanExampleBase::initVulkan()
 {
 	VkResult err;
 
+	if (commandLineParser.isSet("help")) {
+#if defined(_WIN32)
+		setupConsole("Vulkan example");
+#endif
+		commandLineParser.printHelp();
+		std::cin.get();
+		exit(0);
+	}
+
 	// Vulkan instance
 	err = createInstance(settings.validation);
 	if (err) {
@@ -2672,7 +2674,7 @@ void VulkanExampleBase::setupDepthStencil()
 	imageCI.arrayLayers = 1;
 	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | depthStencilUsage;
 
 	VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &depthStencil.image));
 	VkMemoryRequirements memReqs{};
@@ -226,6 +226,8 @@ public:
 		VkDeviceMemory mem;
 		VkImageView view;
 	} depthStencil;
+	/** @brief Usage flags of the depth stencil image in addition to the attachment and sampled usage, e.g. to read it back */
+	VkImageUsageFlags depthStencilUsage = 0;
 
 	struct {
 		glm::vec2 axisLeft = glm::vec2(0.0f);
@@ -0,0 +1,50 @@
+# Measure the cost of the depth buffer collisions of the meshparticles particle simulation across particle counts
+# Each spawn budget is run with and without collisions (--nocollision), the simulation time is printed per
+# million simulated particles. The compute time covers the gpu command, surface emit and simulation passes.
+import subprocess
+import sys
+import os
+import platform
+import re
+
+CONFIGS = [
+	("collision", ""),
+	("none", "--nocollision")
+]
+
+SPAWN_BUDGETS = [4096, 16384, 65536, 262144]
+
+ARGS = "-fullscreen -b"
+
+# Additional arguments are passed on to the example, e.g. "--dynamicrendering" or "-i 16"
+EXTRA_ARGS = " ".join(sys.argv[1:])
+
+print("Measuring meshparticles particle collisions...")
+
+os.makedirs("./benchmark", exist_ok=True)
+
+results = {}
+for budget in SPAWN_BUDGETS:
+	for name, option in CONFIGS:
+		print("---- Running meshparticles with %s, spawn budget %d ----" % (name, budget))
+		executable = "./meshparticles" if platform.system() == 'Linux' or platform.system() == 'Darwin' else "meshparticles"
+		command = "%s %s %s --spawnbudget %d %s -bf ./benchmark/meshparticles_collision_%s_%d.csv 5" % (executable, ARGS, option, budget, EXTRA_ARGS, name, budget)
+		process = subprocess.run(command, shell=True, capture_output=True, text=True)
+		print(process.stdout)
+		if process.returncode != 0:
+			print("Error, result code = %d" % process.returncode)
+			continue
+		compute = re.search(r"particle compute:\s*([0-9.]+) ms, ([0-9.]+) ms per million", process.stdout)
+		simulated = re.search(r"live, ([0-9.]+) simulated", process.stdout)
+		results[(name, budget)] = (float(simulated.group(1)) if simulated else None, float(compute.group(1)) if compute else None, float(compute.group(2)) if compute else None)
+
+print("---- Results ----")
+print("%-10s %10s %14s %18s %22s" % ("collision", "budget", "simulated", "compute (ms)", "ms per million"))
+for (name, budget), (simulated, compute, perMillion) in results.items():
+	print("%-10s %10d %14s %18s %22s" % (name, budget, "%.0f" % simulated if simulated else "-", "%.3f" % compute if compute else "-", "%.3f" % perMillion if perMillion else "-"))
+
+for budget in SPAWN_BUDGETS:
+	collision = results.get(("collision", budget))
+	none = results.get(("none", budget))
+	if collision and none and collision[2] and none[2]:
+		print("spawn budget %d: collisions cost %.3f ms per million simulated particles (%+.1f%%)" % (budget, collision[2] - none[2], (collision[2] - none[2]) / none[2] * 100.0))
@@ -0,0 +1,55 @@
+# Compare the render pass structures of the meshparticles example:
+# separate render passes, the merged subpass render pass, dynamic rendering of the offscreen passes
+# and the particle simulation on an async compute queue. The structures are compared by the wall clock
+# frame time of the benchmark, as the gpu frame time only covers the graphics queue and misses the
+# compute queue work of the async compute configuration
+import subprocess
+import sys
+import os
+import platform
+import re
+
+CONFIGURATIONS = [
+	("renderpasses", ""),
+	("subpasses", "--subpasses"),
+	("dynamicrendering", "--dynamicrendering"),
+	("asynccompute", "--asynccompute")
+]
+
+ARGS = "-fullscreen -b -bt"
+
+# Additional arguments are passed on to the example, e.g. "--surfacespawn" or "-i 16"
+EXTRA_ARGS = " ".join(sys.argv[1:])
+
+print("Comparing meshparticles render pass structures...")
+
+os.makedirs("./benchmark", exist_ok=True)
+
+results = {}
+for name, option in CONFIGURATIONS:
+	print("---- Running meshparticles with %s ----" % name)
+	if platform.system() == 'Linux' or platform.system() == 'Darwin':
+		command = "./meshparticles %s %s %s -bf ./benchmark/meshparticles_%s.csv 5" % (ARGS, option, EXTRA_ARGS, name)
+	else:
+		command = "meshparticles %s %s %s -bf ./benchmark/meshparticles_%s.csv 5" % (ARGS, option, EXTRA_ARGS, name)
+	process = subprocess.run(command, shell=True, capture_output=True, text=True)
+	print(process.stdout)
+	if process.returncode != 0:
+		print("Error, result code = %d" % process.returncode)
+		continue
+	fps = re.search(r"fps\s*:\s*([0-9.]+)", process.stdout)
+	# Average wall clock frame time, printed as the frame times are saved
+	frame = re.search(r"avg\s*:\s*[0-9.]+ fps \(([0-9.]+) ms\)", process.stdout)
+	gpu = re.search(r"gpu frame:\s*([0-9.]+)", process.stdout)
+	results[name] = (float(fps.group(1)) if fps else None, float(frame.group(1)) if frame else None, float(gpu.group(1)) if gpu else None)
+
+print("---- Results ----")
+print("%-18s %10s %16s %24s" % ("structure", "fps", "frame time (ms)", "graphics queue gpu (ms)"))
+for name, (fps, frame, gpu) in results.items():
+	print("%-18s %10s %16s %24s" % (name, "%.2f" % fps if fps else "-", "%.3f" % frame if frame else "-", "%.3f" % gpu if gpu else "-"))
+
+if "renderpasses" in results and results["renderpasses"][1]:
+	separate = results["renderpasses"][1]
+	for name, (fps, frame, gpu) in results.items():
+		if name != "renderpasses" and frame:
+			print("%s: %+.1f%% frame time compared to render passes" % (name, (frame - separate) / separate * 100.0))
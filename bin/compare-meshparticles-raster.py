@@ -0,0 +1,55 @@
+# Compare the particle rasterizers of the meshparticles example across particle counts:
+# the point list draw, the compute rasterizer (--computeraster), the sprites with the compute rasterizer for
+# the sub-pixel particles (--sprites) and the depth tested, blended points (--blendedparticles). Each run uses a fixed spawn budget,
+# the particle render time covers the particle pass or the compute rasterizer passes
+import subprocess
+import sys
+import os
+import platform
+import re
+
+RASTERIZERS = [
+	("points", ""),
+	("compute", "--computeraster"),
+	("sprites", "--sprites"),
+	("blended", "--blendedparticles")
+]
+
+SPAWN_BUDGETS = [4096, 16384, 65536, 262144]
+
+ARGS = "-fullscreen -b"
+
+# Additional arguments are passed on to the example, e.g. "--dynamicrendering" or "-i 16"
+EXTRA_ARGS = " ".join(sys.argv[1:])
+
+print("Comparing meshparticles particle rasterizers...")
+
+os.makedirs("./benchmark", exist_ok=True)
+
+results = {}
+for budget in SPAWN_BUDGETS:
+	for name, option in RASTERIZERS:
+		print("---- Running meshparticles with %s, spawn budget %d ----" % (name, budget))
+		executable = "./meshparticles" if platform.system() == 'Linux' or platform.system() == 'Darwin' else "meshparticles"
+		command = "%s %s %s --spawnbudget %d %s -bf ./benchmark/meshparticles_raster_%s_%d.csv 5" % (executable, ARGS, option, budget, EXTRA_ARGS, name, budget)
+		process = subprocess.run(command, shell=True, capture_output=True, text=True)
+		print(process.stdout)
+		if process.returncode != 0:
+			print("Error, result code = %d" % process.returncode)
+			continue
+		render = re.search(r"particle render:\s*([0-9.]+)", process.stdout)
+		live = re.search(r"particles:\s*([0-9.]+) live", process.stdout)
+		gpu = re.search(r"gpu frame:\s*([0-9.]+)", process.stdout)
+		results[(name, budget)] = (float(live.group(1)) if live else None, float(render.group(1)) if render else None, float(gpu.group(1)) if gpu else None)
+
+print("---- Results ----")
+print("%-10s %10s %14s %20s %16s" % ("raster", "budget", "live", "particle render (ms)", "gpu frame (ms)"))
+for (name, budget), (live, render, gpu) in results.items():
+	print("%-10s %10d %14s %20s %16s" % (name, budget, "%.0f" % live if live else "-", "%.3f" % render if render else "-", "%.3f" % gpu if gpu else "-"))
+
+for budget in SPAWN_BUDGETS:
+	points = results.get(("points", budget))
+	for name, description in (("compute", "compute rasterizer"), ("sprites", "sprites"), ("blended", "blended points")):
+		result = results.get((name, budget))
+		if points and result and points[1] and result[1]:
+			print("spawn budget %d: %s %+.1f%% particle render time compared to points" % (budget, description, (result[1] - points[1]) / points[1] * 100.0))
@@ -0,0 +1,172 @@
+# Decode readback files written by vks::Readback (base/VulkanReadback.hpp), e.g. the particle state dumps
+# of the meshparticles example (--dumpframe or "Dump next frame" in the UI)
+#
+# decode-readback.py <file>                        list the chunks and decode the known meshparticles layouts
+# decode-readback.py <file> --count 16             print the first 16 elements of array chunks
+# decode-readback.py <file> --csv spawn out.csv    write all elements of an array chunk as csv
+# decode-readback.py <file> --pgm depth out.pgm    write a depth image chunk as 16 bit pgm
+# decode-readback.py <file> --raw append out.bin   write the data of a chunk as it is
+import argparse
+import struct
+import sys
+
+MAGIC = b"VKSDUMP\0"
+VERSION = 1
+HEADER = struct.Struct("<8sIIQ")
+CHUNK_HEADER = struct.Struct("<32sIIIIQ")
+CHUNK_TYPES = { 0: "buffer", 1: "image", 2: "host" }
+
+# VkFormat values of the depth formats
+DEPTH_FORMATS = {
+	124: ("D16_UNORM", "<H", 0xffff),
+	125: ("X8_D24_UNORM_PACK32", "<I", 0xffffff),
+	126: ("D32_SFLOAT", "<f", None),
+	128: ("D16_UNORM_S8_UINT", "<H", 0xffff),
+	129: ("D24_UNORM_S8_UINT", "<I", 0xffffff),
+	130: ("D32_SFLOAT_S8_UINT", "<f", None)
+}
+
+# Layouts of the meshparticles structures, see examples/meshparticles/particlereference.hpp
+# A layout is a list of (field, struct format), arrays are chunks of repeated elements
+STRUCTS = {
+	"particleSystem": [("wind", "3f"), ("deltaT", "f"), ("speed", "f"), ("seed", "I"), ("frameNum", "I"), ("spawnBudget", "I"),
+		("spawnSampling", "I"), ("spawnSource", "I"), ("candidateWriteSlot", "I"), ("candidateReadSlot", "I"), ("candidateSlotSize", "I"),
+		("collision", "I"), ("restitution", "f"), ("friction", "f"), ("turbulenceOffset", "3f"), ("turbulenceAmplitude", "f"),
+		("turbulenceFrequency", "f"), ("tick", "I"), ("substeps", "I"), ("tickTime", "f"), ("interpolation", "f"),
+		("emissionLodSize", "f"), ("instanceRadius", "f"), ("simulationLodLevels", "I"), ("lodCamera", "3f"), ("simulationLodDistance", "f")],
+	"viewData": [("view", "16f"), ("viewProj", "16f"), ("invViewProj", "16f"), ("viewport", "2f"), ("spriteSize", "f"), ("spritePixelScale", "f")],
+	"gpucmd": [("particleCount", "2I"), ("spawnProbability", "2f"), ("dispatchCmd", "3I"), ("drawCmd", "4I")],
+	"global": [("particleCountMax", "I"), ("particleIndex", "I"), ("renderCount", "I"), ("cachedCount", "I"), ("newEmiitedCount", "I")],
+	"kernelConstants": [("workgroupSize", "I"), ("particleCountMax", "I"), ("gravity", "f"), ("lifetimeScale", "f")]
+}
+PARTICLE = [("pos", "4f"), ("color", "4f"), ("birthTick", "I"), ("instance", "I"), ("response", "2I")]
+ARRAYS = {
+	"spawn": PARTICLE,
+	"particle": PARTICLE,
+	"append": [("position", "4f"), ("instance", "I"), ("pad", "3I")]
+}
+
+def layout_struct(layout):
+	return struct.Struct("<" + "".join(fmt for _, fmt in layout))
+
+def unpack(layout, data, offset=0):
+	values = layout_struct(layout).unpack_from(data, offset)
+	result = []
+	index = 0
+	for name, fmt in layout:
+		count = int(fmt[:-1]) if len(fmt) > 1 else 1
+		field = values[index:index + count]
+		result.append((name, field[0] if count == 1 else list(field)))
+		index += count
+	return result
+
+def format_value(value):
+	if isinstance(value, list):
+		return "(" + ", ".join(format_value(v) for v in value) + ")"
+	if isinstance(value, float):
+		return "%.6g" % value
+	return str(value)
+
+def load(path):
+	with open(path, "rb") as f:
+		data = f.read()
+	magic, version, chunk_count, frame = HEADER.unpack_from(data, 0)
+	if magic != MAGIC:
+		sys.exit("Error: %s is not a readback file" % path)
+	if version != VERSION:
+		sys.exit("Error: %s has version %d, expected %d" % (path, version, VERSION))
+	chunks = {}
+	offset = HEADER.size
+	for _ in range(chunk_count):
+		name, chunk_type, fmt, width, height, size = CHUNK_HEADER.unpack_from(data, offset)
+		offset += CHUNK_HEADER.size
+		if offset + size > len(data):
+			sys.exit("Error: %s is truncated" % path)
+		name = name.split(b"\0", 1)[0].decode()
+		chunks[name] = { "type": chunk_type, "format": fmt, "width": width, "height": height, "data": data[offset:offset + size] }
+		offset += size
+	return frame, chunks
+
+def array_elements(name, chunk):
+	layout = ARRAYS[name]
+	stride = layout_struct(layout).size
+	for i in range(len(chunk["data"]) // stride):
+		yield unpack(layout, chunk["data"], i * stride)
+
+def depth_values(chunk):
+	_, fmt, mask = DEPTH_FORMATS[chunk["format"]]
+	values = struct.iter_unpack(fmt, chunk["data"])
+	if mask is None:
+		return [v[0] for v in values]
+	return [(v[0] & mask) / mask for v in values]
+
+def print_chunks(frame, chunks, count):
+	print("frame %d, %d chunks" % (frame, len(chunks)))
+	for name, chunk in chunks.items():
+		description = "%-16s %-6s %10d bytes" % (name, CHUNK_TYPES.get(chunk["type"], "?"), len(chunk["data"]))
+		if chunk["type"] == 1:
+			format_name = DEPTH_FORMATS[chunk["format"]][0] if chunk["format"] in DEPTH_FORMATS else "format %d" % chunk["format"]
+			description += "  %dx%d %s" % (chunk["width"], chunk["height"], format_name)
+		print(description)
+		if name in STRUCTS and len(chunk["data"]) >= layout_struct(STRUCTS[name]).size:
+			for field, value in unpack(STRUCTS[name], chunk["data"]):
+				print("    %-20s %s" % (field, format_value(value)))
+		elif name in ARRAYS:
+			for i, element in enumerate(array_elements(name, chunk)):
+				if i >= count:
+					break
+				print("    [%d] %s" % (i, ", ".join("%s %s" % (field, format_value(value)) for field, value in element if field != "pad")))
+		elif chunk["format"] in DEPTH_FORMATS:
+			values = depth_values(chunk)
+			print("    depth range %.6f - %.6f" % (min(values), max(values)))
+
+parser = argparse.ArgumentParser(description="Decode vks::Readback files")
+parser.add_argument("file")
+parser.add_argument("--count", type=int, default=4, help="elements of array chunks to print")
+parser.add_argument("--csv", nargs=2, metavar=("CHUNK", "OUTPUT"), help="write an array chunk as csv")
+parser.add_argument("--pgm", nargs=2, metavar=("CHUNK", "OUTPUT"), help="write a depth image chunk as 16 bit pgm")
+parser.add_argument("--raw", nargs=2, metavar=("CHUNK", "OUTPUT"), help="write the data of a chunk")
+args = parser.parse_args()
+
+frame, chunks = load(args.file)
+print_chunks(frame, chunks, args.count)
+
+for option in (args.csv, args.pgm, args.raw):
+	if option and option[0] not in chunks:
+		sys.exit("Error: %s has no %s chunk" % (args.file, option[0]))
+
+if args.csv:
+	name, output = args.csv
+	if name not in ARRAYS:
+		sys.exit("Error: %s is not an array chunk" % name)
+	with open(output, "w") as f:
+		columns = []
+		for field, fmt in ARRAYS[name]:
+			count = int(fmt[:-1]) if len(fmt) > 1 else 1
+			if field != "pad":
+				columns += [field] if count == 1 else ["%s%d" % (field, i) for i in range(count)]
+		f.write(",".join(columns) + "\n")
+		for element in array_elements(name, chunks[name]):
+			values = []
+			for field, value in element:
+				if field != "pad":
+					values += value if isinstance(value, list) else [value]
+			f.write(",".join(format_value(v) for v in values) + "\n")
+	print("wrote %s" % output)
+
+if args.pgm:
+	name, output = args.pgm
+	chunk = chunks[name]
+	if chunk["format"] not in DEPTH_FORMATS:
+		sys.exit("Error: %s is not a depth image chunk" % name)
+	values = depth_values(chunk)
+	with open(output, "wb") as f:
+		f.write(b"P5\n%d %d\n65535\n" % (chunk["width"], chunk["height"]))
+		f.write(b"".join(struct.pack(">H", int(min(max(v, 0.0), 1.0) * 65535.0 + 0.5)) for v in values))
+	print("wrote %s" % output)
+
+if args.raw:
+	name, output = args.raw
+	with open(output, "wb") as f:
+		f.write(chunks[name]["data"])
+	print("wrote %s" % output)
@@ -0,0 +1,75 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+// LSD radix sort of 32 bit keys with 32 bit values, see base/VulkanRadixSort.hpp
+// Each pass sorts by 8 bits of the key: radixsort_histogram.comp counts the digits of each block,
+// radixsort_scan.comp scans the counts of each digit across the blocks and radixsort_scatter.comp
+// moves the elements of each block to their sorted position, keeping the order of equal digits
+
+#define RADIX_SORT_WORKGROUP_SIZE 256
+#define RADIX_SORT_BINS 256
+// Elements of a block, processed by one work group in chunks of one element per invocation
+#define RADIX_SORT_BLOCK_CHUNKS 16
+#define RADIX_SORT_BLOCK_SIZE (RADIX_SORT_WORKGROUP_SIZE * RADIX_SORT_BLOCK_CHUNKS)
+
+// Indirect dispatch of the block kernels, and the element count clamped to the scratch size
+layout (std430, binding = 0) buffer State
+{
+	uint blockCount;
+	uint dispatchY;
+	uint dispatchZ;
+	uint count;
+} state;
+
+layout (std430, binding = 1) readonly buffer KeysIn
+{
+	uint keysIn[];
+};
+
+layout (std430, binding = 2) readonly buffer ValuesIn
+{
+	uint valuesIn[];
+};
+
+layout (std430, binding = 3) writeonly buffer KeysOut
+{
+	uint keysOut[];
+};
+
+layout (std430, binding = 4) writeonly buffer ValuesOut
+{
+	uint valuesOut[];
+};
+
+// Digit counts of the blocks, digit major, scanned to the offset of each block within its digit
+layout (std430, binding = 5) buffer BlockHistograms
+{
+	uint blockHistograms[];
+};
+
+// Element count of each digit
+layout (std430, binding = 6) buffer DigitTotals
+{
+	uint digitTotals[RADIX_SORT_BINS];
+};
+
+layout (std430, binding = 7) readonly buffer CountBuffer
+{
+	uint counts[];
+};
+
+layout (push_constant) uniform PushConstants
+{
+	// First key bit of the pass
+	uint shift;
+	// Index of the element count in the count buffer
+	uint countIndex;
+	uint maxCount;
+} pushConstants;
+
+uint radixDigit(uint key)
+{
+	return (key >> pushConstants.shift) & (RADIX_SORT_BINS - 1);
+}
+
+#endif
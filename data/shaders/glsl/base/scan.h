@@ -0,0 +1,148 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+// Scan, stream compaction and segmented reduction of uint values, see base/VulkanScanPrimitives.hpp
+// The scans and the compaction reduce then scan: scan_reduce.comp sums each block, scan_blocks.comp scans the
+// block sums in a single work group and scan_downsweep.comp scans each block again, starting at its block offset.
+// Each invocation handles SCAN_ITEMS consecutive elements of a block.
+// The SUBGROUP_ARITHMETIC variant scans within the subgroups first and only the subgroup sums in shared memory.
+
+#define SCAN_ITEMS 8
+
+// Operation of the pipeline
+#define SCAN_EXCLUSIVE 0
+#define SCAN_INCLUSIVE 1
+#define SCAN_COMPACT 2
+#define SCAN_SEGMENTS 3
+layout (constant_id = 0) const uint SCAN_MODE = SCAN_EXCLUSIVE;
+
+// Indirect dispatch of the block kernels, and the element count clamped to the scratch size
+layout (std430, binding = 0) buffer State
+{
+	uint blockCount;
+	uint dispatchY;
+	uint dispatchZ;
+	uint count;
+} state;
+
+layout (std430, binding = 1) readonly buffer Input
+{
+	uint inputValues[];
+};
+
+// Elements with a non zero flag are kept by the compaction
+layout (std430, binding = 2) readonly buffer Flags
+{
+	uint flags[];
+};
+
+layout (std430, binding = 3) writeonly buffer Output
+{
+	uint outputValues[];
+};
+
+// Sum of each block, scanned to the block offsets
+layout (std430, binding = 4) buffer BlockSums
+{
+	uint blockSums[];
+};
+
+layout (std430, binding = 5) readonly buffer Counts
+{
+	uint counts[];
+};
+
+// Total of the scans, element count of the compaction
+layout (std430, binding = 6) writeonly buffer Totals
+{
+	uint totals[];
+};
+
+// Segment i of the segmented reduction covers the elements segmentOffsets[i] to segmentOffsets[i + 1]
+layout (std430, binding = 7) readonly buffer SegmentOffsets
+{
+	uint segmentOffsets[];
+};
+
+layout (push_constant) uniform PushConstants
+{
+	// Index of the element or segment count in the count buffer
+	uint countIndex;
+	uint maxCount;
+	// Index of the total in the totals buffer
+	uint totalIndex;
+	// Elements of a block, gl_WorkGroupSize.x * SCAN_ITEMS of the block kernels
+	uint blockSize;
+} pushConstants;
+
+// Value of an element as summed by the operation
+uint scanValue(uint index)
+{
+	if (SCAN_MODE == SCAN_COMPACT)
+	{
+		return flags[index] != 0 ? 1u : 0u;
+	}
+	return inputValues[index];
+}
+
+shared uint scanShared[gl_WorkGroupSize.x];
+shared uint scanTotal;
+
+// Exclusive scan over the work group, the total is returned in sum
+uint workgroupExclusiveScan(uint value, out uint sum)
+{
+	uint index = gl_LocalInvocationIndex;
+#ifdef SUBGROUP_ARITHMETIC
+	uint inclusive = subgroupInclusiveAdd(value);
+	if (gl_SubgroupInvocationID == gl_SubgroupSize - 1 || index == gl_WorkGroupSize.x - 1)
+	{
+		scanShared[gl_SubgroupID] = inclusive;
+	}
+	barrier();
+
+	// The first subgroup scans the subgroup sums, in steps of its size
+	if (gl_SubgroupID == 0)
+	{
+		uint carry = 0;
+		for (uint first = 0; first < gl_NumSubgroups; first += gl_SubgroupSize)
+		{
+			uint subgroup = first + gl_SubgroupInvocationID;
+			uint subgroupSum = subgroup < gl_NumSubgroups ? scanShared[subgroup] : 0;
+			uint offset = subgroupExclusiveAdd(subgroupSum) + carry;
+			if (subgroup < gl_NumSubgroups)
+			{
+				scanShared[subgroup] = offset;
+			}
+			carry += subgroupAdd(subgroupSum);
+		}
+		if (gl_SubgroupInvocationID == 0)
+		{
+			scanTotal = carry;
+		}
+	}
+	barrier();
+	uint exclusive = scanShared[gl_SubgroupID] + inclusive - value;
+#else
+	scanShared[index] = value;
+	barrier();
+	for (uint stride = 1; stride < gl_WorkGroupSize.x; stride *= 2)
+	{
+		uint preceding = index >= stride ? scanShared[index - stride] : 0;
+		barrier();
+		scanShared[index] += preceding;
+		barrier();
+	}
+	if (index == gl_WorkGroupSize.x - 1)
+	{
+		scanTotal = scanShared[index];
+	}
+	barrier();
+	uint exclusive = scanShared[index] - value;
+#endif
+	sum = scanTotal;
+	// The shared memory may be reused right after
+	barrier();
+	return exclusive;
+}
+
+#endif
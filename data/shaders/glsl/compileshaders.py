@@ -1,6 +1,8 @@
 import argparse
 import fileinput
+import itertools
 import os
+import re
 import subprocess
 import sys
 
@@ -31,26 +33,72 @@ def findCompiler(compiler_name):
 compiler_path = findCompiler("glslc")
 dir_path = os.path.dirname(os.path.realpath(__file__))
 dir_path = dir_path.replace('\\', '/')
+
+# Shader variants, compiled in addition to the default SPIR-V for shaders that test the variant's define
+# The default is the release build, e.g. gpu_cmd.comp.spv, a variant is written to gpu_cmd.comp.<variant>.spv
+# A shader testing several defines is compiled for every combination of them, with the variant names joined in the
+# order below, e.g. particle.comp.debug.collision.spv. The examples build the file names in the same order.
+VARIANTS = {
+    # debugPrintfEXT instrumentation, requires VK_KHR_shader_non_semantic_info
+    "debug": "SHADER_DEBUG",
+    # Packed 64 bit depth and color of the meshparticles compute rasterizer, requires shaderSharedInt64Atomics
+    "atomic64": "PARTICLE_RASTER_ATOMIC64",
+    # Subgroup arithmetic of the scan primitives in base/, requires Vulkan 1.1
+    "subgroup": "SUBGROUP_ARITHMETIC",
+    # Depth buffer collisions of the meshparticles simulation
+    "collision": "PARTICLE_COLLISION"
+}
+
+# Additional compiler parameters of a variant
+VARIANT_PARAMS = {
+    "subgroup": ["--target-env=vulkan1.1"]
+}
+
+# Source of a shader with the files it includes, relative to the including file as glslc resolves them, so that
+# defines tested in headers select the variants of every shader including them
+def readSource(input_file, included=None):
+    if included is None:
+        included = set()
+    input_file = os.path.normpath(input_file)
+    if input_file in included or not os.path.isfile(input_file):
+        return ""
+    included.add(input_file)
+    with open(input_file, encoding='utf-8', errors='replace') as f:
+        source = f.read()
+    for header in re.findall(r'^\s*#\s*include\s*"([^"]+)"', source, re.MULTILINE):
+        source += readSource(os.path.join(os.path.dirname(input_file), header), included)
+    return source
+
+def compile(input_file, output_file, add_params):
+    cmd = [compiler_path] + add_params + [input_file, "-o", output_file]
+    res = subprocess.run(cmd, capture_output=True, text=True, encoding='utf-8')
+    if res.returncode == 0:
+        print('compile succeed: {}'.format(output_file))
+    else:
+        print(res.stderr)
+        sys.exit()
+
 for root, dirs, files in os.walk(dir_path):
     for file in files:
-        if file.endswith(".vert") or file.endswith(".frag") or file.endswith(".comp") or file.endswith(".geom") or file.endswith(".tesc") or file.endswith(".tese") or file.endswith(".rgen") or file.endswith(".rchit") or file.endswith(".rmiss"):
+        if file.endswith(".vert") or file.endswith(".frag") or file.endswith(".comp") or file.endswith(".geom") or file.endswith(".tesc") or file.endswith(".tese") or file.endswith(".mesh") or file.endswith(".rgen") or file.endswith(".rchit") or file.endswith(".rmiss"):
             input_file = os.path.join(root, file)
             output_file = input_file + ".spv"
 
-            add_params = ""
+            add_params = []
             if args.g:
-                add_params = "-g -O0"
-
-            if file.endswith(".rgen") or file.endswith(".rchit") or file.endswith(".rmiss"):
-               add_params = add_params + " --target-env vulkan1.2"
-
-            # res = subprocess.call("%s -V %s -o %s %s" % (compiler_path, input_file, output_file, add_params), shell=True)
-            cmd = [compiler_path, input_file, "-o", output_file]
-            if add_params:
-                cmd.insert(1, add_params)
-            res = subprocess.run([compiler_path, input_file, "-o", output_file], capture_output=True, text=True, encoding='utf-8')
-            if res.returncode == 0:
-                print('compile succeed: {}'.format(input_file))
-            else:
-                print(res.stderr)
-                sys.exit()
\ No newline at end of file
+                add_params += ["-g", "-O0"]
+
+            # Ray tracing and mesh shaders require SPIR-V 1.4
+            if file.endswith(".rgen") or file.endswith(".rchit") or file.endswith(".rmiss") or file.endswith(".mesh"):
+               add_params += ["--target-env=vulkan1.2"]
+
+            compile(input_file, output_file, add_params)
+
+            source = readSource(input_file)
+            variants = [variant for variant, define in VARIANTS.items() if define in source]
+            for count in range(1, len(variants) + 1):
+                for combination in itertools.combinations(variants, count):
+                    variant_params = []
+                    for variant in combination:
+                        variant_params += VARIANT_PARAMS.get(variant, []) + ["-D" + VARIANTS[variant]]
+                    compile(input_file, input_file + "." + ".".join(combination) + ".spv", add_params + variant_params)
@@ -1,4 +1,6 @@
 
+#include "gpu_cmd.h"
+
 layout(binding = 0) uniform UBOModel
 {
 	float modelAlpha;
@@ -10,17 +12,10 @@ layout(binding = 1) uniform UBOView
 	mat4 viewProj;
 	mat4 invViewProj;
 	vec2 viewport;
+	float spriteSize;			// world space size of the particle sprites, zero unless they are drawn
+	float spritePixelScale;		// projected size in pixels of a sprite of size 1 at clip space w = 1
 } viewData;
 
-struct ParticleSystem
-{
-	vec3 wind;
-	float deltaT;
-	float speed;
-	float random;
-	uint frameNum;
-};
-
 layout(std140, binding = 2) uniform ParticleSystemBuffer
 {
 	ParticleSystem particleSystem;
@@ -1,3 +1,4 @@
+#include "gpu_cmd.h"
 
 layout(binding = 0) uniform UBOModel
 {
@@ -11,10 +12,12 @@ layout(binding = 1) uniform UBOView
 	mat4 viewProj;
 	mat4 invViewProj;
 	vec2 viewport;
+	float spriteSize;			// world space size of the particle sprites, zero unless they are drawn
+	float spritePixelScale;		// projected size in pixels of a sprite of size 1 at clip space w = 1
 } viewData;
 
-layout(binding = 2) uniform UBOInstance
+layout(std430, binding = 2) readonly buffer SSBOInstance
 {
-	mat4 transform[2];
+	InstanceData instances[];
 } instanceData;
 
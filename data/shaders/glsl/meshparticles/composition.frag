@@ -3,6 +3,9 @@
 layout (binding = 0) uniform sampler2D samplerSceneAlbedo;
 layout (binding = 1) uniform sampler2D samplerParticleAlbedo;
 
+// The particles were drawn with particle_blend.frag into an accumulation target
+layout (constant_id = 0) const bool PARTICLE_BLENDED = false;
+
 layout (location = 0) in vec2 inUV;
 
 layout (location = 0) out vec4 outFragColor;
@@ -12,6 +15,15 @@ void main()
 	vec4 sceneAlbedo = texture(samplerSceneAlbedo, inUV);
 	vec4 particleAlbedo = texture(samplerParticleAlbedo, inUV);
 
+	if (PARTICLE_BLENDED)
+	{
+		// Red holds the weighted gray sum, green the weight sum and alpha the transmittance of all particles of the pixel
+		float coverage = 1.0 - particleAlbedo.a;
+		float gray = particleAlbedo.r / max(particleAlbedo.g, 0.00001);
+		outFragColor = mix(sceneAlbedo, vec4(0.0, gray, 0.7, 1.0), clamp(coverage, 0.0, 1.0));
+		return;
+	}
+
 	if (particleAlbedo.a > 0)
 	{
 		//outFragColor = vec4(particleAlbedo.r, particleAlbedo.g, particleAlbedo.b, 1.0);
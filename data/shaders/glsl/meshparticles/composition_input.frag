@@ -0,0 +1,23 @@
+#version 450
+
+// Composition in the merged render pass, the scene and particle colors
+// of the current pixel are read from the earlier subpasses
+layout (input_attachment_index = 0, binding = 0) uniform subpassInput inputSceneAlbedo;
+layout (input_attachment_index = 1, binding = 1) uniform subpassInput inputParticleAlbedo;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main()
+{
+	vec4 sceneAlbedo = subpassLoad(inputSceneAlbedo);
+	vec4 particleAlbedo = subpassLoad(inputParticleAlbedo);
+
+	if (particleAlbedo.a > 0)
+	{
+		outFragColor = vec4(0.0, particleAlbedo.g, 0.7, 1.0);
+	}
+	else
+	{
+		outFragColor = sceneAlbedo;
+	}
+}
@@ -3,6 +3,7 @@
 #include "common_scene.h"
 
 layout (location = 1) in vec2 inUV;
+layout (location = 4) flat in uint inInstanceIndex;
 
 layout (binding = 3) uniform sampler2D particleSpawn;
 
@@ -13,7 +14,7 @@ void main()
 
 	// As alpha reference value increase,
 	// model alpha which is less than alpha reference will be invisable.
-	if (modelAlpha < modelData.alphaReference)
+	if (modelAlpha < instanceData.instances[inInstanceIndex].alphaReference)
 	{
 		discard;
 	}
@@ -1,6 +1,5 @@
-
-// Work group size of particle.comp
-#define PARTICLE_COMPUTE_WORKGROUP_SIZE 64
+#ifndef GPU_CMD_H
+#define GPU_CMD_H
 
 struct VkDispatchIndirectCommand
 {
@@ -17,19 +16,103 @@ struct VkDrawIndirectCommand
 	uint    firstInstance;
 };
 
+// Spawn candidates are double buffered with async compute, the scene pass of a frame appends to
+// one slot while the simulation on the compute queue consumes the other. Otherwise only slot 0 is used.
+#define SPAWN_CANDIDATE_SLOTS 2
+
 struct GpuCmdBuffer
 {
-	uint particleCount;                      // particle count emitted this frame
+	uint particleCount[SPAWN_CANDIDATE_SLOTS];      // spawn candidates accepted into each slot, reset by gpu_cmd.comp
+	float spawnProbability[SPAWN_CANDIDATE_SLOTS];  // fraction of spawn candidates accepted into each slot, adapted to the spawn budget
+	uint appendBudget[SPAWN_CANDIDATE_SLOTS];       // spawn budget each slot was filled under, written by its first append
 	VkDispatchIndirectCommand dispatchCmd;
 	VkDrawIndirectCommand drawCmd;
 };
 
 struct GlobalParticleData
 {
-	uint particleCountMax;		// ring buffer size, never change
+	uint particleCountMax;		// ring buffer size, equals PARTICLE_COUNT_MAX of particle_constants.h, never change
 	uint particleIndex;			// ring buffer index
 	uint renderCount;			// particle render count this frame, equals compute shader thread count
-	uint cachedCount;			// slot count in particle ring buffer before current particleIndex
+	uint cachedCount;			// slot count in particle ring buffer before the newly emitted particles
 	uint newEmiitedCount;		// newly emitted particle count this frame
 };
 
+// Per-frame statistics are kept for the last frames, so the host can read them without waiting
+#define PARTICLE_STATS_FRAMES 4
+
+// Written by gpu_cmd.comp to slot frameNum % PARTICLE_STATS_FRAMES
+struct ParticleStats
+{
+	uint frame;					// frameNum of the statistics
+	uint newEmittedCount;		// particles emitted this frame
+	uint renderCount;			// particles simulated this frame
+	uint cachedCount;			// particles in the ring buffer before the newly emitted ones
+	uint ringWraps;				// ring buffer wraps since the start
+	uint dispatchGroups;		// work groups of the simulation
+	uint drawVertexCount;		// live particles drawn, written by gpu_cmd.comp of the next frame
+};
+
+// Spawn candidate subsampling when over budget
+#define SPAWN_SAMPLING_STOCHASTIC 0
+#define SPAWN_SAMPLING_STRATIFIED 1
+
+// Spawn candidates are either scene fragments, or points of the surface point set
+#define SPAWN_SOURCE_SCREEN 0
+#define SPAWN_SOURCE_SURFACE 1
+
+struct ParticleSystem
+{
+	vec3 wind;
+	float deltaT;				// frame time, the simulation advances in ticks
+	float speed;				// lifetime in ticks is speed / PARTICLE_LIFETIME_SCALE
+	uint seed;					// seed of the random numbers, offset by the tick, see random.h
+	uint frameNum;
+	uint spawnBudget;			// maximum particle count emitted per frame
+	uint spawnSampling;			// SPAWN_SAMPLING_*
+	uint spawnSource;			// SPAWN_SOURCE_*
+	uint candidateWriteSlot;	// slot scene.frag and emit.comp append the spawn candidates to
+	uint candidateReadSlot;		// slot the simulation consumes
+	uint candidateSlotSize;		// append jobs per slot
+	uint collision;				// nonzero to collide the particles with the depth only pass, see particle.comp
+	float restitution;			// fraction of the normal velocity a collision reflects
+	float friction;				// fraction of the tangential velocity a collision removes
+	vec3 turbulenceOffset;		// scroll of the turbulence field in texture coordinates
+	float turbulenceAmplitude;	// turbulence velocity scale, 0 disables it
+	float turbulenceFrequency;	// turbulence field repetitions per world space unit
+	uint tick;					// simulation ticks before this frame
+	uint substeps;				// ticks simulated this frame
+	float tickTime;				// fixed tick length in seconds
+	float interpolation;		// fraction of the next tick that has passed at the frame time
+	float emissionLodSize;		// projected instance radius (radius / distance) below which emission thins out, 0 disables it
+	float instanceRadius;		// object space bounding radius of an instance
+	uint simulationLodLevels;	// halvings of the simulation rate of far particles, 0 to 2
+	vec3 lodCamera;				// world space camera position of the level of detail
+	float simulationLodDistance;	// camera distance beyond which the simulation rate halves, again at twice it
+};
+
+// The spawn position is resolved when the candidate is appended, in every mode.
+// The simulation consumes the candidates after the frame that appended them, with
+// async compute one frame later on another queue, when the depth and color targets
+// and the instance transforms of that frame are no longer available. Resolving them
+// early also keeps screen and surface spawns on the same path.
+// The particle gray is the spawn texture value of the candidate rather than the lit
+// scene color, so it doesn't include the vertex color of the mesh.
+struct AppendJob
+{
+	vec4 position;				// world space position in xyz, spawn texture value in w
+	uint instance;				// instance the particle is spawned from
+};
+
+struct InstanceData
+{
+	mat4 transform;
+	// Dissolve state of this instance
+	float alphaReference;
+	float dissolveSpeed;
+	float dissolveStart;
+	float alphaDelta;			// estimated alpha reference change until next frame, zero when not dissolving
+};
+
+#endif
+
@@ -0,0 +1,37 @@
+#version 450
+
+#extension GL_EXT_samplerless_texture_functions : require
+
+#include "common_particle.h"
+
+// Depth of the depth only pass
+layout (binding = 3) uniform texture2D depthTexture;
+
+layout (location = 0) in vec4 inColor;
+
+layout (location = 0) out vec4 outFragColor;
+
+// Particles are spawned on the surfaces of the depth only pass, so they are tested against it with a bias
+#define PARTICLE_BLEND_DEPTH_BIAS 0.0001
+
+void main() 
+{
+	// The lifetime fades the particle out
+	float alpha = clamp(inColor.a, 0.0, 1.0);
+	if (alpha <= 0.0)
+	{
+		discard;
+	}
+
+	float sceneDepth = texelFetch(depthTexture, ivec2(gl_FragCoord.xy), 0).r;
+	if (gl_FragCoord.z > sceneDepth + PARTICLE_BLEND_DEPTH_BIAS)
+	{
+		discard;
+	}
+
+	// Weighted blended order independent transparency (McGuire and Bavoil) with their weight for window space depth
+	// Red and green are blended additively into the weighted gray sum and the weight sum,
+	// alpha multiplicatively into the transmittance, see the blend state of the particle pipeline
+	float weight = alpha * clamp(3000.0 * pow(1.0 - gl_FragCoord.z, 3.0), 0.01, 3000.0);
+	outFragColor = vec4(inColor.g * weight, weight, 0.0, alpha);
+}
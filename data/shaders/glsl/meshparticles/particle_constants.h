@@ -0,0 +1,12 @@
+#ifndef PARTICLE_CONSTANTS_H
+#define PARTICLE_CONSTANTS_H
+
+// Specialization constants of particle.comp and gpu_cmd.comp, set by prepareComputePipelines()
+// The defaults are the values the kernels used to be built with
+
+layout (constant_id = 0) const uint PARTICLE_COMPUTE_WORKGROUP_SIZE = 64;	// work group size of particle.comp
+layout (constant_id = 1) const uint PARTICLE_COUNT_MAX = 1310720;			// ring buffer size
+layout (constant_id = 2) const float PARTICLE_GRAVITY = 0.2;				// upward velocity, scaled by the random number of a particle
+layout (constant_id = 3) const float PARTICLE_LIFETIME_SCALE = 0.01;		// lifetime a particle loses per tick at speed 1
+
+#endif
@@ -0,0 +1,37 @@
+#version 450
+
+#extension GL_EXT_samplerless_texture_functions : require
+
+#include "common_particle.h"
+
+// Depth of the depth only pass
+layout (binding = 3) uniform texture2D depthTexture;
+
+// Coverage of the sprite in red, generated by prepareParticleSprites()
+layout (binding = 5) uniform sampler2D spriteTexture;
+
+layout (location = 0) in vec4 inColor;
+layout (location = 1) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+// Particles are spawned on the surfaces of the depth only pass, so they are tested against it with a bias
+#define PARTICLE_SPRITE_DEPTH_BIAS 0.0001
+
+void main() 
+{
+	// The particle target is opaque, so the sprite shape is alpha tested
+	float coverage = texture(spriteTexture, inUV).r;
+	if (inColor.a <= 0.0 || coverage < 0.5)
+	{
+		discard;
+	}
+
+	float sceneDepth = texelFetch(depthTexture, ivec2(gl_FragCoord.xy), 0).r;
+	if (gl_FragCoord.z > sceneDepth + PARTICLE_SPRITE_DEPTH_BIAS)
+	{
+		discard;
+	}
+
+	outFragColor = vec4(inColor.rgb * coverage, inColor.a);
+}
@@ -0,0 +1,45 @@
+#version 450
+
+#include "common_particle.h"
+#include "sprite.h"
+
+struct Particle
+{
+	vec4 pos;
+	vec4 color;
+	uint birthTick;
+	uint instance;
+};
+
+layout(binding = 4) readonly buffer ParticleBuffer
+{
+	Particle particles[];
+};
+
+layout (location = 0) out vec4 outColor;
+layout (location = 1) out vec2 outUV;
+
+// Two triangles per particle, drawn without vertex or index buffers
+const vec2 corners[6] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0), vec2(-1.0, 1.0), vec2(1.0, -1.0), vec2(1.0, 1.0));
+
+void main()
+{
+	Particle particle = particles[gl_VertexIndex / 6];
+	vec2 corner = corners[gl_VertexIndex % 6];
+
+	vec4 clip = viewData.viewProj * vec4(particle.pos.xyz, 1.0);
+	float pixels = spritePixels(clip.w, viewData.spriteSize, viewData.spritePixelScale);
+	if (!spriteDrawn(pixels) || particle.color.a <= 0.0)
+	{
+		// All vertices of the quad collapse to a point outside of the view volume
+		gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+		outColor = vec4(0.0);
+		outUV = vec2(0.0);
+		return;
+	}
+
+	clip.xy += corner * spriteExtent(pixels, viewData.viewport) * clip.w;
+	gl_Position = clip;
+	outColor = particle.color;
+	outUV = corner * 0.5 + 0.5;
+}
@@ -0,0 +1,70 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+// Compute rasterizer of the particles: raster_bin.comp bins the splat pixels of the live particles into screen tiles,
+// raster_scan.comp reserves the entry range of each tile and raster_tile.comp resolves one tile per work group
+
+// Screen tiles of PARTICLE_RASTER_TILE_SIZE x PARTICLE_RASTER_TILE_SIZE pixels
+#define PARTICLE_RASTER_TILE_SIZE 16
+#define PARTICLE_RASTER_TILE_PIXELS (PARTICLE_RASTER_TILE_SIZE * PARTICLE_RASTER_TILE_SIZE)
+
+// Invocations of raster_scan.comp
+#define PARTICLE_RASTER_SCAN_SIZE 256
+
+// Particles cover 2x2 pixels, as the points of particle.vert
+#define PARTICLE_RASTER_SPLAT_SIZE 2
+
+// Particles are spawned on the surfaces of the depth only pass, so they are tested against it with a bias
+#define PARTICLE_RASTER_DEPTH_BIAS 0.0001
+
+// The nearest particle of a pixel has the smallest value, empty pixels have all bits set
+#ifdef PARTICLE_RASTER_ATOMIC64
+
+// Float depth in the upper 32 bits and the color as rgba8 in the lower ones
+#define RasterValue uint64_t
+#define PARTICLE_RASTER_EMPTY 0xFFFFFFFFFFFFFFFFUL
+
+RasterValue packRasterValue(float depth, vec4 color)
+{
+	return (uint64_t(floatBitsToUint(depth)) << 32) | uint64_t(packUnorm4x8(color));
+}
+
+vec4 unpackRasterColor(RasterValue value)
+{
+	return unpackUnorm4x8(uint(value & 0xFFFFFFFFUL));
+}
+
+#else
+
+// Depth quantized to 16 bits in the upper half, the gray value and the lifetime in 8 bits each
+#define RasterValue uint
+#define PARTICLE_RASTER_EMPTY 0xFFFFFFFFu
+
+RasterValue packRasterValue(float depth, vec4 color)
+{
+	uint quantizedDepth = uint(clamp(depth, 0.0, 1.0) * 65534.0 + 0.5);
+	uint gray = uint(clamp(color.g, 0.0, 1.0) * 255.0 + 0.5);
+	uint lifetime = uint(clamp(color.a, 0.0, 1.0) * 255.0 + 0.5);
+	return (quantizedDepth << 16) | (gray << 8) | lifetime;
+}
+
+vec4 unpackRasterColor(RasterValue value)
+{
+	float gray = float((value >> 8) & 0xFFu) / 255.0;
+	return vec4(gray, gray, gray, float(value & 0xFFu) / 255.0);
+}
+
+#endif
+
+struct RasterEntry
+{
+	RasterValue value;
+	uint pixel;			// pixel index within the tile
+};
+
+uvec2 rasterTiles(vec2 viewport)
+{
+	return (uvec2(viewport) + PARTICLE_RASTER_TILE_SIZE - 1) / PARTICLE_RASTER_TILE_SIZE;
+}
+
+#endif
@@ -1,8 +1,7 @@
 #version 450
-#extension GL_EXT_debug_printf : enable
 
 #include "common_scene.h"
-#include "gpu_cmd.h"
+#include "spawn.h"
 
 layout(early_fragment_tests) in;
 
@@ -10,14 +9,10 @@ layout (location = 0) in vec3 inNormal;
 layout (location = 1) in vec2 inUV;
 layout (location = 2) in vec3 inColor;
 layout (location = 3) in vec3 inPos;
+layout (location = 4) flat in uint inInstanceIndex;
 
 layout (binding = 3) uniform sampler2D particleSpawn;
 
-struct AppendJob 
-{
-	vec2 screenPos;
-};
-
 layout(binding = 4) buffer AppendBuffer
 {
    AppendJob appendJobs[];
@@ -28,33 +23,63 @@ layout(binding = 5) buffer SSBOGpuCmdBuffer
    GpuCmdBuffer gpuCmdBuffer;
 };
 
+layout(std140, binding = 6) uniform ParticleSystemBuffer
+{
+	ParticleSystem particleSystem;
+};
+
 layout (location = 0) out vec4 outColor;
 
+// World space position of the fragment, reconstructed the same way as from the depth buffer
+vec3 fragmentWorldPosition()
+{
+	vec2 xy = mix(vec2(-1.0), vec2(1.0), gl_FragCoord.xy / viewData.viewport);
+	// The projection maps depth to [0, 1], as does the viewport
+	vec4 positionMW = viewData.invViewProj * vec4(xy, gl_FragCoord.z, 1.0);
+	return positionMW.xyz / positionMW.w;
+}
 
 void main() 
 {
+	InstanceData instance = instanceData.instances[inInstanceIndex];
+
 	float gray = texture(particleSpawn, inUV).r;
 	float modelAlpha = gray;
 
 	// As alpha reference value increase,
 	// model alpha which is less than alpha reference will be invisable.
-	if (modelAlpha < modelData.alphaReference)
+	if (modelAlpha < instance.alphaReference)
 	{
 		discard;
 	}
 
-	uint flag = floatBitsToUint(inUV.x) & 1;
-
 	// Determine if current pixel will be invisable next frame.
-	float nextAlphaReference = modelData.alphaReference + modelData.deltaAlphaEstimation;
-	if (modelAlpha < nextAlphaReference && flag != 0)
+	// With surface spawning the candidates are generated by emit.comp instead.
+	float nextAlphaReference = instance.alphaReference + instance.alphaDelta;
+	if (particleSystem.spawnSource == SPAWN_SOURCE_SCREEN && modelAlpha < nextAlphaReference &&
+		screenSpawnThreshold(uvec2(gl_FragCoord.xy), particleSystem.spawnSampling, particleSystem.frameNum) <
+			gpuCmdBuffer.spawnProbability[particleSystem.candidateWriteSlot] *
+			emissionLod(instance.transform, particleSystem.lodCamera, particleSystem.instanceRadius, particleSystem.emissionLodSize))
 	{
 		// If it's going to be invisable, append information in the append buffer,
 		// such that it can be replaced by particle next frame.
-		uint index = atomicAdd(gpuCmdBuffer.particleCount, 1);
-		appendJobs[index].screenPos = vec2(gl_FragCoord.x, gl_FragCoord.y);
+		uint index = atomicAdd(gpuCmdBuffer.particleCount[particleSystem.candidateWriteSlot], 1);
+
+		// The slot is consumed in a later frame, which may have a different budget
+		if (index == 0)
+		{
+			gpuCmdBuffer.appendBudget[particleSystem.candidateWriteSlot] = particleSystem.spawnBudget;
+		}
 
-		//debugPrintfEXT("index %d\n", index);
+		// The spawn probability is estimated from the previous frame,
+		// so the budget is additionally enforced as a hard limit.
+		if (index < particleSystem.spawnBudget)
+		{
+			index += particleSystem.candidateWriteSlot * particleSystem.candidateSlotSize;
+			// The candidate carries its world position and spawn texture value, see AppendJob
+			appendJobs[index].position = vec4(fragmentWorldPosition(), gray);
+			appendJobs[index].instance = inInstanceIndex;
+		}
 	}
 
 	outColor = vec4(gray, gray, gray, 1.0) * vec4(inColor, 1.0);
@@ -11,10 +11,11 @@ layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec2 outUV;
 layout (location = 2) out vec3 outColor;
 layout (location = 3) out vec3 outPos;
+layout (location = 4) flat out uint outInstanceIndex;
 
 void main() 
 {
-	mat4 model = instanceData.transform[gl_InstanceIndex];
+	mat4 model = instanceData.instances[gl_InstanceIndex].transform;
 	gl_Position = viewData.viewProj * model * inPos;
 	
 	outUV = inUV;
@@ -28,4 +29,5 @@ void main()
 	outNormal = normalMatrix * inNormal;
 
 	outColor = inColor;
+	outInstanceIndex = gl_InstanceIndex;
 }
@@ -0,0 +1,51 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include "gpu_cmd.h"
+#include "random.h"
+
+// Scale of the spawn probability of an instance by its projected size
+// Instances with a projected radius (radius / distance) above lodSize emit at full density, smaller ones at a density
+// proportional to their projected radius, which keeps the emission of many far instances bounded
+float emissionLod(mat4 transform, vec3 camera, float radius, float lodSize)
+{
+	if (lodSize <= 0.0)
+	{
+		return 1.0;
+	}
+	float distance = max(length(transform[3].xyz - camera), 1e-4);
+	float projectedRadius = radius * length(transform[0].xyz) / distance;
+	return min(projectedRadius / lodSize, 1.0);
+}
+
+// Threshold in [0, 1) a scene fragment has to be below to get accepted
+float screenSpawnThreshold(uvec2 pixel, uint sampling, uint frameNum)
+{
+	if (sampling == SPAWN_SAMPLING_STRATIFIED)
+	{
+		// 4x4 ordered dither, accepted candidates are spread evenly over the screen.
+		// The pattern is shifted every frame so that all pixels get their turn.
+		const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+		float threshold = (bayer[((pixel.y & 3u) << 2u) | (pixel.x & 3u)] + 0.5) / 16.0;
+		return fract(threshold + float(frameNum) * 0.618034);
+	}
+
+	// The hash of the particle random numbers, with the frame as the seed
+	return particleRandom(pixel.x, pixel.y, frameNum);
+}
+
+// Threshold in [0, 1) a surface point has to be below to get accepted
+float surfaceSpawnThreshold(uint point, uint instance, uint sampling, uint frameNum)
+{
+	if (sampling == SPAWN_SAMPLING_STRATIFIED)
+	{
+		// Emitting points are consecutive in the point set, a golden ratio sequence
+		// in fixed point spreads the accepted ones evenly over the range.
+		uint sequence = point * 2654435769u + (frameNum + instance) * 1640531527u;
+		return float(sequence >> 8u) / 16777216.0;
+	}
+
+	return particleRandom(point, instance, frameNum);
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#include "gpu_cmd.h"
+
+// Particle sprites: view facing quads of viewData.spriteSize world units, expanded by particle_sprite.vert or
+// particle_sprite.mesh. Sprites smaller than a pixel are splatted by the compute rasterizer instead.
+
+// Larger sprites are clamped to this size in pixels, so close particles don't cover the screen
+#define PARTICLE_SPRITE_MAX_PIXELS 32.0
+
+// Sprites per work group of particle_sprite.mesh
+#define PARTICLE_SPRITE_MESH_GROUP_SIZE 32
+
+// Written by sprite_cmd.comp from the live particle count of the simulation
+struct SpriteCmdBuffer
+{
+	VkDrawIndirectCommand drawCmd;				// 6 vertices per particle
+	VkDispatchIndirectCommand meshTasksCmd;		// PARTICLE_SPRITE_MESH_GROUP_SIZE particles per work group
+	uint spriteCount;
+};
+
+// Projected size in pixels of a sprite at clip space w, pixelScale is the size of a sprite of size 1 at w = 1
+float spritePixels(float clipW, float spriteSize, float pixelScale)
+{
+	return clipW > 0.0 ? spriteSize * pixelScale / clipW : 0.0;
+}
+
+// Sprites of at least a pixel are drawn, smaller ones are left to the compute rasterizer
+bool spriteDrawn(float pixels)
+{
+	return pixels >= 1.0;
+}
+
+// Half extent of a sprite in normalized device coordinates
+vec2 spriteExtent(float pixels, vec2 viewport)
+{
+	return vec2(min(pixels, PARTICLE_SPRITE_MAX_PIXELS)) / viewport;
+}
+
+#endif
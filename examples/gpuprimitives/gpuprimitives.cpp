@@ -0,0 +1,439 @@
+/*
+* Vulkan Example - Tests of the GPU sort and scan primitives of the framework
+*
+* Checks vks::RadixSort and vks::ScanPrimitives against the host and measures their throughput
+* over 1K to 16M elements.
+* Runs without a window or swap chain, the result is the exit code.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanInitializers.hpp"
+#include "VulkanRadixSort.hpp"
+#include "VulkanScanPrimitives.hpp"
+
+class GpuPrimitivesTest
+{
+public:
+	VkInstance instance = VK_NULL_HANDLE;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties deviceProperties{};
+	vks::VulkanDevice* vulkanDevice = nullptr;
+	VkDevice device = VK_NULL_HANDLE;
+	VkQueue queue = VK_NULL_HANDLE;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	// The subgroup arithmetic variants of the scan shaders are SPIR-V 1.3
+	uint32_t apiVersion = VK_API_VERSION_1_1;
+
+	GpuPrimitivesTest(uint32_t gpuIndex)
+	{
+		VkApplicationInfo appInfo = {};
+		appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+		appInfo.pApplicationName = "gpuprimitives";
+		appInfo.pEngineName = "gpuprimitives";
+		appInfo.apiVersion = apiVersion;
+
+		VkInstanceCreateInfo instanceCreateInfo = {};
+		instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+		instanceCreateInfo.pApplicationInfo = &appInfo;
+		VkResult result = vkCreateInstance(&instanceCreateInfo, nullptr, &instance);
+		// Vulkan 1.0 implementations may reject the 1.1 api version
+		if (result == VK_ERROR_INCOMPATIBLE_DRIVER) {
+			apiVersion = VK_API_VERSION_1_0;
+			appInfo.apiVersion = apiVersion;
+			result = vkCreateInstance(&instanceCreateInfo, nullptr, &instance);
+		}
+		VK_CHECK_RESULT(result);
+
+		uint32_t deviceCount = 0;
+		VK_CHECK_RESULT(vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr));
+		if (deviceCount == 0) {
+			vks::tools::exitFatal("No device with Vulkan support found", -1);
+		}
+		std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
+		VK_CHECK_RESULT(vkEnumeratePhysicalDevices(instance, &deviceCount, physicalDevices.data()));
+		if (gpuIndex >= deviceCount) {
+			std::cerr << "Selected device index " << gpuIndex << " is out of range, reverting to device 0\n";
+			gpuIndex = 0;
+		}
+		physicalDevice = physicalDevices[gpuIndex];
+		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+		std::cout << "Device: " << deviceProperties.deviceName << "\n";
+
+		// The primitives only need compute, the graphics queue is used as its family also supports timestamps
+		vulkanDevice = new vks::VulkanDevice(physicalDevice);
+		VkPhysicalDeviceFeatures enabledFeatures{};
+		VK_CHECK_RESULT(vulkanDevice->createLogicalDevice(enabledFeatures, {}, nullptr, false));
+		device = vulkanDevice->logicalDevice;
+		vkGetDeviceQueue(device, vulkanDevice->queueFamilyIndices.graphics, 0, &queue);
+
+		VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+		pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+	}
+
+	~GpuPrimitivesTest()
+	{
+		vkDestroyPipelineCache(device, pipelineCache, nullptr);
+		delete vulkanDevice;
+		vkDestroyInstance(instance, nullptr);
+	}
+
+	VkPhysicalDeviceSubgroupProperties getSubgroupProperties()
+	{
+		VkPhysicalDeviceSubgroupProperties subgroupProperties{};
+		subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+		if (apiVersion >= VK_API_VERSION_1_1 && deviceProperties.apiVersion >= VK_API_VERSION_1_1) {
+			VkPhysicalDeviceProperties2 deviceProperties2{};
+			deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			deviceProperties2.pNext = &subgroupProperties;
+			vkGetPhysicalDeviceProperties2(physicalDevice, &deviceProperties2);
+		}
+		return subgroupProperties;
+	}
+
+	// Sort random keys with vks::RadixSort and compare the keys and values with std::stable_sort on the host
+	// The values are the element indices, so equal keys have to keep their order. Every other size uses 16 bit keys
+	// with many equal ones. The element count is read from a buffer that is larger than the sorted range.
+	// The first run of each size is a warm-up, the fastest of the others counts.
+	bool runRadixSortTest()
+	{
+		const uint32_t minCount = 1024;
+		const uint32_t maxCount = 16 * 1024 * 1024;
+		const uint32_t runs = 4;
+		const bool timestamps = deviceProperties.limits.timestampComputeAndGraphics == VK_TRUE;
+		const double period = deviceProperties.limits.timestampPeriod / 1000000.0;
+
+		vks::RadixSort radixSort;
+		radixSort.create(vulkanDevice, getAssetPath() + "shaders/glsl/base/", maxCount, pipelineCache);
+
+		const VkDeviceSize size = (VkDeviceSize)maxCount * sizeof(uint32_t);
+		vks::Buffer keys, values, stagingKeys, stagingValues, count;
+		const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		const VkMemoryPropertyFlags hostMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &keys, size));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &values, size));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostMemory, &stagingKeys, size));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostMemory, &stagingValues, size));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemory, &count, sizeof(uint32_t)));
+		VK_CHECK_RESULT(stagingKeys.map());
+		VK_CHECK_RESULT(stagingValues.map());
+		VK_CHECK_RESULT(count.map());
+		radixSort.setBuffers(keys.buffer, values.buffer, count.buffer, 0);
+
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		if (timestamps) {
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = runs * 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+		}
+
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		const VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+		std::mt19937 generator(1);
+		bool passed = true;
+		std::cout << "GPU radix sort test, " << (radixSort.scratchSize(maxCount) >> 20) << " MB scratch:\n";
+		for (uint32_t elementCount = minCount, sizeIndex = 0; elementCount <= maxCount; elementCount *= 4, sizeIndex++) {
+			const uint32_t keyMask = (sizeIndex % 2 == 0) ? 0xFFFFFFFFu : 0xFFFFu;
+			std::vector<std::pair<uint32_t, uint32_t>> reference(elementCount);
+			uint32_t* hostKeys = static_cast<uint32_t*>(stagingKeys.mapped);
+			uint32_t* hostValues = static_cast<uint32_t*>(stagingValues.mapped);
+			for (uint32_t i = 0; i < elementCount; i++) {
+				reference[i] = std::make_pair(generator() & keyMask, i);
+				hostKeys[i] = reference[i].first;
+				hostValues[i] = i;
+			}
+			*static_cast<uint32_t*>(count.mapped) = elementCount;
+
+			// Each run sorts the same input again
+			const VkBufferCopy region = { 0, 0, elementCount * sizeof(uint32_t) };
+			VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			if (timestamps) {
+				vkCmdResetQueryPool(commandBuffer, queryPool, 0, runs * 2);
+			}
+			for (uint32_t run = 0; run < runs; run++) {
+				vkCmdCopyBuffer(commandBuffer, stagingKeys.buffer, keys.buffer, 1, &region);
+				vkCmdCopyBuffer(commandBuffer, stagingValues.buffer, values.buffer, 1, &region);
+				vkCmdPipelineBarrier(commandBuffer, stages, stages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+				if (timestamps) {
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, run * 2);
+				}
+				radixSort.record(commandBuffer);
+				if (timestamps) {
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, run * 2 + 1);
+				}
+				vkCmdPipelineBarrier(commandBuffer, stages, stages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
+			vkCmdCopyBuffer(commandBuffer, keys.buffer, stagingKeys.buffer, 1, &region);
+			vkCmdCopyBuffer(commandBuffer, values.buffer, stagingValues.buffer, 1, &region);
+			memoryBarrier.dstAccessMask |= VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			vulkanDevice->flushCommandBuffer(commandBuffer, queue, true);
+
+			std::stable_sort(reference.begin(), reference.end(),
+				[](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) { return a.first < b.first; });
+			uint32_t mismatches = 0;
+			for (uint32_t i = 0; i < elementCount; i++) {
+				if (hostKeys[i] != reference[i].first || hostValues[i] != reference[i].second) {
+					mismatches++;
+				}
+			}
+			passed &= (mismatches == 0);
+
+			std::cout << "  " << elementCount << " elements, " << (keyMask == 0xFFFFu ? "16" : "32") << " bit keys: ";
+			if (timestamps) {
+				std::vector<uint64_t> results(runs * 2);
+				VK_CHECK_RESULT(vkGetQueryPoolResults(device, queryPool, 0, runs * 2, sizeof(uint64_t) * results.size(), results.data(),
+					sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+				double time = std::numeric_limits<double>::max();
+				for (uint32_t run = 1; run < runs; run++) {
+					time = std::min(time, (double)(results[run * 2 + 1] - results[run * 2]) * period);
+				}
+				std::cout << time << " ms, " << (double)elementCount / (time * 1000.0) << " M keys/s, ";
+			}
+			std::cout << (mismatches == 0 ? "passed" : "FAILED (" + std::to_string(mismatches) + " mismatches)") << "\n";
+		}
+		std::cout << "GPU radix sort test " << (passed ? "passed" : "FAILED") << "\n";
+
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, queryPool, nullptr);
+		}
+		keys.destroy();
+		values.destroy();
+		stagingKeys.destroy();
+		stagingValues.destroy();
+		count.destroy();
+		radixSort.destroy();
+		return passed;
+	}
+
+	// Run the vks::ScanPrimitives operations on random input and compare the results with its host reference
+	// The shared memory kernels are tested first, then the subgroup arithmetic ones if the device supports them.
+	// Half of the elements are flagged for the compaction, the segments are 1 to 256 elements long.
+	// The first run of each operation is a warm-up, the fastest of the others counts.
+	bool runScanTest()
+	{
+		const uint32_t minCount = 1024;
+		const uint32_t maxCount = 16 * 1024 * 1024;
+		const uint32_t runs = 4;
+		const bool timestamps = deviceProperties.limits.timestampComputeAndGraphics == VK_TRUE;
+		const double period = deviceProperties.limits.timestampPeriod / 1000000.0;
+
+		const VkPhysicalDeviceSubgroupProperties subgroupProperties = getSubgroupProperties();
+		const bool subgroupArithmetic = (apiVersion >= VK_API_VERSION_1_1) &&
+			(subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+			(subgroupProperties.supportedOperations & VK_SUBGROUP_FEATURE_ARITHMETIC_BIT);
+
+		// Indices of the counts and totals buffer
+		enum { ELEMENT_COUNT = 0, SEGMENT_COUNT = 1, EXCLUSIVE_TOTAL = 2, INCLUSIVE_TOTAL = 3, COMPACT_COUNT = 4, COUNT_MAX = 5 };
+		const VkDeviceSize size = (VkDeviceSize)(maxCount + 1) * sizeof(uint32_t);
+		vks::Buffer input, flags, segmentOffsets, output, staging, counts;
+		const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		const VkMemoryPropertyFlags hostMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &input, size));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &flags, size));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &segmentOffsets, size));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &output, size));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostMemory, &staging, size));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemory, &counts, COUNT_MAX * sizeof(uint32_t)));
+		VK_CHECK_RESULT(staging.map());
+		VK_CHECK_RESULT(counts.map());
+		uint32_t* hostData = static_cast<uint32_t*>(staging.mapped);
+		uint32_t* hostCounts = static_cast<uint32_t*>(counts.mapped);
+
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		if (timestamps) {
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = runs * 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+		}
+
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		VkMemoryBarrier hostBarrier = vks::initializers::memoryBarrier();
+		hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		const VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+		auto upload = [&](const std::vector<uint32_t>& data, vks::Buffer& buffer) {
+			memcpy(hostData, data.data(), data.size() * sizeof(uint32_t));
+			VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			const VkBufferCopy region = { 0, 0, data.size() * sizeof(uint32_t) };
+			vkCmdCopyBuffer(commandBuffer, staging.buffer, buffer.buffer, 1, &region);
+			vkCmdPipelineBarrier(commandBuffer, stages, stages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			vulkanDevice->flushCommandBuffer(commandBuffer, queue, true);
+		};
+
+		// Runs an operation and reads back the first resultCount elements of the output, returns the fastest run in ms
+		auto run = [&](vks::ScanPrimitives& scan, const vks::ScanPrimitives::Operation& operation, uint32_t resultCount) {
+			VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			if (timestamps) {
+				vkCmdResetQueryPool(commandBuffer, queryPool, 0, runs * 2);
+			}
+			for (uint32_t i = 0; i < runs; i++) {
+				if (timestamps) {
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, i * 2);
+				}
+				scan.record(commandBuffer, operation);
+				if (timestamps) {
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, i * 2 + 1);
+				}
+				vkCmdPipelineBarrier(commandBuffer, stages, stages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
+			if (resultCount > 0) {
+				const VkBufferCopy region = { 0, 0, resultCount * sizeof(uint32_t) };
+				vkCmdCopyBuffer(commandBuffer, output.buffer, staging.buffer, 1, &region);
+			}
+			vkCmdPipelineBarrier(commandBuffer, stages, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+			vulkanDevice->flushCommandBuffer(commandBuffer, queue, true);
+
+			double time = 0.0;
+			if (timestamps) {
+				std::vector<uint64_t> results(runs * 2);
+				VK_CHECK_RESULT(vkGetQueryPoolResults(device, queryPool, 0, runs * 2, sizeof(uint64_t) * results.size(), results.data(),
+					sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+				time = std::numeric_limits<double>::max();
+				for (uint32_t i = 1; i < runs; i++) {
+					time = std::min(time, (double)(results[i * 2 + 1] - results[i * 2]) * period);
+				}
+			}
+			return time;
+		};
+
+		bool passed = true;
+		auto report = [&](const char* name, uint32_t elementCount, double time, const std::vector<uint32_t>& expected, uint32_t total, uint32_t expectedTotal) {
+			uint32_t mismatches = (total == expectedTotal) ? 0 : 1;
+			for (size_t i = 0; i < expected.size(); i++) {
+				if (hostData[i] != expected[i]) {
+					mismatches++;
+				}
+			}
+			passed &= (mismatches == 0);
+			std::cout << "  " << name << ", " << elementCount << " elements: ";
+			if (timestamps) {
+				std::cout << time << " ms, " << (double)elementCount / (time * 1000000.0) << " G elements/s, ";
+			}
+			std::cout << (mismatches == 0 ? "passed" : "FAILED (" + std::to_string(mismatches) + " mismatches)") << "\n";
+		};
+
+		std::vector<bool> variants = { false };
+		if (subgroupArithmetic) {
+			variants.push_back(true);
+		}
+		for (bool subgroups : variants) {
+			vks::ScanPrimitives scan;
+			vks::ScanPrimitives::Subgroups subgroupInfo = { subgroupProperties.subgroupSize, subgroups };
+			scan.create(vulkanDevice, getAssetPath() + "shaders/glsl/base/", maxCount, 4, subgroupInfo, pipelineCache);
+			const vks::ScanPrimitives::Operation exclusiveScan = scan.exclusiveScan(input.buffer, output.buffer, counts.buffer, ELEMENT_COUNT * sizeof(uint32_t), counts.buffer, EXCLUSIVE_TOTAL * sizeof(uint32_t));
+			const vks::ScanPrimitives::Operation inclusiveScan = scan.inclusiveScan(input.buffer, output.buffer, counts.buffer, ELEMENT_COUNT * sizeof(uint32_t), counts.buffer, INCLUSIVE_TOTAL * sizeof(uint32_t));
+			const vks::ScanPrimitives::Operation compact = scan.compact(input.buffer, flags.buffer, output.buffer, counts.buffer, ELEMENT_COUNT * sizeof(uint32_t), counts.buffer, COMPACT_COUNT * sizeof(uint32_t));
+			const vks::ScanPrimitives::Operation segmentedReduce = scan.segmentedReduce(input.buffer, segmentOffsets.buffer, output.buffer, counts.buffer, SEGMENT_COUNT * sizeof(uint32_t));
+			std::cout << "GPU scan test, " << (scan.usesSubgroupArithmetic() ? "subgroup arithmetic" : "shared memory") << ", work group size " << scan.getWorkgroupSize() << ":\n";
+
+			std::mt19937 generator(1);
+			for (uint32_t elementCount = minCount; elementCount <= maxCount; elementCount *= 4) {
+				std::vector<uint32_t> values(elementCount), elementFlags(elementCount), offsets(1, 0);
+				for (uint32_t i = 0; i < elementCount; i++) {
+					values[i] = generator() & 0xFFFF;
+					elementFlags[i] = generator() & 1;
+				}
+				while (offsets.back() < elementCount) {
+					offsets.push_back(std::min(offsets.back() + 1 + (uint32_t)(generator() % 256), elementCount));
+				}
+				const uint32_t segmentCount = static_cast<uint32_t>(offsets.size()) - 1;
+				upload(values, input);
+				upload(elementFlags, flags);
+				upload(offsets, segmentOffsets);
+				hostCounts[ELEMENT_COUNT] = elementCount;
+				hostCounts[SEGMENT_COUNT] = segmentCount;
+
+				std::vector<uint32_t> expected;
+				vks::ScanPrimitives::Reference::exclusiveScan(values, elementCount, expected);
+				const uint32_t sum = expected.back() + values.back();
+				double time = run(scan, exclusiveScan, elementCount);
+				report("exclusive scan", elementCount, time, expected, hostCounts[EXCLUSIVE_TOTAL], sum);
+
+				vks::ScanPrimitives::Reference::inclusiveScan(values, elementCount, expected);
+				time = run(scan, inclusiveScan, elementCount);
+				report("inclusive scan", elementCount, time, expected, hostCounts[INCLUSIVE_TOTAL], sum);
+
+				vks::ScanPrimitives::Reference::compact(values, elementFlags, elementCount, expected);
+				time = run(scan, compact, static_cast<uint32_t>(expected.size()));
+				report("compaction", elementCount, time, expected, hostCounts[COMPACT_COUNT], static_cast<uint32_t>(expected.size()));
+
+				vks::ScanPrimitives::Reference::segmentedReduce(values, offsets, segmentCount, expected);
+				time = run(scan, segmentedReduce, segmentCount);
+				report("segmented reduce", elementCount, time, expected, 0, 0);
+			}
+			scan.destroy();
+		}
+		std::cout << "GPU scan test " << (passed ? "passed" : "FAILED") << "\n";
+
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, queryPool, nullptr);
+		}
+		input.destroy();
+		flags.destroy();
+		segmentOffsets.destroy();
+		output.destroy();
+		staging.destroy();
+		counts.destroy();
+		return passed;
+	}
+};
+
+int main(int argc, char* argv[])
+{
+	// -g selects the device, --sort and --scan limit the run to those tests
+	uint32_t gpuIndex = 0;
+	bool sort = false;
+	bool scan = false;
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		if ((arg == "-g" || arg == "--gpu") && i + 1 < argc) {
+			gpuIndex = static_cast<uint32_t>(std::stoi(argv[++i]));
+		} else if (arg == "--sort") {
+			sort = true;
+		} else if (arg == "--scan") {
+			scan = true;
+		} else {
+			std::cerr << "Usage: gpuprimitives [-g <device index>] [--sort] [--scan]\n";
+			return 1;
+		}
+	}
+	const bool all = !sort && !scan;
+
+	bool passed = true;
+	GpuPrimitivesTest* test = new GpuPrimitivesTest(gpuIndex);
+	if (all || sort) {
+		passed &= test->runRadixSortTest();
+	}
+	if (all || scan) {
+		passed &= test->runScanTest();
+	}
+	delete test;
+	return passed ? 0 : 1;
+}
@@ -8,6 +8,9 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanRenderGraph.hpp"
+#include "VulkanReadback.hpp"
+#include "particlereference.hpp"
 
 #define ENABLE_VALIDATION true
 #define PARTICLE_VERTEX_BUFFER_BIND_ID 0
@@ -21,7 +24,11 @@ public:
 	vks::Texture2D particlespawn;
 
 	constexpr static uint32_t PARTICLE_COUNT_MAX = 128 * 1024 * 10;
-	constexpr static uint32_t INSTANCE_COUNT = 2;
+
+	// Number of dissolving mesh instances, can be changed with --instances
+	uint32_t instanceCount = 2;
+	// emit.comp dispatches a work group per instance, every device supports at least 65535 of them
+	static const int32_t INSTANCE_COUNT_MAX = 65535;
 
 	struct UBOModelData {
 		float alphaReference = 0.0f;
@@ -33,24 +40,44 @@ public:
 		glm::mat4 viewProj;
 		glm::mat4 invViewProj;
 		glm::vec2 viewport;
+		// Zero unless the particles are drawn as sprites, see sprite.h
+		float spriteSize = 0.0f;
+		float spritePixelScale = 0.0f;
 	} uboViewData;
 
-	struct UBOInstanceData {
-		glm::mat4 transform[INSTANCE_COUNT];
-	} uboInstanceData;
-
-	// Append buffer unit
-	struct AppendJob {
-		glm::vec2 screenPos;
+	// SSBO per-instance data (std430)
+	struct InstanceData {
+		glm::mat4 transform;
+		// Dissolve state of this instance
+		float alphaReference = 0.0f;
+		float dissolveSpeed = 1.0f;
+		float dissolveStart = 0.0f;
+		// Estimated change of the alpha reference until the next frame, zero while not dissolving
+		float alphaDelta = 0.0f;
 	};
-
+	std::vector<InstanceData> instances;
+	// Instances which need to be written to the instance buffer
+	std::vector<bool> instanceDirty;
+	// Set when the model matrix changed and all transforms need to be rebuilt
+	bool instanceTransformsChanged = true;
+
+	// Staggers the dissolve of the instances so that particle spawns are spread over frames
+	struct DissolveSettings {
+		// Time window the dissolve starts of all instances are spread over
+		float stagger = 1.0f;
+		// Random variation applied to the dissolve speed of each instance
+		float speedVariation = 0.5f;
+		// Time an instance stays fully dissolved before it reappears
+		float hold = 0.5f;
+		// Monotonic dissolve clock, advances at the same rate as the global timer
+		float time = 0.0f;
+	} dissolve;
+
+	// The structures shared with the shaders are declared by the CPU reference, see particlereference.hpp
+	// Append buffer unit
+	typedef ParticleReference::AppendJob AppendJob;
 	// SSBO particle declaration
-	struct Particle {
-		glm::vec4 pos;
-		glm::vec4 color;
-		glm::uint frame;
-		glm::uint pad[3];
-	};
+	typedef ParticleReference::Particle Particle;
 
 	struct ParticleVertexState {
 		VkPipelineVertexInputStateCreateInfo inputState;
@@ -58,32 +85,383 @@ public:
 		std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
 	} vertexState;
 
-	struct ParticleSystem {					// Compute shader uniform block object
-		glm::vec3 wind = glm::vec3(0.0f);
-		float deltaT = 0.0f;				// Frame delta time
-		float speed = 100.0f;
-		float random = 0.0f;
-		glm::uint frameNum = 0;
-	} particleSystem;
-
-	struct GlobalParticleData {
-		uint32_t particleCountMax = PARTICLE_COUNT_MAX;
-		uint32_t particleIndex = 0;
-		uint32_t renderCount = 0;
-		uint32_t cachedCount = 0;
-		uint32_t newEmiitedCount = 0;
-	} globalParticleData;
-
-	struct GpuCmdBuffer {
-		uint32_t particleCount;
-		VkDispatchIndirectCommand dispatchCmd;
+	// Spawn candidate subsampling when over budget
+	enum SpawnSampling {
+		SPAWN_SAMPLING_STOCHASTIC = 0,
+		SPAWN_SAMPLING_STRATIFIED = 1
+	};
+
+	// Spawn candidates are either the scene fragments crossing the dissolve threshold,
+	// or the points of a precomputed point set on the mesh surface
+	enum SpawnSource {
+		SPAWN_SOURCE_SCREEN = 0,
+		SPAWN_SOURCE_SURFACE = 1
+	};
+
+	// Compute shader uniform block object
+	typedef ParticleReference::ParticleSystem ParticleSystem;
+	ParticleSystem particleSystem;
+
+	typedef ParticleReference::GlobalParticleData GlobalParticleData;
+
+	// Fixed step simulation clock, see advanceSimulationClock
+	// Frames longer than PARTICLE_MAX_SUBSTEPS ticks slow the simulation down rather than simulating more ticks
+	static const uint32_t PARTICLE_MAX_SUBSTEPS = 4;
+	struct {
+		// Frame time not simulated yet, less than a tick
+		float accumulator = 0.0f;
+		// Fractional particles of the spawn budget carried over to the next frame
+		float spawnCredit = 0.0f;
+	} simulationClock;
+
+	// Particle spawn budget per simulation tick
+	// The budget is enforced on the GPU, and can adapt to the measured cost of the particle passes
+	struct {
+		int32_t budget = 64 * 1024;
+		int32_t minBudget = 1024;
+		int32_t maxBudget = PARTICLE_COUNT_MAX / 4;
+		bool adaptive = true;
+		// Target GPU time of the particle compute and render passes in ms
+		float targetTime = 1.0f;
+		int32_t sampling = SPAWN_SAMPLING_STOCHASTIC;
+	} spawnBudget;
+
+	// Global particle quality level, selected with --quality or in the UI, see particleQualityLevel
+	// Lower levels scale the spawn budget down, thin out the emission of instances that are small on screen and
+	// simulate far particles at half or a quarter of the tick rate, which keeps the particle cost bounded with many
+	// instances on screen
+	struct ParticleQuality {
+		const char* name;
+		// Scale of the spawn budget per tick
+		float budgetScale;
+		// Projected instance radius in pixels below which the emission density falls off, 0 emits at full density
+		float emissionLodPixels;
+		// Halvings of the simulation rate of far particles and the camera distance of the first one
+		uint32_t simulationLodLevels;
+		float simulationLodDistance;
+	};
+	static const int32_t PARTICLE_QUALITY_LEVELS = 4;
+	int32_t particleQuality = 2;
+
+	static const ParticleQuality& particleQualityLevel(int32_t level)
+	{
+		static const ParticleQuality levels[PARTICLE_QUALITY_LEVELS] = {
+			{ "Low", 0.25f, 96.0f, 2, 3.0f },
+			{ "Medium", 0.5f, 48.0f, 2, 5.0f },
+			{ "High", 1.0f, 24.0f, 1, 8.0f },
+			{ "Ultra", 1.0f, 0.0f, 0, 0.0f }
+		};
+		return levels[glm::clamp(level, 0, PARTICLE_QUALITY_LEVELS - 1)];
+	}
+
+	// Object space spawning from the mesh surface, independent of the screen resolution
+	// The point set is distributed by triangle area and sorted by the spawn texture value,
+	// so the points of an instance that disappear in a frame form one contiguous range.
+	struct {
+		int32_t source = SPAWN_SOURCE_SCREEN;
+		uint32_t pointCount = 256 * 1024;
+	} surfaceSpawn;
+
+	// Depth only, scene, particle and composition rendering as subpasses of a single render pass, enabled with --subpasses
+	// The scene and particle colors are transient input attachments, which tile based GPUs can keep in tile memory.
+	// The particle simulation then runs ahead of the render pass on the spawn candidates of the previous frame.
+	bool mergedRenderPass = false;
+
+	enum MergedSubpass {
+		SUBPASS_DEPTH_ONLY = 0,
+		SUBPASS_SCENE = 1,
+		SUBPASS_PARTICLE = 2,
+		SUBPASS_COMPOSITION = 3
+	};
+
+	// Render the offscreen passes with VK_KHR_dynamic_rendering and synchronization2 barriers, enabled with --dynamicrendering
+	// No render pass or frame buffer objects are needed for them, so pipelines only depend on the attachment formats
+	// and a resize only recreates the attachments. Falls back to render passes if the extensions are not supported.
+	bool dynamicRendering = false;
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR enabledDynamicRenderingFeaturesKHR{};
+	PFN_vkCmdBeginRenderingKHR vkCmdBeginRenderingKHR{ VK_NULL_HANDLE };
+	PFN_vkCmdEndRenderingKHR vkCmdEndRenderingKHR{ VK_NULL_HANDLE };
+
+	// The release SPIR-V is used by default, the debug variants of data/shaders/glsl/compileshaders.py with --shaderdebug
+	bool shaderDebug = false;
+
+	// Specialization constants of particle.comp and gpu_cmd.comp, see particle_constants.h
+	// The work group size is derived from the subgroup size and the device limits unless set with --workgroupsize,
+	// --autotune times the simulation of a full ring buffer for a sweep of sizes and keeps the fastest
+	typedef ParticleReference::KernelConstants KernelConstants;
+	struct {
+		KernelConstants constants;
+		uint32_t requestedWorkgroupSize = 0;
+		bool autotune = false;
+		// Zero if the device can't report it
+		uint32_t subgroupSize = 0;
+		// Work group sizes and simulation times in ms of the autotune sweep
+		std::vector<std::pair<uint32_t, float>> sweep;
+	} particleKernel;
+
+	// Particle rendering, the point list draw of particle.vert, the compute rasterizer or sprites
+	enum ParticleRaster {
+		PARTICLE_RASTER_POINTS = 0,
+		PARTICLE_RASTER_COMPUTE = 1,
+		PARTICLE_RASTER_SPRITES = 2
+	};
+
+	// Screen tile size of the compute rasterizer, see raster.h
+	static const uint32_t PARTICLE_RASTER_TILE_SIZE = 16;
+
+	// Compute rasterizer of the particles, selected with --computeraster or in the UI, not available with subpasses
+	// The covered pixels of the live particles are binned into screen tiles and depth tested against the depth only pass,
+	// each tile is then resolved with shared memory atomics on packed depth and color, so the nearest particle of a pixel
+	// wins. With shaderSharedInt64Atomics the depth is a full float next to rgba8 color, otherwise it is quantized to 16 bits.
+	struct {
+		int32_t mode = PARTICLE_RASTER_POINTS;
+		bool available = false;
+		bool atomic64 = false;
+		VkPhysicalDeviceShaderAtomicInt64FeaturesKHR enabledAtomicInt64Features{};
+		// Entry count of each tile, and the entry offsets scanned from it
+		vks::Buffer tileCounts;
+		vks::Buffer tileOffsets;
+		// Packed depth and color of the covered pixels, grouped by tile
+		vks::Buffer entries;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		struct {
+			VkPipeline count = VK_NULL_HANDLE;
+			VkPipeline scatter = VK_NULL_HANDLE;
+			VkPipeline scan = VK_NULL_HANDLE;
+			VkPipeline tile = VK_NULL_HANDLE;
+		} pipelines;
+		// Passes of both paths, only one of them is enabled
+		vks::RenderGraph::Pass pointsPass = 0;
+		std::vector<vks::RenderGraph::Pass> computePasses;
+		// Mode the command buffers were last recorded with
+		int32_t recordedMode = PARTICLE_RASTER_POINTS;
+	} particleRaster;
+
+	// Mirrors SpriteCmdBuffer of sprite.h
+	struct SpriteCmdBuffer {
 		VkDrawIndirectCommand drawCmd;
+		VkDrawMeshTasksIndirectCommandEXT meshTasksCmd;
+		uint32_t spriteCount;
+	};
+
+	// View facing particle sprites sized in world units, selected with --sprites or in the UI, available with the compute rasterizer
+	// particle_sprite.vert expands each live particle to 6 vertices from gl_VertexIndex, or particle_sprite.mesh to a quad per
+	// invocation if VK_EXT_mesh_shader is supported. The draw commands are derived from the live particle count by sprite_cmd.comp.
+	// Sprites are drawn into the particle color first and tested against the depth only pass, the particles projecting to less
+	// than a pixel are then splatted by the compute rasterizer, see sprite.h.
+	struct {
+		float size = 0.008f;
+		// The mesh shader is SPIR-V 1.4, which needs a Vulkan 1.2 instance, so it is only used with --sprites
+		bool meshShader = false;
+		bool allowMeshShader = true;
+		VkPhysicalDeviceMeshShaderFeaturesEXT enabledMeshShaderFeatures{};
+		PFN_vkCmdDrawMeshTasksIndirectEXT vkCmdDrawMeshTasksIndirectEXT{ VK_NULL_HANDLE };
+		vks::Buffer commands;
+		// Coverage of the sprite shape, generated at startup
+		vks::Texture2D texture;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkPipeline commandPipeline = VK_NULL_HANDLE;
+		vks::RenderGraph::Pass commandPass = 0;
+	} particleSprites;
+
+	// Collision of the particles with the depth only pass, restitution and friction are part of particleSystem
+	// The simulation has to run after the depth only pass of its frame on the graphics queue, so collisions are not
+	// available with subpasses or async compute. particle.comp.collision.spv is used when available, its cost is
+	// described in particle.comp and measured by bin/compare-meshparticles-collision.py. Disabled with --nocollision.
+	struct {
+		bool available = false;
+		bool enabled = true;
+	} particleCollision;
+
+	// Curl noise turbulence added to the particle velocity, sampled from a 3D texture baked at startup
+	// Amplitude and frequency are part of particleSystem, the field scrolls by scrollSpeed texture coordinates per
+	// second along scrollDirection. The CPU reference samples the same texels. --turbulence sets the amplitude.
+	static const uint32_t TURBULENCE_SIZE = 32;
+	static const uint32_t TURBULENCE_PERIOD = 4;
+	static const uint32_t TURBULENCE_SEED = 1;
+	struct {
+		ParticleReference::TurbulenceField field;
+		vks::Texture3D texture;
+		float scrollSpeed = 0.05f;
+		glm::vec3 scrollDirection = glm::normalize(glm::vec3(0.3f, 1.0f, 0.2f));
+	} turbulence;
+
+	// Specialization constants of raster_bin.comp, the kernel constants followed by PARTICLE_RASTER_SCATTER
+	struct RasterBinConstants {
+		KernelConstants kernel;
+		VkBool32 scatter;
+	};
+
+	// Depth tested particles blended by lifetime, enabled with --blendedparticles, not available with subpasses
+	// particle_blend.frag tests the points against the depth only pass and accumulates them with weighted blended order
+	// independent transparency into a float target: the weighted gray and the weight sums in red and green, the
+	// transmittance in alpha. The composition resolves it over the scene. Replaces the compute rasterizer.
+	bool blendedParticles = false;
+
+	// Depth aspect of the depth buffer, which can be sampled, recreated with the depth buffer
+	// Read by the compute rasterizer and the blended particles, not created with subpasses
+	VkImageView sampledDepthView = VK_NULL_HANDLE;
+
+	// VK_KHR_synchronization2 is used for all barriers if supported
+	bool synchronization2 = false;
+	VkPhysicalDeviceSynchronization2FeaturesKHR enabledSynchronization2FeaturesKHR{};
+	PFN_vkCmdPipelineBarrier2KHR vkCmdPipelineBarrier2KHR{ VK_NULL_HANDLE };
+
+	// The frame is a render graph of passes with declared buffer and image accesses, see setupRenderGraph
+	// The graph derives the barriers outside of render passes and owns the offscreen color attachments with dynamic rendering
+	// The passes, transient memory and barriers of a frame are printed with --barrierplan
+	vks::RenderGraph renderGraph;
+	struct GraphResources {
+		vks::RenderGraph::Resource gpucmd;
+		vks::RenderGraph::Resource append;
+		vks::RenderGraph::Resource spawn;
+		vks::RenderGraph::Resource particle;
+		vks::RenderGraph::Resource global;
+		vks::RenderGraph::Resource stats;
+		// Only accessed with dynamic rendering, render passes synchronize their attachments with subpass dependencies
+		vks::RenderGraph::Resource depth;
+		vks::RenderGraph::Resource sceneColor;
+		vks::RenderGraph::Resource particleColor;
+		// Only imported into the graphics graph, with the compute rasterizer
+		vks::RenderGraph::Resource tileCounts;
+		vks::RenderGraph::Resource tileOffsets;
+		vks::RenderGraph::Resource rasterEntries;
+		vks::RenderGraph::Resource spriteCmd;
+	} graphResources;
+	vks::RenderGraph::Pass surfaceEmitPass;
+	bool printBarrierPlan = false;
+
+
+	// Run the particle simulation on a dedicated compute queue, enabled with --asynccompute
+	// The simulation of a frame consumes the spawn candidates of the previous frame, so it runs concurrently with
+	// the depth only and scene passes, which append to the other candidate slot. The graphics frame is split into
+	// two submits, only the second one with the particle and composition passes waits for the simulation.
+	// The particle buffer changes queue family ownership twice per frame. The gpucmd and append buffers are shared
+	// concurrently instead, as both queues access them at the same time in different slots.
+	struct {
+		bool enabled = false;
+		VkQueue queue = VK_NULL_HANDLE;
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		// Second part of the graphics frame, per swap chain image
+		std::vector<VkCommandBuffer> particleCommandBuffers;
+		// Signaled by the compute queue once the simulation of a frame is done
+		VkSemaphore simulationComplete = VK_NULL_HANDLE;
+		// Signaled by the graphics queue once a frame has appended its spawn candidates and drawn the particles
+		VkSemaphore candidatesReady = VK_NULL_HANDLE;
+		bool candidatesPending = false;
+		vks::RenderGraph graph;
+		GraphResources graphResources;
+	} asyncCompute;
+
+	// Validation of the particle simulation against the CPU reference, enabled with --cpureference
+	// Every interval frames the simulation step of the frame is replayed on host visible copies of the particle state,
+	// so that the running simulation isn't changed, and the results are compared with the CPU reference run on the same
+	// inputs. Screen spawn positions are checked against the depth buffer, except with subpasses which don't store it.
+	struct {
+		bool enabled = false;
+		uint32_t interval = 60;
+		std::unique_ptr<ParticleReference> reference;
+		struct {
+			vks::Buffer gpucmd;
+			vks::Buffer global;
+			vks::Buffer spawn;
+			vks::Buffer particle;
+			vks::Buffer append;
+			vks::Buffer depth;
+			vks::Buffer stats;
+		} buffers;
+		VkDescriptorSet gpuCmdDescriptorSet = VK_NULL_HANDLE;
+		VkDescriptorSet computeDescriptorSet = VK_NULL_HANDLE;
+		// Results of the last validation
+		bool passed = true;
+		std::string summary;
+		float cpuTime = 0.0f;
+	} cpuReference;
+
+	// Dumps of the particle state to disk, decoded with bin/decode-readback.py and replayed with --replay
+	// Requested with --dumpframe or from the UI, the copies are submitted after the frame and written once
+	// the GPU has finished them, without waiting for it.
+	struct {
+		vks::Readback readback;
+		// Frame to dump after, 0 for none
+		uint64_t frame = 0;
+		bool requested = false;
+		// Signaled by the capture on the graphics queue with async compute, the next simulation waits for it
+		VkSemaphore captured = VK_NULL_HANDLE;
+		bool capturePending = false;
+	} particleDump;
+
+	// GPU timestamps of the particle passes and the whole frame of the last frame
+	enum Timestamp {
+		TIMESTAMP_FRAME_BEGIN,
+		TIMESTAMP_FRAME_END,
+		TIMESTAMP_PARTICLE_COMPUTE_BEGIN,
+		TIMESTAMP_PARTICLE_COMPUTE_END,
+		TIMESTAMP_PARTICLE_RENDER_BEGIN,
+		TIMESTAMP_PARTICLE_RENDER_END,
+		TIMESTAMP_COUNT
+	};
+
+	struct {
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		bool supported = false;
+		// GPU time of the particle compute and render passes in ms
+		float particleTime = 0.0f;
+		// GPU time of the particle compute passes in ms, on the compute queue with async compute, and its sum over all frames
+		float computeTime = 0.0f;
+		double computeTimeSum = 0.0;
+		// GPU time of the particle render passes in ms, and its sum over all frames for the average
+		float renderTime = 0.0f;
+		double renderTimeSum = 0.0;
+		// GPU time of the whole frame in ms, and its sum over all frames for the average
+		float frameTime = 0.0f;
+		double frameTimeSum = 0.0;
+		uint32_t frameTimeSamples = 0;
+	} gpuTimings;
+
+	// Spawn candidates are double buffered with async compute, see gpu_cmd.h
+	static const uint32_t SPAWN_CANDIDATE_SLOTS = ParticleReference::SPAWN_CANDIDATE_SLOTS;
+
+	typedef ParticleReference::GpuCmdBuffer GpuCmdBuffer;
+
+	// Per-frame statistics written by gpu_cmd.comp to slot frameNum % PARTICLE_STATS_FRAMES (std430), see gpu_cmd.h
+	static const uint32_t PARTICLE_STATS_FRAMES = 4;
+
+	struct ParticleStats {
+		uint32_t frame;
+		uint32_t newEmittedCount;
+		uint32_t renderCount;
+		uint32_t cachedCount;
+		uint32_t ringWraps;
+		uint32_t dispatchGroups;
+		uint32_t drawVertexCount;
 	};
 
+	// The statistics of a frame are complete once the next frame has run its simulation, so they are read two frames
+	// late, when the GPU is done with both frames and the host never waits for them. They are plotted in the overlay
+	// and written to the benchmark frame times with -bfs.
+	static const uint32_t PARTICLE_STATS_LATENCY = 2;
+	// Frames shown in the overlay plots
+	static const uint32_t PARTICLE_STATS_HISTORY = 128;
+
+	struct {
+		ParticleStats last{};
+		bool valid = false;
+		std::vector<float> liveParticles;
+		std::vector<float> renderCount;
+		std::vector<float> newEmitted;
+		std::vector<float> cachedCount;
+		// Sums over all frames for the averages printed with the benchmark result
+		std::array<double, 4> sums{};
+		uint32_t samples = 0;
+	} particleStats;
+
 	struct {
 		vks::Buffer modelData;
 		vks::Buffer viewData;
-		vks::Buffer instancing;
 		vks::Buffer particleSystem;
 	} uniformBuffers;
 
@@ -98,6 +476,12 @@ public:
 		vks::Buffer particle;
 		// Global particle data
 		vks::Buffer global;
+		// Per-instance data, host visible and persistently mapped
+		vks::Buffer instances;
+		// Surface point set for object space spawning
+		vks::Buffer surfacePoints;
+		// Per-frame statistics, host visible and persistently mapped
+		vks::Buffer stats;
 	} resourceBuffers;
 
 	struct {
@@ -105,6 +489,7 @@ public:
 		VkPipeline scene;
 		VkPipeline compute;
 		VkPipeline gpuCmd;
+		VkPipeline emit;
 		VkPipeline particle;
 		VkPipeline composition;
 	} pipelines;
@@ -113,6 +498,7 @@ public:
 		VkPipelineLayout scene;
 		VkPipelineLayout compute;
 		VkPipelineLayout gpuCmd;
+		VkPipelineLayout emit;
 		VkPipelineLayout particle;
 		VkPipelineLayout composition;;
 	} pipelineLayouts;
@@ -122,6 +508,7 @@ public:
 		VkDescriptorSet scene;
 		VkDescriptorSet compute;
 		VkDescriptorSet gpuCmd;
+		VkDescriptorSet emit;
 		VkDescriptorSet particle;
 		VkDescriptorSet composition;
 	} descriptorSets;
@@ -130,16 +517,20 @@ public:
 		VkDescriptorSetLayout scene;
 		VkDescriptorSetLayout compute;
 		VkDescriptorSetLayout gpuCmd;
+		VkDescriptorSetLayout emit;
 		VkDescriptorSetLayout particle;
 		VkDescriptorSetLayout composition;
 	} descriptorSetLayouts;
 
 
 	struct FrameBufferAttachment {
-		VkImage image;
-		VkDeviceMemory mem;
-		VkImageView view;
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory mem = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
 		VkFormat format;
+		// Size and type of the memory allocation, which is reused by a resized attachment if it fits
+		VkDeviceSize memSize = 0;
+		uint32_t memTypeIndex = 0;
 		void destroy(VkDevice device)
 		{
 			vkDestroyImage(device, image, nullptr);
@@ -150,7 +541,7 @@ public:
 
 	struct FrameBuffer {
 		int32_t width, height;
-		VkFramebuffer frameBuffer;
+		VkFramebuffer frameBuffer = VK_NULL_HANDLE;
 		VkRenderPass renderPass;
 
 		void setSize(int32_t w, int32_t h)
@@ -188,6 +579,8 @@ public:
 
 	std::default_random_engine rndEngine;
 
+	uint64_t submittedFrames = 0;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Disintegrating Meshes with Particles";
@@ -197,25 +590,229 @@ public:
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
 
 		rndEngine.seed(benchmark.active ? 0 : (unsigned)time(nullptr));
+		particleSystem.seed = static_cast<uint32_t>(rndEngine());
+
+		// All options are added before they are parsed, so that --help, which is handled by initVulkan, lists them
+		commandLineParser.add("instances", { "-i", "--instances" }, 1, "Set number of dissolving mesh instances");
+		commandLineParser.add("surfacespawn", { "--surfacespawn" }, 0, "Spawn particles from the mesh surface instead of the scene fragments");
+		commandLineParser.add("subpasses", { "--subpasses" }, 0, "Render all passes as subpasses of a single render pass");
+		commandLineParser.add("dynamicrendering", { "--dynamicrendering" }, 0, "Render the offscreen passes with dynamic rendering");
+		commandLineParser.add("asynccompute", { "--asynccompute" }, 0, "Run the particle simulation on a dedicated compute queue");
+		commandLineParser.add("cpureference", { "--cpureference" }, 0, "Validate the particle simulation against the CPU reference every second");
+		commandLineParser.add("turbulence", { "--turbulence" }, 1, "Set the amplitude of the curl noise turbulence, 0 disables it");
+		commandLineParser.add("barrierplan", { "--barrierplan" }, 0, "Print the render graph passes, transient memory and barriers of a frame");
+		commandLineParser.add("shaderdebug", { "--shaderdebug" }, 0, "Use the debug shader variants with debugPrintfEXT instrumentation");
+		commandLineParser.add("workgroupsize", { "--workgroupsize" }, 1, "Set the work group size of the particle simulation");
+		commandLineParser.add("autotune", { "--autotune" }, 0, "Time the particle simulation for a sweep of work group sizes at startup and use the fastest");
+		commandLineParser.add("blendedparticles", { "--blendedparticles" }, 0, "Depth test the particles and blend them by lifetime with weighted blended transparency");
+		commandLineParser.add("computeraster", { "--computeraster" }, 0, "Render the particles with the compute rasterizer instead of the point list draw");
+		commandLineParser.add("sprites", { "--sprites" }, 0, "Draw the particles as sprites, expanded by a mesh shader if supported, with the compute rasterizer for the ones below a pixel");
+		commandLineParser.add("nomeshshader", { "--nomeshshader" }, 0, "Expand the sprites in the vertex shader even if mesh shaders are supported");
+		commandLineParser.add("nocollision", { "--nocollision" }, 0, "Let the particles pass through the scene instead of colliding with the depth buffer");
+		commandLineParser.add("spawnbudget", { "--spawnbudget" }, 1, "Set a fixed spawn budget per simulation tick, disables the adaptive budget");
+		commandLineParser.add("quality", { "--quality" }, 1, "Set the particle quality level, 0 (low) to 3 (ultra, no level of detail)");
+		commandLineParser.add("dumpframe", { "--dumpframe" }, 1, "Write the particle state after the given frame to meshparticles_frame<n>.bin");
+		commandLineParser.add("replay", { "--replay" }, 1, "Run the CPU reference simulation step on a particle state dump and exit, no GPU is used");
+		commandLineParser.parse(args);
+
+		if (commandLineParser.isSet("instances")) {
+			instanceCount = glm::clamp(commandLineParser.getValueAsInt("instances", instanceCount), 1, INSTANCE_COUNT_MAX);
+		}
+		if (commandLineParser.isSet("surfacespawn")) {
+			surfaceSpawn.source = SPAWN_SOURCE_SURFACE;
+		}
+		if (commandLineParser.isSet("subpasses")) {
+			mergedRenderPass = true;
+			UIOverlay.subpass = SUBPASS_COMPOSITION;
+		}
+		if (commandLineParser.isSet("dynamicrendering")) {
+			// Subpasses need a render pass object
+			if (mergedRenderPass) {
+				std::cout << "Dynamic rendering is not available with subpasses, using render passes\n";
+			} else {
+				dynamicRendering = true;
+			}
+		}
+		if (commandLineParser.isSet("asynccompute")) {
+			// The merged render pass has no point between its subpasses to wait for the simulation
+			if (mergedRenderPass) {
+				std::cout << "Async compute is not available with subpasses, using the graphics queue\n";
+			} else {
+				asyncCompute.enabled = true;
+			}
+		}
+		if (commandLineParser.isSet("cpureference")) {
+			cpuReference.enabled = true;
+		}
+		particleSystem.turbulenceAmplitude = 0.3f;
+		particleSystem.turbulenceFrequency = 0.5f;
+		if (commandLineParser.isSet("turbulence")) {
+			// Values that aren't a number keep the default amplitude
+			const std::string value = commandLineParser.getValueAsString("turbulence", "0.3");
+			char* end = nullptr;
+			const float amplitude = strtof(value.c_str(), &end);
+			if (end != value.c_str() && std::isfinite(amplitude)) {
+				particleSystem.turbulenceAmplitude = std::max(amplitude, 0.0f);
+			} else {
+				std::cout << "Invalid turbulence amplitude \"" << value << "\", using " << particleSystem.turbulenceAmplitude << "\n";
+			}
+		}
+		printBarrierPlan = commandLineParser.isSet("barrierplan");
+
+		// The particle statistics are written next to the frame times of the benchmark, see updateParticleStats
+		benchmark.frameValueNames = { "live particles", "simulated", "emitted", "cached", "ring wraps", "dispatch groups" };
+		benchmark.frameValueLatency = PARTICLE_STATS_LATENCY;
+		shaderDebug = commandLineParser.isSet("shaderdebug");
+		if (commandLineParser.isSet("workgroupsize")) {
+			particleKernel.requestedWorkgroupSize = std::max(commandLineParser.getValueAsInt("workgroupsize", 0), 0);
+		}
+		particleKernel.autotune = commandLineParser.isSet("autotune");
+		if (commandLineParser.isSet("blendedparticles")) {
+			// The depth only pass is an attachment of the merged render pass and can't be sampled by the particle subpass
+			if (mergedRenderPass) {
+				std::cout << "Blended particles are not available with subpasses, drawing opaque points\n";
+			} else {
+				blendedParticles = true;
+			}
+		}
+		// The compute rasterizer writes the particle color between render passes, which subpasses don't have,
+		// and keeps the nearest particle of a pixel, which doesn't blend
+		particleRaster.available = !mergedRenderPass && !blendedParticles;
+		if (commandLineParser.isSet("computeraster")) {
+			if (!particleRaster.available) {
+				std::cout << "The compute rasterizer is not available with " << (mergedRenderPass ? "subpasses" : "blended particles") << ", drawing points\n";
+			} else {
+				particleRaster.mode = PARTICLE_RASTER_COMPUTE;
+			}
+		}
+		if (commandLineParser.isSet("sprites")) {
+			if (!particleRaster.available) {
+				std::cout << "Sprites are not available with " << (mergedRenderPass ? "subpasses" : "blended particles") << ", drawing points\n";
+			} else {
+				particleRaster.mode = PARTICLE_RASTER_SPRITES;
+				// particle_sprite.mesh is SPIR-V 1.4
+				apiVersion = VK_API_VERSION_1_2;
+			}
+		}
+		particleSprites.allowMeshShader = !commandLineParser.isSet("nomeshshader");
+		particleCollision.enabled = !commandLineParser.isSet("nocollision");
+		if (commandLineParser.isSet("spawnbudget")) {
+			spawnBudget.budget = std::min(std::max(commandLineParser.getValueAsInt("spawnbudget", spawnBudget.budget), spawnBudget.minBudget), spawnBudget.maxBudget);
+			spawnBudget.adaptive = false;
+		}
+		if (commandLineParser.isSet("quality")) {
+			particleQuality = glm::clamp(commandLineParser.getValueAsInt("quality", particleQuality), 0, PARTICLE_QUALITY_LEVELS - 1);
+		}
+		if (commandLineParser.isSet("dumpframe")) {
+			particleDump.frame = commandLineParser.getValueAsInt("dumpframe", 0);
+		}
+		// The replay only runs the CPU reference and exits before the example is set up. Nothing needs to be torn down at
+		// this point: the instance, device and window are created by initVulkan and setupWindow after the constructor,
+		// the base constructor has only opened the display connection, which is closed by the process exit.
+		if (commandLineParser.isSet("replay")) {
+			exit(replayParticleDump(commandLineParser.getValueAsString("replay", "")) ? 0 : 1);
+		}
+
+		// The depth buffer is read back to check the screen spawn positions and for dumps
+		depthStencilUsage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+		// Required for the feature structures in the device create chain
+		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 
 		//settings.vsync = true;
 	}
 
 	~VulkanExample()
 	{
+		particleDump.readback.destroy();
+		if (particleDump.captured != VK_NULL_HANDLE) {
+			vkDestroySemaphore(device, particleDump.captured, nullptr);
+		}
+
 		particlespawn.destroy();
+		turbulence.texture.destroy();
 
 		uniformBuffers.modelData.destroy();
 		uniformBuffers.viewData.destroy();
-		uniformBuffers.instancing.destroy();
 		uniformBuffers.particleSystem.destroy();
 
 		resourceBuffers.gpucmd.destroy();
 		resourceBuffers.append.destroy();
 		resourceBuffers.spawn.destroy();
+		resourceBuffers.instances.destroy();
+		resourceBuffers.surfacePoints.destroy();
+		resourceBuffers.stats.destroy();
+
+		if (particleRaster.available) {
+			particleRaster.tileCounts.destroy();
+			particleRaster.tileOffsets.destroy();
+			particleRaster.entries.destroy();
+			vkDestroyPipeline(device, particleRaster.pipelines.count, nullptr);
+			vkDestroyPipeline(device, particleRaster.pipelines.scatter, nullptr);
+			vkDestroyPipeline(device, particleRaster.pipelines.scan, nullptr);
+			vkDestroyPipeline(device, particleRaster.pipelines.tile, nullptr);
+			vkDestroyPipeline(device, particleSprites.pipeline, nullptr);
+			vkDestroyPipeline(device, particleSprites.commandPipeline, nullptr);
+			particleSprites.commands.destroy();
+			particleSprites.texture.destroy();
+			vkDestroyPipelineLayout(device, particleRaster.pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, particleRaster.descriptorSetLayout, nullptr);
+		}
+
+		vkDestroyImageView(device, sampledDepthView, nullptr);
+
+		if (gpuTimings.queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, gpuTimings.queryPool, nullptr);
+		}
+
+		// Average GPU frame time for comparing the render pass structures, see bin/compare-meshparticles-passes.py
+		if (benchmark.active && gpuTimings.frameTimeSamples > 0) {
+			std::cout << "gpu frame: " << gpuTimings.frameTimeSum / gpuTimings.frameTimeSamples << " ms (" << frameStructure() << ")\n";
+			// Particle rasterizers across spawn budgets, see bin/compare-meshparticles-raster.py
+			std::cout << "particle render: " << gpuTimings.renderTimeSum / gpuTimings.frameTimeSamples << " ms ("
+				<< particleRenderingName() << ")\n";
+		}
+		if (benchmark.active && particleStats.samples > 0) {
+			const double samples = (double)particleStats.samples;
+			// Simulation cost with and without collisions, see bin/compare-meshparticles-collision.py
+			if (gpuTimings.frameTimeSamples > 0 && particleStats.sums[1] > 0.0) {
+				const double computeTime = gpuTimings.computeTimeSum / gpuTimings.frameTimeSamples;
+				std::cout << "particle compute: " << computeTime << " ms, " << computeTime / (particleStats.sums[1] / samples / 1000000.0)
+					<< " ms per million simulated particles (" << (particleSystem.collision ? "collision" : "no collision") << ")\n";
+			}
+			std::cout << "particles: " << particleStats.sums[0] / samples << " live, " << particleStats.sums[1] / samples << " simulated, "
+				<< particleStats.sums[2] / samples << " emitted, " << particleStats.sums[3] / samples << " cached per frame, "
+				<< particleStats.last.ringWraps << " ring wraps\n";
+		}
+		if (benchmark.active) {
+			std::cout << "particle kernel: work group size " << particleKernel.constants.workgroupSize;
+			for (auto& result : particleKernel.sweep) {
+				std::cout << (&result == &particleKernel.sweep.front() ? " (autotuned: " : ", ") << result.first << " " << result.second << " ms";
+			}
+			std::cout << (particleKernel.sweep.empty() ? "\n" : ")\n");
+		}
+
+		if (asyncCompute.enabled) {
+			asyncCompute.graph.destroy();
+			vkDestroySemaphore(device, asyncCompute.simulationComplete, nullptr);
+			vkDestroySemaphore(device, asyncCompute.candidatesReady, nullptr);
+			vkDestroyCommandPool(device, asyncCompute.commandPool, nullptr);
+		}
+
+		if (cpuReference.enabled) {
+			cpuReference.buffers.gpucmd.destroy();
+			cpuReference.buffers.global.destroy();
+			cpuReference.buffers.spawn.destroy();
+			cpuReference.buffers.particle.destroy();
+			cpuReference.buffers.append.destroy();
+			cpuReference.buffers.depth.destroy();
+			cpuReference.buffers.stats.destroy();
+		}
 
 		vkDestroySampler(device, sampler, nullptr);
 
+		renderGraph.destroy();
+
 		vkDestroyPipeline(device, pipelines.scene, nullptr);
 
 		vkDestroyPipelineLayout(device, pipelineLayouts.scene, nullptr);
@@ -231,7 +828,113 @@ public:
 
 	void getEnabledExtensions()
 	{
-		enabledDeviceExtensions.push_back(VK_KHR_SHADER_NON_SEMANTIC_INFO_EXTENSION_NAME);
+		// Only the debug shader variants use debugPrintfEXT
+		if (shaderDebug)
+		{
+			if (vulkanDevice->extensionSupported(VK_KHR_SHADER_NON_SEMANTIC_INFO_EXTENSION_NAME))
+			{
+				enabledDeviceExtensions.push_back(VK_KHR_SHADER_NON_SEMANTIC_INFO_EXTENSION_NAME);
+			}
+			else
+			{
+				std::cout << VK_KHR_SHADER_NON_SEMANTIC_INFO_EXTENSION_NAME << " is not supported, using the release shaders\n";
+				shaderDebug = false;
+			}
+		}
+
+		// Without synchronization2 the barrier planner falls back to vkCmdPipelineBarrier
+		if (vulkanDevice->extensionSupported(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+		{
+			synchronization2 = true;
+			enabledDeviceExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+			enabledSynchronization2FeaturesKHR.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+			enabledSynchronization2FeaturesKHR.synchronization2 = VK_TRUE;
+			deviceCreatepNextChain = &enabledSynchronization2FeaturesKHR;
+		}
+
+		// The compute rasterizer packs depth and color into 64 bits if shared memory supports 64 bit atomics
+		if (particleRaster.available && deviceFeatures.shaderInt64 && vulkanDevice->extensionSupported(VK_KHR_SHADER_ATOMIC_INT64_EXTENSION_NAME))
+		{
+			PFN_vkGetPhysicalDeviceFeatures2KHR vkGetPhysicalDeviceFeatures2KHR =
+				reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR"));
+			VkPhysicalDeviceShaderAtomicInt64FeaturesKHR atomicInt64Features{};
+			atomicInt64Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_ATOMIC_INT64_FEATURES_KHR;
+			if (vkGetPhysicalDeviceFeatures2KHR) {
+				VkPhysicalDeviceFeatures2KHR deviceFeatures2{};
+				deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+				deviceFeatures2.pNext = &atomicInt64Features;
+				vkGetPhysicalDeviceFeatures2KHR(physicalDevice, &deviceFeatures2);
+			}
+			if (atomicInt64Features.shaderSharedInt64Atomics)
+			{
+				particleRaster.atomic64 = true;
+				enabledFeatures.shaderInt64 = VK_TRUE;
+				enabledDeviceExtensions.push_back(VK_KHR_SHADER_ATOMIC_INT64_EXTENSION_NAME);
+				particleRaster.enabledAtomicInt64Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_ATOMIC_INT64_FEATURES_KHR;
+				particleRaster.enabledAtomicInt64Features.shaderSharedInt64Atomics = VK_TRUE;
+				particleRaster.enabledAtomicInt64Features.pNext = deviceCreatepNextChain;
+				deviceCreatepNextChain = &particleRaster.enabledAtomicInt64Features;
+			}
+		}
+
+		// The sprites are expanded by a mesh shader if supported, which is SPIR-V 1.4 and needs Vulkan 1.2
+		if (particleRaster.available && particleSprites.allowMeshShader && apiVersion >= VK_API_VERSION_1_2 && deviceProperties.apiVersion >= VK_API_VERSION_1_2 &&
+			vulkanDevice->extensionSupported(VK_EXT_MESH_SHADER_EXTENSION_NAME))
+		{
+			PFN_vkGetPhysicalDeviceFeatures2KHR vkGetPhysicalDeviceFeatures2KHR =
+				reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR"));
+			VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+			meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+			if (vkGetPhysicalDeviceFeatures2KHR) {
+				VkPhysicalDeviceFeatures2KHR deviceFeatures2{};
+				deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+				deviceFeatures2.pNext = &meshShaderFeatures;
+				vkGetPhysicalDeviceFeatures2KHR(physicalDevice, &deviceFeatures2);
+			}
+			if (meshShaderFeatures.meshShader)
+			{
+				particleSprites.meshShader = true;
+				enabledDeviceExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+				particleSprites.enabledMeshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+				particleSprites.enabledMeshShaderFeatures.meshShader = VK_TRUE;
+				particleSprites.enabledMeshShaderFeatures.pNext = deviceCreatepNextChain;
+				deviceCreatepNextChain = &particleSprites.enabledMeshShaderFeatures;
+			}
+		}
+
+		if (dynamicRendering)
+		{
+			// VK_KHR_dynamic_rendering and its dependencies on a Vulkan 1.0 device
+			const std::vector<const char*> extensions = {
+				VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+				VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+				VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
+				VK_KHR_MAINTENANCE2_EXTENSION_NAME,
+				VK_KHR_MULTIVIEW_EXTENSION_NAME
+			};
+			for (auto extension : extensions) {
+				if (!vulkanDevice->extensionSupported(extension)) {
+					std::cout << extension << " is not supported, using render passes\n";
+					dynamicRendering = false;
+					return;
+				}
+			}
+			enabledDeviceExtensions.insert(enabledDeviceExtensions.end(), extensions.begin(), extensions.end());
+
+			enabledDynamicRenderingFeaturesKHR.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+			enabledDynamicRenderingFeaturesKHR.dynamicRendering = VK_TRUE;
+			enabledDynamicRenderingFeaturesKHR.pNext = deviceCreatepNextChain;
+			deviceCreatepNextChain = &enabledDynamicRenderingFeaturesKHR;
+		}
+	}
+
+	VkImageAspectFlags depthAspectMask() const
+	{
+		VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (depthFormat >= VK_FORMAT_D16_UNORM_S8_UINT) {
+			aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+		return aspectMask;
 	}
 
 	// Create a frame buffer attachment
@@ -269,16 +972,39 @@ public:
 		image.arrayLayers = 1;
 		image.samples = VK_SAMPLE_COUNT_1_BIT;
 		image.tiling = VK_IMAGE_TILING_OPTIMAL;
-		image.usage = usage | VK_IMAGE_USAGE_SAMPLED_BIT;
+		// Transient attachments can only be used as attachments
+		image.usage = (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) ? usage : usage | VK_IMAGE_USAGE_SAMPLED_BIT;
 
 		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
 		VkMemoryRequirements memReqs;
 
 		VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &attachment->image));
 		vkGetImageMemoryRequirements(device, attachment->image, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &attachment->mem));
+
+		// A recreated attachment keeps the memory of the previous one if the new image fits into it,
+		// otherwise the old allocation is freed and a new one is made
+		bool reuseMemory = (attachment->mem != VK_NULL_HANDLE) && (memReqs.size <= attachment->memSize) && (memReqs.memoryTypeBits & (1u << attachment->memTypeIndex));
+		if (!reuseMemory)
+		{
+			if (attachment->mem != VK_NULL_HANDLE)
+			{
+				vkFreeMemory(device, attachment->mem, nullptr);
+			}
+			memAlloc.allocationSize = memReqs.size;
+			// Transient attachments use lazily allocated memory if available, which tile based GPUs may never need to back
+			VkBool32 lazilyAllocated = VK_FALSE;
+			if (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+			{
+				memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazilyAllocated);
+			}
+			if (!lazilyAllocated)
+			{
+				memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			}
+			VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &attachment->mem));
+			attachment->memSize = memReqs.size;
+			attachment->memTypeIndex = memAlloc.memoryTypeIndex;
+		}
 		VK_CHECK_RESULT(vkBindImageMemory(device, attachment->image, attachment->mem, 0));
 
 		VkImageViewCreateInfo imageView = vks::initializers::imageViewCreateInfo();
@@ -294,21 +1020,43 @@ public:
 		VK_CHECK_RESULT(vkCreateImageView(device, &imageView, nullptr, &attachment->view));
 	}
 
+	// Render passes and sampler do not depend on the resolution and are only created once
 	void prepareOffscreenFramebuffers()
 	{
-		// Attachments
-		offscreenFrameBuffers.depthOnly.setSize(width, height);
-		offscreenFrameBuffers.scene.setSize(width, height);
-		offscreenFrameBuffers.particle.setSize(width, height);
+		offscreenFrameBuffers.depthOnly.depth.format = depthFormat;
+		offscreenFrameBuffers.scene.color.format = VK_FORMAT_R8G8B8A8_UNORM;
+		offscreenFrameBuffers.particle.color.format = particleColorFormat();
 
-		// Depth only
+		// Shared sampler used for all color attachments
+		VkSamplerCreateInfo samplerInfo = vks::initializers::samplerCreateInfo();
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = samplerInfo.addressModeU;
+		samplerInfo.addressModeW = samplerInfo.addressModeU;
+		samplerInfo.mipLodBias = 0.0f;
+		samplerInfo.maxAnisotropy = 1.0f;
+		samplerInfo.minLod = 0.0f;
+		samplerInfo.maxLod = 1.0f;
+		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VK_CHECK_RESULT(vkCreateSampler(device, &samplerInfo, nullptr, &sampler));
+
+		// The merged render pass and its attachments are created by setupRenderPass and setupFrameBuffer
+		if (mergedRenderPass)
 		{
-			// Use the default depth buffer created in VulkanExampleBase::setupDepthStencil
-			offscreenFrameBuffers.depthOnly.depth.image = depthStencil.image;
-			offscreenFrameBuffers.depthOnly.depth.view = depthStencil.view;
-			offscreenFrameBuffers.depthOnly.depth.format = depthFormat;
-			offscreenFrameBuffers.depthOnly.depth.mem = depthStencil.mem;;
+			return;
+		}
 
+		// Dynamic rendering only needs the attachments
+		if (dynamicRendering)
+		{
+			createOffscreenFramebuffers();
+			return;
+		}
+
+		// Depth only
+		{
 			VkAttachmentDescription attachmentDescription{};
 			attachmentDescription.format = offscreenFrameBuffers.depthOnly.depth.format;
 			attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -327,20 +1075,22 @@ public:
 
 			std::array<VkSubpassDependency, 2> dependencies;
 
+			// The depth buffer was last written by the composition pass of the previous frame
 			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 			dependencies[0].dstSubpass = 0;
-			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-			dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 			dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+			// The scene pass tests against the depth
 			dependencies[1].srcSubpass = 0;
 			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependencies[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
 			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
 			VkRenderPassCreateInfo renderPassInfo = {};
@@ -352,21 +1102,10 @@ public:
 			renderPassInfo.dependencyCount = 2;
 			renderPassInfo.pDependencies = dependencies.data();
 			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &offscreenFrameBuffers.depthOnly.renderPass));
-
-			VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
-			fbufCreateInfo.renderPass = offscreenFrameBuffers.depthOnly.renderPass;
-			fbufCreateInfo.pAttachments = &offscreenFrameBuffers.depthOnly.depth.view;
-			fbufCreateInfo.attachmentCount = 1;
-			fbufCreateInfo.width = offscreenFrameBuffers.depthOnly.width;
-			fbufCreateInfo.height = offscreenFrameBuffers.depthOnly.height;
-			fbufCreateInfo.layers = 1;
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreenFrameBuffers.depthOnly.frameBuffer));
 		}
 
 		// Scene
 		{
-			createAttachment(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, &offscreenFrameBuffers.scene.color, width, height);
-
 			std::array<VkAttachmentDescription, 2> attachmentDescs = {};
 
 			// Init attachment properties
@@ -401,21 +1140,24 @@ public:
 
 			std::array<VkSubpassDependency, 2> dependencies;
 
+			// The color was last sampled by the composition of the previous frame, the depth written by the depth only pass
 			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 			dependencies[0].dstSubpass = 0;
-			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
+			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+			dependencies[0].dependencyFlags = 0;
+
+			// The color is sampled by the composition, which also depth tests against the scene depth
+			// The depth is also read by the particle collisions and the compute rasterizer
 			dependencies[1].srcSubpass = 0;
 			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			dependencies[1].dependencyFlags = 0;
 
 			VkRenderPassCreateInfo renderPassInfo = {};
 			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -426,27 +1168,10 @@ public:
 			renderPassInfo.dependencyCount = 2;
 			renderPassInfo.pDependencies = dependencies.data();
 			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &offscreenFrameBuffers.scene.renderPass));
-
-			std::array<VkImageView, 2> attachments =
-			{
-				offscreenFrameBuffers.scene.color.view,
-				depthStencil.view
-			};
-
-			VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
-			fbufCreateInfo.renderPass = offscreenFrameBuffers.scene.renderPass;
-			fbufCreateInfo.pAttachments = attachments.data();
-			fbufCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-			fbufCreateInfo.width = offscreenFrameBuffers.scene.width;
-			fbufCreateInfo.height = offscreenFrameBuffers.scene.height;
-			fbufCreateInfo.layers = 1;
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreenFrameBuffers.scene.frameBuffer));
 		}
 
 		// Particle
 		{
-			createAttachment(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, &offscreenFrameBuffers.particle.color, width, height);
-
 			VkAttachmentDescription attachmentDescription{};
 			attachmentDescription.format = offscreenFrameBuffers.particle.color.format;
 			attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -466,21 +1191,23 @@ public:
 
 			std::array<VkSubpassDependency, 2> dependencies;
 
+			// The color was last sampled by the composition of the previous frame
 			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 			dependencies[0].dstSubpass = 0;
-			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
 			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+			dependencies[0].srcAccessMask = 0;
+			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependencies[0].dependencyFlags = 0;
 
+			// The color is sampled by the composition
 			dependencies[1].srcSubpass = 0;
 			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
 			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			dependencies[1].dependencyFlags = 0;
 
 			VkRenderPassCreateInfo renderPassInfo = {};
 			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -491,6 +1218,100 @@ public:
 			renderPassInfo.dependencyCount = 2;
 			renderPassInfo.pDependencies = dependencies.data();
 			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &offscreenFrameBuffers.particle.renderPass));
+		}
+
+		createOffscreenFramebuffers();
+	}
+
+	// Create the resolution dependent attachments and frame buffers
+	void createOffscreenFramebuffers()
+	{
+		offscreenFrameBuffers.depthOnly.setSize(width, height);
+		offscreenFrameBuffers.scene.setSize(width, height);
+		offscreenFrameBuffers.particle.setSize(width, height);
+
+		if (!mergedRenderPass)
+		{
+			// The depth buffer may have a stencil aspect, which can't be sampled together with depth
+			VkImageViewCreateInfo imageView = vks::initializers::imageViewCreateInfo();
+			imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			imageView.format = depthFormat;
+			imageView.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+			imageView.image = depthStencil.image;
+			VK_CHECK_RESULT(vkCreateImageView(device, &imageView, nullptr, &sampledDepthView));
+		}
+
+		if (mergedRenderPass)
+		{
+			// Transient attachments, which are only accessed within the merged render pass
+			const VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+			createAttachment(VK_FORMAT_R8G8B8A8_UNORM, usage, &offscreenFrameBuffers.scene.color, width, height);
+			createAttachment(VK_FORMAT_R8G8B8A8_UNORM, usage, &offscreenFrameBuffers.particle.color, width, height);
+			return;
+		}
+
+		if (dynamicRendering)
+		{
+			// The attachments are transient images of the render graph and are bound when rendering begins,
+			// so there are no frame buffers to create
+			renderGraph.compile(width, height);
+			offscreenFrameBuffers.scene.color.image = renderGraph.getImage(graphResources.sceneColor);
+			offscreenFrameBuffers.scene.color.view = renderGraph.getImageView(graphResources.sceneColor);
+			offscreenFrameBuffers.particle.color.image = renderGraph.getImage(graphResources.particleColor);
+			offscreenFrameBuffers.particle.color.view = renderGraph.getImageView(graphResources.particleColor);
+			return;
+		}
+
+		// Depth only
+		{
+			// Use the default depth buffer created in VulkanExampleBase::setupDepthStencil
+			offscreenFrameBuffers.depthOnly.depth.image = depthStencil.image;
+			offscreenFrameBuffers.depthOnly.depth.view = depthStencil.view;
+			offscreenFrameBuffers.depthOnly.depth.mem = depthStencil.mem;
+
+			VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
+			fbufCreateInfo.renderPass = offscreenFrameBuffers.depthOnly.renderPass;
+			fbufCreateInfo.pAttachments = &offscreenFrameBuffers.depthOnly.depth.view;
+			fbufCreateInfo.attachmentCount = 1;
+			fbufCreateInfo.width = offscreenFrameBuffers.depthOnly.width;
+			fbufCreateInfo.height = offscreenFrameBuffers.depthOnly.height;
+			fbufCreateInfo.layers = 1;
+			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreenFrameBuffers.depthOnly.frameBuffer));
+		}
+
+		// Scene
+		{
+			createAttachment(offscreenFrameBuffers.scene.color.format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, &offscreenFrameBuffers.scene.color, width, height);
+
+			std::array<VkImageView, 2> attachments =
+			{
+				offscreenFrameBuffers.scene.color.view,
+				depthStencil.view
+			};
+
+			VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
+			fbufCreateInfo.renderPass = offscreenFrameBuffers.scene.renderPass;
+			fbufCreateInfo.pAttachments = attachments.data();
+			fbufCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+			fbufCreateInfo.width = offscreenFrameBuffers.scene.width;
+			fbufCreateInfo.height = offscreenFrameBuffers.scene.height;
+			fbufCreateInfo.layers = 1;
+			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreenFrameBuffers.scene.frameBuffer));
+		}
+
+		// Particle
+		{
+			// Written as a storage image by the compute rasterizer
+			const VkImageUsageFlags storageUsage = particleRaster.available ? VK_IMAGE_USAGE_STORAGE_BIT : 0;
+			createAttachment(offscreenFrameBuffers.particle.color.format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | storageUsage, &offscreenFrameBuffers.particle.color, width, height);
+			if (particleRaster.available)
+			{
+				// The render graph transitions the particle color between the compute rasterizer and the composition, and without the
+				// particle render pass the steady state frames expect it in the layout the composition leaves it in
+				VkCommandBuffer layoutCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				vks::tools::setImageLayout(layoutCmd, offscreenFrameBuffers.particle.color.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+				vulkanDevice->flushCommandBuffer(layoutCmd, queue, true);
+			}
 
 			VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
 			fbufCreateInfo.renderPass = offscreenFrameBuffers.particle.renderPass;
@@ -501,25 +1322,295 @@ public:
 			fbufCreateInfo.layers = 1;
 			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreenFrameBuffers.particle.frameBuffer));
 		}
+	}
 
-		// Shared sampler used for all color attachments
-		VkSamplerCreateInfo samplerInfo = vks::initializers::samplerCreateInfo();
-		samplerInfo.magFilter = VK_FILTER_LINEAR;
-		samplerInfo.minFilter = VK_FILTER_LINEAR;
-		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-		samplerInfo.addressModeV = samplerInfo.addressModeU;
-		samplerInfo.addressModeW = samplerInfo.addressModeU;
-		samplerInfo.mipLodBias = 0.0f;
-		samplerInfo.maxAnisotropy = 1.0f;
-		samplerInfo.minLod = 0.0f;
-		samplerInfo.maxLod = 1.0f;
-		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-		VK_CHECK_RESULT(vkCreateSampler(device, &samplerInfo, nullptr, &sampler));
+	// Recreate the resolution dependent resources after the swap chain and depth buffer have been resized
+	// Everything else (render passes, pipelines, particle buffers) is kept
+	void resizeOffscreenFramebuffers()
+	{
+		// VulkanExampleBase::windowResize has waited for the device before recreating the swap chain,
+		// so no submitted frame uses the old handles anymore and they are destroyed right away
+		vkDestroyFramebuffer(device, offscreenFrameBuffers.depthOnly.frameBuffer, nullptr);
+		vkDestroyFramebuffer(device, offscreenFrameBuffers.scene.frameBuffer, nullptr);
+		vkDestroyFramebuffer(device, offscreenFrameBuffers.particle.frameBuffer, nullptr);
+		// With dynamic rendering the attachments belong to the render graph, which recreates them when compiled for the new size
+		if (!dynamicRendering) {
+			for (FrameBufferAttachment* attachment : { &offscreenFrameBuffers.scene.color, &offscreenFrameBuffers.particle.color }) {
+				vkDestroyImageView(device, attachment->view, nullptr);
+				vkDestroyImage(device, attachment->image, nullptr);
+			}
+		}
+		vkDestroyImageView(device, sampledDepthView, nullptr);
+
+		// The attachment memory is kept for reuse if the new images fit into it
+		createOffscreenFramebuffers();
+
+		updateAttachmentDescriptors();
+	}
+
+	// Point the descriptors at the current attachments, after they have been (re)created
+	void updateAttachmentDescriptors()
+	{
+		std::vector<VkDescriptorImageInfo> imageDescriptors =
+		{
+			vks::initializers::descriptorImageInfo(sampler, offscreenFrameBuffers.scene.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vks::initializers::descriptorImageInfo(sampler, offscreenFrameBuffers.particle.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, sampledDepthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, offscreenFrameBuffers.particle.color.view, VK_IMAGE_LAYOUT_GENERAL),
+		};
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets =
+		{
+			// Binding 0 : Scene color buffer
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, compositionDescriptorType(), 0, &imageDescriptors[0]),
+			// Binding 1 : Particle color buffer
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, compositionDescriptorType(), 1, &imageDescriptors[1]),
+		};
+		if (particleRaster.available)
+		{
+			// Binding 1 : Depth of the depth only pass
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(particleRaster.descriptorSet, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1, &imageDescriptors[2]));
+			// Binding 7 : Particle color buffer
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(particleRaster.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 7, &imageDescriptors[3]));
+		}
+		if (blendedParticles || particleRaster.available)
+		{
+			// Binding 3 : Depth of the depth only pass
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(descriptorSets.particle, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 3, &imageDescriptors[2]));
+		}
+		if (particleCollision.available)
+		{
+			// Binding 8 : Depth of the depth only pass, also of the simulation replayed for the CPU reference
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(descriptorSets.compute, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 8, &imageDescriptors[2]));
+			if (cpuReference.computeDescriptorSet != VK_NULL_HANDLE) {
+				writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(cpuReference.computeDescriptorSet, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 8, &imageDescriptors[2]));
+			}
+		}
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	// Frame structure shown in the overlay and printed with the benchmark result
+	std::string frameStructure() const
+	{
+		std::string structure = mergedRenderPass ? "subpasses" : (dynamicRendering ? "dynamic rendering" : "render passes");
+		if (asyncCompute.enabled) {
+			structure += ", async compute";
+		}
+		if (particleRaster.mode == PARTICLE_RASTER_COMPUTE) {
+			structure += ", compute raster";
+		}
+		if (particleRaster.mode == PARTICLE_RASTER_SPRITES) {
+			structure += particleSprites.meshShader ? ", mesh shader sprites" : ", sprites";
+		}
+		if (blendedParticles) {
+			structure += ", blended particles";
+		}
+		return structure;
+	}
+
+	// Particle rendering printed with the benchmark result, see bin/compare-meshparticles-raster.py
+	const char* particleRenderingName() const
+	{
+		if (particleRaster.mode == PARTICLE_RASTER_COMPUTE) {
+			return "compute tiles";
+		}
+		if (particleRaster.mode == PARTICLE_RASTER_SPRITES) {
+			return particleSprites.meshShader ? "mesh shader sprites" : "vertex sprites";
+		}
+		return blendedParticles ? "blended points" : "points";
+	}
+
+	// Blended particles accumulate weight sums, which need more range and precision than 8 bits
+	VkFormat particleColorFormat() const
+	{
+		return blendedParticles ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R8G8B8A8_UNORM;
+	}
+
+	// The transmittance of the blended particles starts at one, otherwise all zero marks the pixels without a particle
+	VkClearColorValue particleClearColor() const
+	{
+		VkClearColorValue clearColor = { { 0.0f, 0.0f, 0.0f, blendedParticles ? 1.0f : 0.0f } };
+		return clearColor;
+	}
+
+	// The composition reads the scene and particle colors as input attachments in the merged render pass
+	VkDescriptorType compositionDescriptorType() const
+	{
+		return mergedRenderPass ? VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	}
+
+	// Called on startup and after the swap chain has been recreated, before the command buffers are rebuilt
+	void setupFrameBuffer()
+	{
+		// The offscreen targets only exist after the first call, so later calls come from a window resize
+		const bool resize = (offscreenFrameBuffers.scene.color.image != VK_NULL_HANDLE);
+
+		if (!mergedRenderPass)
+		{
+			VulkanExampleBase::setupFrameBuffer();
+			if (resize)
+			{
+				resizeOffscreenFramebuffers();
+			}
+			return;
+		}
+
+		// The transient attachments are part of the swap chain frame buffers, so they are created first
+		if (resize)
+		{
+			resizeOffscreenFramebuffers();
+		}
+		else
+		{
+			createOffscreenFramebuffers();
+		}
+
+		std::array<VkImageView, 4> attachments;
+		attachments[1] = depthStencil.view;
+		attachments[2] = offscreenFrameBuffers.scene.color.view;
+		attachments[3] = offscreenFrameBuffers.particle.color.view;
+
+		VkFramebufferCreateInfo frameBufferCreateInfo = vks::initializers::framebufferCreateInfo();
+		frameBufferCreateInfo.renderPass = renderPass;
+		frameBufferCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		frameBufferCreateInfo.pAttachments = attachments.data();
+		frameBufferCreateInfo.width = width;
+		frameBufferCreateInfo.height = height;
+		frameBufferCreateInfo.layers = 1;
+
+		frameBuffers.resize(swapChain.imageCount);
+		for (uint32_t i = 0; i < frameBuffers.size(); i++)
+		{
+			attachments[0] = swapChain.buffers[i].view;
+			VK_CHECK_RESULT(vkCreateFramebuffer(device, &frameBufferCreateInfo, nullptr, &frameBuffers[i]));
+		}
+		// Nothing outside of the render pass reads the depth buffer, which is cleared by the depth only subpass.
+		// The pending spawn candidates carry their world position, so they stay valid across the resize.
+	}
+
+	// Single render pass for tile based GPUs, with depth only, scene, particle and composition as subpasses
+	// Only the swap chain image is stored. Depth is cleared and discarded within the render pass, as the spawn candidates
+	// carry their world position and the particle simulation, which runs before the render pass, doesn't sample it.
+	void setupMergedRenderPass()
+	{
+		std::array<VkAttachmentDescription, 4> attachments = {};
+		for (auto& attachment : attachments)
+		{
+			attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		}
+		// Swap chain image
+		attachments[0].format = swapChain.colorFormat;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		// Depth, not needed after the render pass as the spawn candidates carry their world position
+		attachments[1].format = depthFormat;
+		attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		// Scene and particle colors, only read as input attachments by the composition
+		attachments[2].format = VK_FORMAT_R8G8B8A8_UNORM;
+		attachments[3].format = VK_FORMAT_R8G8B8A8_UNORM;
+
+		VkAttachmentReference swapChainReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+		VkAttachmentReference sceneReference = { 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		VkAttachmentReference particleReference = { 3, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		std::array<VkAttachmentReference, 2> inputReferences = { {
+			{ 2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+			{ 3, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }
+		} };
+		// The particle subpass keeps the depth and the scene color, the composition keeps the depth
+		std::array<uint32_t, 2> particlePreserve = { 1, 2 };
+		uint32_t compositionPreserve = 1;
+
+		std::array<VkSubpassDescription, 4> subpasses = {};
+		for (auto& subpass : subpasses)
+		{
+			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		}
+
+		subpasses[SUBPASS_DEPTH_ONLY].pDepthStencilAttachment = &depthReference;
+
+		subpasses[SUBPASS_SCENE].colorAttachmentCount = 1;
+		subpasses[SUBPASS_SCENE].pColorAttachments = &sceneReference;
+		subpasses[SUBPASS_SCENE].pDepthStencilAttachment = &depthReference;
+
+		subpasses[SUBPASS_PARTICLE].colorAttachmentCount = 1;
+		subpasses[SUBPASS_PARTICLE].pColorAttachments = &particleReference;
+		subpasses[SUBPASS_PARTICLE].preserveAttachmentCount = static_cast<uint32_t>(particlePreserve.size());
+		subpasses[SUBPASS_PARTICLE].pPreserveAttachments = particlePreserve.data();
+
+		subpasses[SUBPASS_COMPOSITION].colorAttachmentCount = 1;
+		subpasses[SUBPASS_COMPOSITION].pColorAttachments = &swapChainReference;
+		subpasses[SUBPASS_COMPOSITION].inputAttachmentCount = static_cast<uint32_t>(inputReferences.size());
+		subpasses[SUBPASS_COMPOSITION].pInputAttachments = inputReferences.data();
+		subpasses[SUBPASS_COMPOSITION].preserveAttachmentCount = 1;
+		subpasses[SUBPASS_COMPOSITION].pPreserveAttachments = &compositionPreserve;
+
+		std::array<VkSubpassDependency, 5> dependencies;
+
+		// The depth is cleared after the depth tests of the previous frame
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = SUBPASS_DEPTH_ONLY;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dependencyFlags = 0;
+
+		// Swap chain image acquire
+		dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].dstSubpass = SUBPASS_COMPOSITION;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].srcAccessMask = 0;
+		dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dependencyFlags = 0;
+
+		// The scene is only shaded where the depth only subpass left the nearest surface
+		dependencies[2].srcSubpass = SUBPASS_DEPTH_ONLY;
+		dependencies[2].dstSubpass = SUBPASS_SCENE;
+		dependencies[2].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[2].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[2].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[2].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		// The composition reads the scene and particle colors of the same pixel
+		dependencies[3].srcSubpass = SUBPASS_SCENE;
+		dependencies[3].dstSubpass = SUBPASS_COMPOSITION;
+		dependencies[3].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[3].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[3].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[3].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+		dependencies[3].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		dependencies[4] = dependencies[3];
+		dependencies[4].srcSubpass = SUBPASS_PARTICLE;
+
+		VkRenderPassCreateInfo renderPassInfo = {};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassInfo.pAttachments = attachments.data();
+		renderPassInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+		renderPassInfo.pSubpasses = subpasses.data();
+		renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderPassInfo.pDependencies = dependencies.data();
+
+		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass));
 	}
 
 	void setupRenderPass()
 	{
+		if (mergedRenderPass)
+		{
+			setupMergedRenderPass();
+			return;
+		}
+
 		std::array<VkAttachmentDescription, 2> attachments = {};
 		// Color attachment
 		attachments[0].format = swapChain.colorFormat;
@@ -563,20 +1654,22 @@ public:
 		// Subpass dependencies for layout transitions
 		std::array<VkSubpassDependency, 2> dependencies;
 
+		// Waits for the swap chain image and for the scene pass leaving the depth buffer, which compute shaders may read
 		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 		dependencies[0].dstSubpass = 0;
-		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].srcAccessMask = 0;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dependencyFlags = 0;
 
+		// Presentation waits on a semaphore, which covers the memory dependency
 		dependencies[1].srcSubpass = 0;
 		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
 		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = 0;
 		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
 		VkRenderPassCreateInfo renderPassInfo = {};
@@ -591,351 +1684,896 @@ public:
 		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass));
 	}
 
+	// Path of a meshparticles shader with the selected variants it has, see VARIANTS in compileshaders.py
+	// which compiles every combination of the variants a shader tests, named in the order listed here,
+	// e.g. particle.comp.debug.collision.spv
+	std::string shaderFile(const std::string& name)
+	{
+		struct Variant {
+			std::string name;
+			bool selected;
+			// Shaders that test the define of the variant, also through the headers they include
+			std::vector<std::string> shaders;
+		};
+		const std::vector<Variant> variants = {
+			// debugPrintfEXT instrumentation
+			{ "debug", shaderDebug, { "gpu_cmd.comp" } },
+			// 64 bit packing of the compute rasterizer if the device supports it
+			{ "atomic64", particleRaster.atomic64, { "raster_bin.comp", "raster_scan.comp", "raster_tile.comp" } },
+			// Depth buffer collisions of the simulation
+			{ "collision", particleCollision.available, { "particle.comp" } }
+		};
+		std::string file = getShadersPath() + "meshparticles/" + name;
+		for (const Variant& variant : variants) {
+			if (variant.selected && std::find(variant.shaders.begin(), variant.shaders.end(), name) != variant.shaders.end()) {
+				file += "." + variant.name;
+			}
+		}
+		return file + ".spv";
+	}
+
 	void loadAssets()
 	{
 		vkglTF::descriptorBindingFlags = vkglTF::DescriptorBindingFlags::ImageBaseColor;
 		const uint32_t gltfLoadingFlags = vkglTF::FileLoadingFlags::FlipY | vkglTF::FileLoadingFlags::PreTransformVertices;
 
+		// The mesh is read back to generate the surface point set
+		vkglTF::memoryPropertyFlags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 		sphere.loadFromFile(getAssetPath() + "models/sphere.gltf", vulkanDevice, queue, gltfLoadingFlags);
 		particlespawn.loadFromFile(getAssetPath() + "textures/particlespawn.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 	}
 
-	void buildCommandBuffers()
+	// Calculate the dispatch and draw commands on the GPU
+	void recordGpuCommand(VkCommandBuffer commandBuffer)
 	{
-		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		// Dispatch the compute job
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.gpuCmd);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.gpuCmd, 0, 1, &descriptorSets.gpuCmd, 0, 0);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+	}
+
+	// Generate and animate the particles
+	void recordParticleSimulation(VkCommandBuffer commandBuffer)
+	{
+		// Dispatch the compute job
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.compute);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.compute, 0, 1, &descriptorSets.compute, 0, 0);
+		// We'll process one particle per thread, and the 
+		// particle count is determined in fragment shader,
+		// thus it's best to use indirect dispatch to read parameters directly in GPU buffer.
+		vkCmdDispatchIndirect(commandBuffer, resourceBuffers.gpucmd.buffer, offsetof(GpuCmdBuffer, dispatchCmd));
+	}
+
+	// Emit the surface points crossing the dissolve threshold
+	void recordSurfaceEmit(VkCommandBuffer commandBuffer)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.emit);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.emit, 0, 1, &descriptorSets.emit, 0, 0);
+		// One work group per instance, each one walks the point range of its instance
+		vkCmdDispatch(commandBuffer, instanceCount, 1, 1);
+	}
+
+	// Draw the particles from the compacted particle buffer
+	void drawParticles(VkCommandBuffer commandBuffer)
+	{
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.particle, 0, 1, &descriptorSets.particle, 0, NULL);
+
+		// The sprites read the particles from the storage buffer
+		if (particleRaster.mode == PARTICLE_RASTER_SPRITES)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, particleSprites.pipeline);
+			if (particleSprites.meshShader) {
+				particleSprites.vkCmdDrawMeshTasksIndirectEXT(commandBuffer, particleSprites.commands.buffer, offsetof(SpriteCmdBuffer, meshTasksCmd), 1, 0);
+			} else {
+				vkCmdDrawIndirect(commandBuffer, particleSprites.commands.buffer, offsetof(SpriteCmdBuffer, drawCmd), 1, 0);
+			}
+			return;
+		}
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.particle);
 
 		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, PARTICLE_VERTEX_BUFFER_BIND_ID, 1, &resourceBuffers.particle.buffer, offsets);
+		vkCmdDrawIndirect(commandBuffer, resourceBuffers.gpucmd.buffer, offsetof(GpuCmdBuffer, drawCmd), 1, 0);
+	}
+
+	// Combine the scene and particle colors into the swap chain image
+	void drawComposition(VkCommandBuffer commandBuffer)
+	{
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.composition, 0, 1, &descriptorSets.composition, 0, NULL);
+
+		// Final composition pass
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.composition);
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	}
 
-		uint32_t queueFamilyIndex = vulkanDevice->queueFamilyIndices.graphics;
+	// Begin dynamic rendering of an offscreen pass, the color and depth attachments are optional
+	// Color is cleared to zero unless given, depth is either cleared or loaded from a previous pass
+	void beginOffscreenRendering(VkCommandBuffer commandBuffer, VkImageView colorView, VkImageView depthView, VkAttachmentLoadOp depthLoadOp, VkClearColorValue clearColor = VkClearColorValue())
+	{
+		VkRenderingAttachmentInfoKHR colorAttachment{};
+		colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+		colorAttachment.imageView = colorView;
+		colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.clearValue.color = clearColor;
+
+		VkRenderingAttachmentInfoKHR depthAttachment{};
+		depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+		depthAttachment.imageView = depthView;
+		depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthAttachment.loadOp = depthLoadOp;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		depthAttachment.clearValue.depthStencil = { 1.0f, 0 };
+
+		VkRenderingInfoKHR renderingInfo{};
+		renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+		renderingInfo.renderArea = { 0, 0, width, height };
+		renderingInfo.layerCount = 1;
+		renderingInfo.colorAttachmentCount = (colorView != VK_NULL_HANDLE) ? 1 : 0;
+		renderingInfo.pColorAttachments = &colorAttachment;
+		renderingInfo.pDepthAttachment = (depthView != VK_NULL_HANDLE) ? &depthAttachment : nullptr;
+
+		vkCmdBeginRenderingKHR(commandBuffer, &renderingInfo);
+
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	}
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
+	void recordDepthOnlyPass(VkCommandBuffer commandBuffer)
+	{
+		if (dynamicRendering)
 		{
-			VkCommandBuffer& commandBuffer = drawCmdBuffers[i];
+			beginOffscreenRendering(commandBuffer, VK_NULL_HANDLE, depthStencil.view, VK_ATTACHMENT_LOAD_OP_CLEAR);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.depthOnly);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
+			sphere.draw(commandBuffer, instanceCount, 0, pipelineLayouts.scene);
+			vkCmdEndRenderingKHR(commandBuffer);
+			return;
+		}
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+		std::vector<VkClearValue> clearValues(1);
+		clearValues[0].depthStencil = { 1.0f, 0 };
 
-			/*
-				Clear pass
-			*/
-			{
-				vkCmdFillBuffer(commandBuffer, resourceBuffers.gpucmd.buffer, 0, VK_WHOLE_SIZE, 0);
-				vkCmdFillBuffer(commandBuffer, resourceBuffers.append.buffer, 0, VK_WHOLE_SIZE, 0);
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = offscreenFrameBuffers.depthOnly.renderPass;
+		renderPassBeginInfo.framebuffer = offscreenFrameBuffers.depthOnly.frameBuffer;
+		renderPassBeginInfo.renderArea.extent.width = offscreenFrameBuffers.depthOnly.width;
+		renderPassBeginInfo.renderArea.extent.height = offscreenFrameBuffers.depthOnly.height;
+		renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassBeginInfo.pClearValues = clearValues.data();
 
-				VkBufferMemoryBarrier buffer_barrier =
-				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-					nullptr,
-					VK_ACCESS_TRANSFER_WRITE_BIT,
-					VK_ACCESS_SHADER_READ_BIT,
-					queueFamilyIndex,
-					queueFamilyIndex,
-					resourceBuffers.gpucmd.buffer,
-					0,
-					resourceBuffers.gpucmd.size
-				};
-
-				vkCmdPipelineBarrier(
-					commandBuffer,
-					VK_PIPELINE_STAGE_TRANSFER_BIT,
-					VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-					0,
-					0, nullptr,
-					1, &buffer_barrier,
-					0, nullptr);
-
-				buffer_barrier.buffer = resourceBuffers.append.buffer;
-				buffer_barrier.size = resourceBuffers.append.size;
-				vkCmdPipelineBarrier(
-					commandBuffer,
-					VK_PIPELINE_STAGE_TRANSFER_BIT,
-					VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-					0,
-					0, nullptr,
-					1, &buffer_barrier,
-					0, nullptr);
-			}
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			/*
-				First pass: Depth only
-			*/
-			{
-				std::vector<VkClearValue> clearValues(1);
-				clearValues[0].depthStencil = { 1.0f, 0 };
+		VkViewport viewport = vks::initializers::viewport((float)offscreenFrameBuffers.depthOnly.width, (float)offscreenFrameBuffers.depthOnly.height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = offscreenFrameBuffers.depthOnly.renderPass;
-				renderPassBeginInfo.framebuffer = offscreenFrameBuffers.depthOnly.frameBuffer;
-				renderPassBeginInfo.renderArea.extent.width = offscreenFrameBuffers.depthOnly.width;
-				renderPassBeginInfo.renderArea.extent.height = offscreenFrameBuffers.depthOnly.height;
-				renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-				renderPassBeginInfo.pClearValues = clearValues.data();
+		VkRect2D scissor = vks::initializers::rect2D(offscreenFrameBuffers.depthOnly.width, offscreenFrameBuffers.depthOnly.height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.depthOnly);
 
-				VkViewport viewport = vks::initializers::viewport((float)offscreenFrameBuffers.depthOnly.width, (float)offscreenFrameBuffers.depthOnly.height, 0.0f, 1.0f);
-				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
+		sphere.draw(commandBuffer, instanceCount, 0, pipelineLayouts.scene);
 
-				VkRect2D scissor = vks::initializers::rect2D(offscreenFrameBuffers.depthOnly.width, offscreenFrameBuffers.depthOnly.height, 0, 0);
-				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+		vkCmdEndRenderPass(commandBuffer);
+	}
 
-				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.depthOnly);
+	void recordScenePass(VkCommandBuffer commandBuffer)
+	{
+		if (dynamicRendering)
+		{
+			beginOffscreenRendering(commandBuffer, offscreenFrameBuffers.scene.color.view, depthStencil.view, VK_ATTACHMENT_LOAD_OP_LOAD);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.scene);
+			sphere.draw(commandBuffer, instanceCount, 0, pipelineLayouts.scene);
+			vkCmdEndRenderingKHR(commandBuffer);
+			return;
+		}
 
-				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
-				sphere.draw(commandBuffer, INSTANCE_COUNT, 0, pipelineLayouts.scene);
+		std::vector<VkClearValue> clearValues(2);
+		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
 
-				vkCmdEndRenderPass(commandBuffer);
-			}
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = offscreenFrameBuffers.scene.renderPass;
+		renderPassBeginInfo.framebuffer = offscreenFrameBuffers.scene.frameBuffer;
+		renderPassBeginInfo.renderArea.extent.width = offscreenFrameBuffers.scene.width;
+		renderPassBeginInfo.renderArea.extent.height = offscreenFrameBuffers.scene.height;
+		renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassBeginInfo.pClearValues = clearValues.data();
 
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			/*
-				Second pass: Scene rendering
-			*/
-			{
-				std::vector<VkClearValue> clearValues(2);
-				clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-				clearValues[1].depthStencil = { 1.0f, 0 };
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = offscreenFrameBuffers.scene.renderPass;
-				renderPassBeginInfo.framebuffer = offscreenFrameBuffers.scene.frameBuffer;
-				renderPassBeginInfo.renderArea.extent.width = offscreenFrameBuffers.scene.width;
-				renderPassBeginInfo.renderArea.extent.height = offscreenFrameBuffers.scene.height;
-				renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-				renderPassBeginInfo.pClearValues = clearValues.data();
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
 
-				VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.scene);
 
-				VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+		sphere.draw(commandBuffer, instanceCount, 0, pipelineLayouts.scene);
 
-				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
+		vkCmdEndRenderPass(commandBuffer);
+	}
 
-				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.scene);
+	void recordParticlePass(VkCommandBuffer commandBuffer)
+	{
+		if (dynamicRendering)
+		{
+			beginOffscreenRendering(commandBuffer, offscreenFrameBuffers.particle.color.view, VK_NULL_HANDLE, VK_ATTACHMENT_LOAD_OP_DONT_CARE, particleClearColor());
+			drawParticles(commandBuffer);
+			vkCmdEndRenderingKHR(commandBuffer);
+			return;
+		}
 
-				sphere.draw(commandBuffer, INSTANCE_COUNT, 0, pipelineLayouts.scene);
+		// Clear particle render target to all zero, so that we know
+		// which pixel renders a particle.
+		std::vector<VkClearValue> clearValues(1);
+		clearValues[0].color = particleClearColor();
 
-				vkCmdEndRenderPass(commandBuffer);
-			}
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = offscreenFrameBuffers.particle.renderPass;
+		renderPassBeginInfo.framebuffer = offscreenFrameBuffers.particle.frameBuffer;
+		renderPassBeginInfo.renderArea.extent.width = offscreenFrameBuffers.particle.width;
+		renderPassBeginInfo.renderArea.extent.height = offscreenFrameBuffers.particle.height;
+		renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassBeginInfo.pClearValues = clearValues.data();
 
-			{
-				VkBufferMemoryBarrier buffer_barrier =
-				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-					nullptr,
-					VK_ACCESS_SHADER_WRITE_BIT,
-					VK_ACCESS_SHADER_READ_BIT,
-					queueFamilyIndex,
-					queueFamilyIndex,
-					resourceBuffers.gpucmd.buffer,
-					0,
-					resourceBuffers.gpucmd.size
-				};
-
-				vkCmdPipelineBarrier(
-					commandBuffer,
-					VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-					0,
-					0, nullptr,
-					1, &buffer_barrier,
-					0, nullptr);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		drawParticles(commandBuffer);
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	// Screen tiles of the compute rasterizer at the current resolution
+	VkExtent2D particleRasterTiles() const
+	{
+		return { (width + PARTICLE_RASTER_TILE_SIZE - 1) / PARTICLE_RASTER_TILE_SIZE, (height + PARTICLE_RASTER_TILE_SIZE - 1) / PARTICLE_RASTER_TILE_SIZE };
+	}
+
+	// Reset the entry counts of the tiles at the current resolution
+	void recordParticleRasterClear(VkCommandBuffer commandBuffer)
+	{
+		const VkExtent2D tiles = particleRasterTiles();
+		vkCmdFillBuffer(commandBuffer, particleRaster.tileCounts.buffer, 0, tiles.width * tiles.height * sizeof(uint32_t), 0);
+	}
+
+	// Count the covered pixels of each tile, or write them to the tile ranges with scatter
+	// One invocation per particle, dispatched with the indirect command of the simulation
+	void recordParticleBinning(VkCommandBuffer commandBuffer, bool scatter)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, scatter ? particleRaster.pipelines.scatter : particleRaster.pipelines.count);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleRaster.pipelineLayout, 0, 1, &particleRaster.descriptorSet, 0, 0);
+		vkCmdDispatchIndirect(commandBuffer, resourceBuffers.gpucmd.buffer, offsetof(GpuCmdBuffer, dispatchCmd));
+	}
+
+	// Derive the sprite draw commands from the live particle count
+	void recordSpriteCommand(VkCommandBuffer commandBuffer)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleSprites.commandPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleRaster.pipelineLayout, 0, 1, &particleRaster.descriptorSet, 0, 0);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+	}
+
+	// Scan the tile counts into the offsets of the tile ranges
+	void recordParticleTileScan(VkCommandBuffer commandBuffer)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleRaster.pipelines.scan);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleRaster.pipelineLayout, 0, 1, &particleRaster.descriptorSet, 0, 0);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+	}
+
+	// Resolve the nearest particle of each pixel, one work group per tile
+	// Every pixel is written, so the particle color doesn't need to be cleared, except for the sprites drawn before
+	// The transitions of the particle color to and from the general layout are derived by the render graph
+	void recordParticleTileRaster(VkCommandBuffer commandBuffer)
+	{
+		const VkExtent2D tiles = particleRasterTiles();
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleRaster.pipelines.tile);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleRaster.pipelineLayout, 0, 1, &particleRaster.descriptorSet, 0, 0);
+		vkCmdDispatch(commandBuffer, tiles.width, tiles.height, 1);
+	}
+
+	void recordCompositionPass(VkCommandBuffer commandBuffer, uint32_t i)
+	{
+		std::vector<VkClearValue> clearValues(2);
+		clearValues[0].color = defaultClearColor;
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.framebuffer = VulkanExampleBase::frameBuffers[i];
+		renderPassBeginInfo.renderArea.extent.width = width;
+		renderPassBeginInfo.renderArea.extent.height = height;
+		renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassBeginInfo.pClearValues = clearValues.data();
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		drawComposition(commandBuffer);
+
+		drawUI(commandBuffer);
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	// Single render pass with one subpass per stage
+	void recordMergedRenderPass(VkCommandBuffer commandBuffer, uint32_t i)
+	{
+		std::array<VkClearValue, 4> clearValues;
+		clearValues[0].color = defaultClearColor;
+		clearValues[1].depthStencil = { 1.0f, 0 };
+		// Clear particle render target to all zero, so that we know
+		// which pixel renders a particle.
+		clearValues[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+		clearValues[3].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.framebuffer = VulkanExampleBase::frameBuffers[i];
+		renderPassBeginInfo.renderArea.extent.width = width;
+		renderPassBeginInfo.renderArea.extent.height = height;
+		renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassBeginInfo.pClearValues = clearValues.data();
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		// Depth only
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.depthOnly);
+		sphere.draw(commandBuffer, instanceCount, 0, pipelineLayouts.scene);
+
+		// Scene rendering
+		vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.scene);
+		sphere.draw(commandBuffer, instanceCount, 0, pipelineLayouts.scene);
+
+		// Particle rendering
+		vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+		if (gpuTimings.supported) {
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, gpuTimings.queryPool, TIMESTAMP_PARTICLE_RENDER_BEGIN);
+		}
+		drawParticles(commandBuffer);
+		if (gpuTimings.supported) {
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, gpuTimings.queryPool, TIMESTAMP_PARTICLE_RENDER_END);
+		}
+
+		// Composition
+		vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+		drawComposition(commandBuffer);
+
+		drawUI(commandBuffer);
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	// Timestamps don't access any resources of the graph, so they are kept as side effects
+	void addTimestampPass(vks::RenderGraph& graph, const std::string& name, VkPipelineStageFlagBits stage, Timestamp query)
+	{
+		if (!gpuTimings.supported) {
+			return;
+		}
+		vks::RenderGraph::Pass pass = graph.addPass(name, [this, stage, query](VkCommandBuffer commandBuffer, uint32_t) {
+			vkCmdWriteTimestamp(commandBuffer, stage, gpuTimings.queryPool, query);
+		});
+		graph.setSideEffect(pass);
+	}
+
+	// Queue family ownership transfer of the particle buffer between the graphics and the compute queue
+	// The graph doesn't know about queue families, so the release and acquire barriers are recorded by side effect passes.
+	// The stage is the last use of the buffer on the releasing queue, or the first use on the acquiring one.
+	void addParticleOwnershipPass(vks::RenderGraph& graph, const std::string& name, VkPipelineStageFlags stage, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, uint32_t srcQueueFamily, uint32_t dstQueueFamily)
+	{
+		vks::RenderGraph::Pass pass = graph.addPass(name, [=](VkCommandBuffer commandBuffer, uint32_t) {
+			VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+			barrier.srcAccessMask = srcAccessMask;
+			barrier.dstAccessMask = dstAccessMask;
+			barrier.srcQueueFamilyIndex = srcQueueFamily;
+			barrier.dstQueueFamilyIndex = dstQueueFamily;
+			barrier.buffer = resourceBuffers.particle.buffer;
+			barrier.offset = 0;
+			barrier.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(commandBuffer, stage, stage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		});
+		graph.setSideEffect(pass);
+	}
+
+	// Compute passes shared by both frame structures and the compute queue
+	void addGpuCommandPass(vks::RenderGraph& graph, const GraphResources& resources)
+	{
+		vks::RenderGraph::Pass pass = graph.addPass("gpu command", [this](VkCommandBuffer commandBuffer, uint32_t) { recordGpuCommand(commandBuffer); });
+		graph.write(pass, resources.gpucmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+		graph.write(pass, resources.global, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+		graph.write(pass, resources.stats, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+
+		// The host reads the statistics once the frame is done, the pass only declares the access
+		// so that the graph makes the writes of gpu_cmd.comp visible to the host
+		vks::RenderGraph::Pass statsPass = graph.addPass("particle stats readback", [](VkCommandBuffer, uint32_t) {});
+		graph.read(statsPass, resources.stats, VK_PIPELINE_STAGE_2_HOST_BIT_KHR, VK_ACCESS_2_HOST_READ_BIT_KHR);
+		graph.setSideEffect(statsPass);
+	}
+
+	vks::RenderGraph::Pass addParticleSimulationPass(vks::RenderGraph& graph, const GraphResources& resources)
+	{
+		vks::RenderGraph::Pass pass = graph.addPass("particle simulation", [this](VkCommandBuffer commandBuffer, uint32_t) { recordParticleSimulation(commandBuffer); });
+		// The dispatch command is consumed by the draw indirect stage, the draw command is counted up by the particle threads
+		graph.read(pass, resources.gpucmd, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR);
+		graph.write(pass, resources.gpucmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+		graph.read(pass, resources.append, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR);
+		graph.write(pass, resources.spawn, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+		graph.write(pass, resources.particle, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+		graph.write(pass, resources.global, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+		return pass;
+	}
+
+	// Only enabled with surface spawning, see buildCommandBuffers
+	void addSurfaceEmitPass()
+	{
+		surfaceEmitPass = renderGraph.addPass("surface emit", [this](VkCommandBuffer commandBuffer, uint32_t) { recordSurfaceEmit(commandBuffer); });
+		renderGraph.write(surfaceEmitPass, graphResources.gpucmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+		renderGraph.write(surfaceEmitPass, graphResources.append, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+	}
+
+	// Buffer accesses of the scene pass, the spawn candidates are appended by scene.frag with screen spawning
+	// The accesses are declared for both spawn sources, so the graph doesn't change with the spawn source
+	void declareSceneAccesses(vks::RenderGraph::Pass pass)
+	{
+		renderGraph.write(pass, graphResources.gpucmd, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+		renderGraph.write(pass, graphResources.append, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+	}
+
+	// Buffer accesses of the particle pass, the sprites are declared along with the points
+	void declareParticleAccesses(vks::RenderGraph::Pass pass)
+	{
+		renderGraph.read(pass, graphResources.gpucmd, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR);
+		renderGraph.read(pass, graphResources.particle, VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT_KHR, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT_KHR);
+		if (particleRaster.available) {
+			renderGraph.read(pass, graphResources.spriteCmd, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR);
+			renderGraph.read(pass, graphResources.particle, spriteShaderStage(), VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR);
+			if (particleSprites.meshShader) {
+				renderGraph.read(pass, graphResources.spriteCmd, VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR);
 			}
+		}
+	}
 
-			/*
-				Third pass: Calculate command on GPU
-			*/
-			{
-				// Dispatch the compute job
-				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.gpuCmd);
-				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.gpuCmd, 0, 1, &descriptorSets.gpuCmd, 0, 0);
-				vkCmdDispatch(commandBuffer, 1, 1, 1);
+	// Stage of the sprite expansion
+	VkPipelineStageFlags2KHR spriteShaderStage() const
+	{
+		return particleSprites.meshShader ? VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT : VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR;
+	}
+
+	// Only enabled with sprites, see enableParticleRasterPasses
+	void addSpriteCommandPass()
+	{
+		particleSprites.commandPass = renderGraph.addPass("sprite command", [this](VkCommandBuffer commandBuffer, uint32_t) { recordSpriteCommand(commandBuffer); });
+		renderGraph.read(particleSprites.commandPass, graphResources.gpucmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR);
+		renderGraph.write(particleSprites.commandPass, graphResources.spriteCmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+	}
+
+	// Compute rasterizer passes, alternative to the point list draw of the particle pass, or splatting the particles below a pixel after the sprites
+	void addParticleRasterPasses()
+	{
+		const VkPipelineStageFlags2KHR compute = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+		const VkAccessFlags2KHR storageRead = VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR;
+		const VkAccessFlags2KHR storageReadWrite = VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR;
+		std::vector<vks::RenderGraph::Pass>& passes = particleRaster.computePasses;
+
+		vks::RenderGraph::Pass clear = renderGraph.addPass("particle raster clear", [this](VkCommandBuffer commandBuffer, uint32_t) { recordParticleRasterClear(commandBuffer); });
+		renderGraph.write(clear, graphResources.tileCounts, VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR);
+		passes.push_back(clear);
+
+		// Both binning dispatches read the live particles and test them against the depth only pass
+		for (bool scatter : { false, true })
+		{
+			vks::RenderGraph::Pass binning = renderGraph.addPass(scatter ? "particle scatter" : "particle binning",
+				[this, scatter](VkCommandBuffer commandBuffer, uint32_t) { recordParticleBinning(commandBuffer, scatter); });
+			renderGraph.read(binning, graphResources.gpucmd, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR);
+			renderGraph.read(binning, graphResources.gpucmd, compute, storageRead);
+			renderGraph.read(binning, graphResources.particle, compute, storageRead);
+			renderGraph.read(binning, graphResources.depth, compute, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			if (scatter) {
+				renderGraph.write(binning, graphResources.tileOffsets, compute, storageReadWrite);
+				renderGraph.write(binning, graphResources.rasterEntries, compute, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+			} else {
+				renderGraph.write(binning, graphResources.tileCounts, compute, storageReadWrite);
 			}
+			passes.push_back(binning);
 
+			if (!scatter)
 			{
-				VkBufferMemoryBarrier cmd_barrier =
-				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-					nullptr,
-					VK_ACCESS_SHADER_WRITE_BIT,
-					VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
-					queueFamilyIndex,
-					queueFamilyIndex,
-					resourceBuffers.gpucmd.buffer,
-					0,
-					resourceBuffers.gpucmd.size
-				};
-
-				vkCmdPipelineBarrier(
-					commandBuffer,
-					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-					VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,  // VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT: Stage of the pipeline where Draw/DispatchIndirect data structures are consumed.
-					0,
-					0, nullptr,
-					1, &cmd_barrier,
-					0, nullptr);
-
-				VkBufferMemoryBarrier global_barrier =
-				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-					nullptr,
-					VK_ACCESS_SHADER_WRITE_BIT,
-					VK_ACCESS_SHADER_READ_BIT,
-					queueFamilyIndex,
-					queueFamilyIndex,
-					resourceBuffers.global.buffer,
-					0,
-					resourceBuffers.global.size
-				};
-
-				vkCmdPipelineBarrier(
-					commandBuffer,
-					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-					0,
-					0, nullptr,
-					1, &global_barrier,
-					0, nullptr);
+				vks::RenderGraph::Pass scan = renderGraph.addPass("particle tile scan", [this](VkCommandBuffer commandBuffer, uint32_t) { recordParticleTileScan(commandBuffer); });
+				renderGraph.read(scan, graphResources.tileCounts, compute, storageRead);
+				renderGraph.write(scan, graphResources.tileOffsets, compute, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+				passes.push_back(scan);
 			}
+		}
+
+		vks::RenderGraph::Pass tile = renderGraph.addPass("particle tile raster", [this](VkCommandBuffer commandBuffer, uint32_t) { recordParticleTileRaster(commandBuffer); });
+		renderGraph.read(tile, graphResources.tileCounts, compute, storageRead);
+		renderGraph.read(tile, graphResources.tileOffsets, compute, storageRead);
+		renderGraph.read(tile, graphResources.rasterEntries, compute, storageRead);
+		// Keeps the sprites, without them the tiles are the first pass writing the particle color, every pixel of which they write
+		renderGraph.write(tile, graphResources.particleColor, compute, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL);
+		passes.push_back(tile);
+	}
 
+	// Only one of the particle rasterizers is recorded, the sprites use the particle pass and the compute rasterizer
+	void enableParticleRasterPasses()
+	{
+		if (!particleRaster.available) {
+			return;
+		}
+		const bool sprites = particleRaster.mode == PARTICLE_RASTER_SPRITES;
+		const bool compute = particleRaster.mode == PARTICLE_RASTER_COMPUTE || sprites;
+		renderGraph.setEnabled(particleRaster.pointsPass, particleRaster.mode != PARTICLE_RASTER_COMPUTE);
+		renderGraph.setEnabled(particleSprites.commandPass, sprites);
+		for (auto pass : particleRaster.computePasses) {
+			renderGraph.setEnabled(pass, compute);
+		}
+	}
+
+	// One render pass per stage, the scene and particle colors are stored and sampled by the composition
+	void setupSeparatePassGraph()
+	{
+		const VkPipelineStageFlags2KHR depthTests = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR;
+		// Stages and accesses the external subpass dependencies of the scene and particle render passes make their attachments visible to
+		const VkPipelineStageFlags2KHR sampledStages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+		const VkAccessFlags2KHR sampledAccess = VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR;
+		// Without dynamic rendering the particle color is only tracked for the compute rasterizer, see setupRenderGraph
+		const bool particleColorTracked = dynamicRendering || particleRaster.available;
+		const uint32_t graphicsQueueFamily = vulkanDevice->queueFamilyIndices.graphics;
+		const uint32_t computeQueueFamily = vulkanDevice->queueFamilyIndices.compute;
+		// The sprites read the particles in the vertex or mesh shader
+		const VkPipelineStageFlags particleStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+			(particleRaster.available ? static_cast<VkPipelineStageFlags>(spriteShaderStage()) : 0);
+
+		/*
+			First pass: Depth only
+		*/
+		vks::RenderGraph::Pass depthOnly = renderGraph.addPass("depth only", [this](VkCommandBuffer commandBuffer, uint32_t) { recordDepthOnlyPass(commandBuffer); });
+		if (dynamicRendering) {
+			// The depth buffer contents of the previous frame are discarded
+			renderGraph.write(depthOnly, graphResources.depth, depthTests, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR,
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true);
+		} else {
+			// Render passes synchronize their attachments with subpass dependencies, which the graph doesn't see
+			renderGraph.setSideEffect(depthOnly);
+		}
+
+		/*
+			Second pass: Scene rendering
+		*/
+		vks::RenderGraph::Pass scene = renderGraph.addPass("scene", [this](VkCommandBuffer commandBuffer, uint32_t) { recordScenePass(commandBuffer); });
+		declareSceneAccesses(scene);
+		if (dynamicRendering) {
+			// The scene is only shaded where the depth only pass left the nearest surface
+			renderGraph.read(scene, graphResources.depth, depthTests, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+			renderGraph.write(scene, graphResources.sceneColor, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		} else {
+			// The render pass leaves depth in the shader read only layout, visible to the compute and fragment shaders that sample it
+			renderGraph.setSideEffect(scene);
+			renderGraph.setLayoutAfter(scene, graphResources.depth, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR,
+				VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR, sampledStages, sampledAccess);
+		}
+
+		if (asyncCompute.enabled)
+		{
 			/*
-				Fourth pass: Particle generation
+				Surface spawning, consumed by the simulation of the next frame on the compute queue
 			*/
-			{
-				// Dispatch the compute job
-				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.compute);
-				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.compute, 0, 1, &descriptorSets.compute, 0, 0);
-				// We'll process one particle per thread, and the 
-				// particle count is determined in fragment shader,
-				// thus it's best to use indirect dispatch to read parameters directly in GPU buffer.
-				vkCmdDispatchIndirect(commandBuffer, resourceBuffers.gpucmd.buffer, offsetof(GpuCmdBuffer, dispatchCmd));
-			}
-
-			{
-				VkBufferMemoryBarrier cmd_barrier =
-				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-					nullptr,
-					VK_ACCESS_SHADER_WRITE_BIT,
-					VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
-					queueFamilyIndex,
-					queueFamilyIndex,
-					resourceBuffers.gpucmd.buffer,
-					0,
-					resourceBuffers.gpucmd.size
-				};
-
-				vkCmdPipelineBarrier(
-					commandBuffer,
-					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-					VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
-					0,
-					0, nullptr,
-					1, &cmd_barrier,
-					0, nullptr);
-
-				VkBufferMemoryBarrier vertex_barrier =
-				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-					nullptr,
-					VK_ACCESS_SHADER_WRITE_BIT,
-					VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-					queueFamilyIndex,
-					queueFamilyIndex,
-					resourceBuffers.particle.buffer,
-					0,
-					resourceBuffers.particle.size
-				};
-
-				vkCmdPipelineBarrier(
-					commandBuffer,
-					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-					VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-					0,
-					0, nullptr,
-					1, &vertex_barrier,
-					0, nullptr);
-			}
+			addSurfaceEmitPass();
+			renderGraph.setSubmitBoundary(surfaceEmitPass);
 
+			// The second submit waits for the simulation of this frame, the particles are drawn or read by the compute rasterizer
+			addParticleOwnershipPass(renderGraph, "acquire particles", particleStages, 0, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT, computeQueueFamily, graphicsQueueFamily);
+		}
+		else
+		{
 			/*
-				Fifth pass: Particle rendering
+				Surface spawning
 			*/
-			{
-				// Clear particle render target to all zero, so that we know
-				// which pixel renders a particle.
-				std::vector<VkClearValue> clearValues(1);
-				clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+			addTimestampPass(renderGraph, "compute timing begin", VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_PARTICLE_COMPUTE_BEGIN);
+			addSurfaceEmitPass();
 
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = offscreenFrameBuffers.particle.renderPass;
-				renderPassBeginInfo.framebuffer = offscreenFrameBuffers.particle.frameBuffer;
-				renderPassBeginInfo.renderArea.extent.width = offscreenFrameBuffers.particle.width;
-				renderPassBeginInfo.renderArea.extent.height = offscreenFrameBuffers.particle.height;
-				renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-				renderPassBeginInfo.pClearValues = clearValues.data();
+			/*
+				Third and fourth pass: Calculate command on GPU and particle generation
+			*/
+			addGpuCommandPass(renderGraph, graphResources);
+			vks::RenderGraph::Pass simulation = addParticleSimulationPass(renderGraph, graphResources);
+			if (particleCollision.available) {
+				// The particles collide with the depth only pass
+				renderGraph.read(simulation, graphResources.depth, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			}
+			addTimestampPass(renderGraph, "compute timing end", VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_PARTICLE_COMPUTE_END);
+		}
 
-				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		/*
+			Fifth pass: Particle rendering
+		*/
+		addTimestampPass(renderGraph, "render timing begin", VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_PARTICLE_RENDER_BEGIN);
+		if (particleRaster.available) {
+			addSpriteCommandPass();
+		}
+		vks::RenderGraph::Pass particles = renderGraph.addPass("particles", [this](VkCommandBuffer commandBuffer, uint32_t) { recordParticlePass(commandBuffer); });
+		declareParticleAccesses(particles);
+		if (dynamicRendering) {
+			renderGraph.write(particles, graphResources.particleColor, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		} else {
+			renderGraph.setSideEffect(particles);
+			if (particleColorTracked) {
+				// The render pass leaves the particle color in the shader read only layout, visible to the composition
+				renderGraph.setLayoutAfter(particles, graphResources.particleColor, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+					VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, sampledAccess);
+			}
+		}
+		if (blendedParticles || particleRaster.available) {
+			// Sampled by particle_blend.frag or particle_sprite.frag
+			renderGraph.read(particles, graphResources.depth, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		}
+		particleRaster.pointsPass = particles;
+		if (particleRaster.available) {
+			addParticleRasterPasses();
+		}
+		addTimestampPass(renderGraph, "render timing end", VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_PARTICLE_RENDER_END);
+
+		/*
+			Final pass: Composition
+		*/
+		vks::RenderGraph::Pass composition = renderGraph.addPass("composition", [this](VkCommandBuffer commandBuffer, uint32_t i) { recordCompositionPass(commandBuffer, i); });
+		// Writes the swap chain image, which is not part of the graph
+		renderGraph.setSideEffect(composition);
+		if (dynamicRendering)
+		{
+			// The composition render pass loads depth from the shader read only layout and leaves it in the attachment layout
+			renderGraph.read(composition, graphResources.sceneColor, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			renderGraph.read(composition, graphResources.particleColor, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			renderGraph.read(composition, graphResources.depth, depthTests, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			renderGraph.setLayoutAfter(composition, graphResources.depth, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, depthTests, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR);
+		}
+		else
+		{
+			// The composition render pass moves depth back to the attachment layout
+			if (particleColorTracked) {
+				renderGraph.read(composition, graphResources.particleColor, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			}
+			renderGraph.setLayoutAfter(composition, graphResources.depth, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, depthTests, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR);
+		}
 
-				VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		if (asyncCompute.enabled)
+		{
+			// Hand the particle buffer back to the simulation of the next frame
+			addParticleOwnershipPass(renderGraph, "release particles", particleStages, 0, 0, graphicsQueueFamily, computeQueueFamily);
+		}
+	}
 
-				VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	// Single render pass with one subpass per stage
+	// The particle simulation can't run between the scene and the particle subpass, so it runs ahead of
+	// the render pass on the spawn candidates of the previous frame (one frame of latency)
+	void setupMergedPassGraph()
+	{
+		addTimestampPass(renderGraph, "compute timing begin", VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_PARTICLE_COMPUTE_BEGIN);
+		addGpuCommandPass(renderGraph, graphResources);
+		addParticleSimulationPass(renderGraph, graphResources);
+
+		/*
+			Surface spawning, consumed by the next frame
+		*/
+		addSurfaceEmitPass();
+		addTimestampPass(renderGraph, "compute timing end", VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_PARTICLE_COMPUTE_END);
+
+		/*
+			Merged render pass
+		*/
+		vks::RenderGraph::Pass merged = renderGraph.addPass("merged render pass", [this](VkCommandBuffer commandBuffer, uint32_t i) { recordMergedRenderPass(commandBuffer, i); });
+		// The attachments are synchronized by the subpass dependencies, the swap chain image is not part of the graph
+		renderGraph.setSideEffect(merged);
+		declareSceneAccesses(merged);
+		declareParticleAccesses(merged);
+	}
 
-				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.particle, 0, 1, &descriptorSets.particle, 0, NULL);
+	// The particle simulation on the compute queue, recorded into a single command buffer
+	void setupComputeGraph()
+	{
+		const uint32_t graphicsQueueFamily = vulkanDevice->queueFamilyIndices.graphics;
+		const uint32_t computeQueueFamily = vulkanDevice->queueFamilyIndices.compute;
+		vks::RenderGraph& graph = asyncCompute.graph;
+
+		graph.setDevice(vulkanDevice, vkCmdPipelineBarrier2KHR);
+		importBuffers(graph, asyncCompute.graphResources);
+
+		addTimestampPass(graph, "compute timing begin", VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_PARTICLE_COMPUTE_BEGIN);
+		addParticleOwnershipPass(graph, "acquire particles", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, VK_ACCESS_SHADER_WRITE_BIT, graphicsQueueFamily, computeQueueFamily);
+		addGpuCommandPass(graph, asyncCompute.graphResources);
+		addParticleSimulationPass(graph, asyncCompute.graphResources);
+		addParticleOwnershipPass(graph, "release particles", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, 0, computeQueueFamily, graphicsQueueFamily);
+		addTimestampPass(graph, "compute timing end", VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_PARTICLE_COMPUTE_END);
+	}
 
-				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.particle);
+	void importBuffers(vks::RenderGraph& graph, GraphResources& resources)
+	{
+		resources.gpucmd = graph.importBuffer("gpucmd", resourceBuffers.gpucmd.buffer);
+		resources.append = graph.importBuffer("append", resourceBuffers.append.buffer);
+		resources.spawn = graph.importBuffer("spawn", resourceBuffers.spawn.buffer);
+		resources.particle = graph.importBuffer("particle", resourceBuffers.particle.buffer);
+		resources.global = graph.importBuffer("global", resourceBuffers.global.buffer);
+		resources.stats = graph.importBuffer("stats", resourceBuffers.stats.buffer);
+	}
 
-				VkDeviceSize offsets[1] = { 0 };
-				vkCmdBindVertexBuffers(commandBuffer, PARTICLE_VERTEX_BUFFER_BIND_ID, 1, &resourceBuffers.particle.buffer, offsets);
-				vkCmdDrawIndirect(commandBuffer, resourceBuffers.gpucmd.buffer, offsetof(GpuCmdBuffer, drawCmd), 1, 0);
-				vkCmdEndRenderPass(commandBuffer);
+	// Describe the frame as a render graph, the barriers outside of render passes are derived from the declared accesses
+	void setupRenderGraph()
+	{
+		renderGraph.setDevice(vulkanDevice, vkCmdPipelineBarrier2KHR);
+		importBuffers(renderGraph, graphResources);
+		// The depth buffer is recreated on resize, its handle is updated before the command buffers are built
+		graphResources.depth = renderGraph.importImage("depth", depthStencil.image, depthAspectMask());
+		if (particleRaster.available)
+		{
+			graphResources.tileCounts = renderGraph.importBuffer("tile counts", particleRaster.tileCounts.buffer);
+			graphResources.tileOffsets = renderGraph.importBuffer("tile offsets", particleRaster.tileOffsets.buffer);
+			graphResources.rasterEntries = renderGraph.importBuffer("raster entries", particleRaster.entries.buffer);
+			graphResources.spriteCmd = renderGraph.importBuffer("sprite cmd", particleSprites.commands.buffer);
+		}
+		if (dynamicRendering)
+		{
+			// Only live within a frame, so the graph creates them and may place them in shared memory
+			const vks::RenderGraph::ImageDesc colorDesc = { VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT };
+			// The compute rasterizer writes the particle color as a storage image
+			vks::RenderGraph::ImageDesc particleColorDesc = colorDesc;
+			particleColorDesc.format = particleColorFormat();
+			if (particleRaster.available) {
+				particleColorDesc.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
 			}
+			graphResources.sceneColor = renderGraph.createImage("scene color", colorDesc);
+			graphResources.particleColor = renderGraph.createImage("particle color", particleColorDesc);
+		}
+		else if (particleRaster.available && !mergedRenderPass)
+		{
+			// Written by the particle render pass and the compute rasterizer, which need the transitions between them
+			// Recreated on resize, its handle is updated before the command buffers are built
+			graphResources.particleColor = renderGraph.importImage("particle color", offscreenFrameBuffers.particle.color.image, VK_IMAGE_ASPECT_COLOR_BIT);
+		}
 
-			/*
-				Note: Explicit synchronization is not required between the render pass,
-				as we are using previous attachments as inputs, and barriers is done implicit via sub pass dependencies
-			*/
+		if (mergedRenderPass)
+		{
+			setupMergedPassGraph();
+		}
+		else
+		{
+			setupSeparatePassGraph();
+		}
+		renderGraph.setEnabled(surfaceEmitPass, surfaceSpawn.source == SPAWN_SOURCE_SURFACE);
+		enableParticleRasterPasses();
 
-			/*
-				Final pass: Composition
-			*/
-			{
-				std::vector<VkClearValue> clearValues(2);
-				clearValues[0].color = defaultClearColor;
-				clearValues[1].depthStencil = { 1.0f, 0 };
+		if (asyncCompute.enabled)
+		{
+			setupComputeGraph();
+		}
+	}
 
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = renderPass;
-				renderPassBeginInfo.framebuffer = VulkanExampleBase::frameBuffers[i];
-				renderPassBeginInfo.renderArea.extent.width = width;
-				renderPassBeginInfo.renderArea.extent.height = height;
-				renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-				renderPassBeginInfo.pClearValues = clearValues.data();
+	void buildCommandBuffers()
+	{
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
-				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		renderGraph.setImportedImage(graphResources.depth, depthStencil.image);
+		if (particleRaster.available && !dynamicRendering && !mergedRenderPass) {
+			renderGraph.setImportedImage(graphResources.particleColor, offscreenFrameBuffers.particle.color.image);
+		}
+		// Culls the surface emit pass with screen spawning, the transient images don't depend on it and are kept
+		renderGraph.setEnabled(surfaceEmitPass, surfaceSpawn.source == SPAWN_SOURCE_SURFACE);
+		// Switching the particle rasterizer changes the lifetime of the particle color, which may recreate the transient images
+		enableParticleRasterPasses();
+		renderGraph.compile(width, height);
+		if (dynamicRendering && (renderGraph.getImageView(graphResources.sceneColor) != offscreenFrameBuffers.scene.color.view ||
+			renderGraph.getImageView(graphResources.particleColor) != offscreenFrameBuffers.particle.color.view))
+		{
+			offscreenFrameBuffers.scene.color.image = renderGraph.getImage(graphResources.sceneColor);
+			offscreenFrameBuffers.scene.color.view = renderGraph.getImageView(graphResources.sceneColor);
+			offscreenFrameBuffers.particle.color.image = renderGraph.getImage(graphResources.particleColor);
+			offscreenFrameBuffers.particle.color.view = renderGraph.getImageView(graphResources.particleColor);
+			updateAttachmentDescriptors();
+		}
 
-				VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		// The second part of the frame with async compute, allocated from the graphics command pool
+		if (asyncCompute.enabled && asyncCompute.particleCommandBuffers.size() != drawCmdBuffers.size())
+		{
+			if (!asyncCompute.particleCommandBuffers.empty()) {
+				vkFreeCommandBuffers(device, cmdPool, static_cast<uint32_t>(asyncCompute.particleCommandBuffers.size()), asyncCompute.particleCommandBuffers.data());
+			}
+			asyncCompute.particleCommandBuffers.resize(drawCmdBuffers.size());
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, static_cast<uint32_t>(drawCmdBuffers.size()));
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, asyncCompute.particleCommandBuffers.data()));
+		}
 
-				VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+		// Each frame's barriers depend on the accesses of the frame before. Until one frame has been recorded
+		// these are unknown, so the first command buffer is recorded twice to get the barriers of a steady state frame.
+		// The same applies after switching the particle rasterizer, as the last recorded frame had the other passes.
+		const bool rasterSwitched = particleRaster.mode != particleRaster.recordedMode;
+		particleRaster.recordedMode = particleRaster.mode;
+		const int32_t firstFrame = (renderGraph.frameStateKnown() && !rasterSwitched) ? 0 : -1;
+		for (int32_t frame = firstFrame; frame < static_cast<int32_t>(drawCmdBuffers.size()); ++frame)
+		{
+			const int32_t i = std::max(frame, 0);
+			std::vector<VkCommandBuffer> commandBuffers = { drawCmdBuffers[i] };
+			if (asyncCompute.enabled) {
+				commandBuffers.push_back(asyncCompute.particleCommandBuffers[i]);
+			}
 
-				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.composition, 0, 1, &descriptorSets.composition, 0, NULL);
+			for (auto commandBuffer : commandBuffers) {
+				VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+			}
 
-				// Final composition pass
-				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.composition);
-				vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+			if (gpuTimings.supported) {
+				if (asyncCompute.enabled) {
+					// The compute timestamps are reset and written by the compute queue
+					vkCmdResetQueryPool(commandBuffers.front(), gpuTimings.queryPool, TIMESTAMP_FRAME_BEGIN, 2);
+					vkCmdResetQueryPool(commandBuffers.front(), gpuTimings.queryPool, TIMESTAMP_PARTICLE_RENDER_BEGIN, 2);
+				} else {
+					vkCmdResetQueryPool(commandBuffers.front(), gpuTimings.queryPool, 0, TIMESTAMP_COUNT);
+				}
+				vkCmdWriteTimestamp(commandBuffers.front(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, gpuTimings.queryPool, TIMESTAMP_FRAME_BEGIN);
+			}
 
-				drawUI(commandBuffer);
+			renderGraph.execute(commandBuffers, static_cast<uint32_t>(i));
 
-				vkCmdEndRenderPass(commandBuffer);
+			if (gpuTimings.supported) {
+				vkCmdWriteTimestamp(commandBuffers.back(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, gpuTimings.queryPool, TIMESTAMP_FRAME_END);
 			}
 
+			for (auto commandBuffer : commandBuffers) {
+				VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+			}
+		}
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+		if (asyncCompute.enabled)
+		{
+			buildComputeCommandBuffer();
+		}
+	}
+
+	// The simulation is the same for every frame, so there is a single compute command buffer
+	void buildComputeCommandBuffer()
+	{
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+
+		asyncCompute.graph.compile(width, height);
+
+		// Recorded twice on the first build for the barriers of a steady state frame, see buildCommandBuffers
+		const uint32_t recordCount = asyncCompute.graph.frameStateKnown() ? 1 : 2;
+		for (uint32_t record = 0; record < recordCount; record++)
+		{
+			VK_CHECK_RESULT(vkBeginCommandBuffer(asyncCompute.commandBuffer, &cmdBufInfo));
+			if (gpuTimings.supported) {
+				vkCmdResetQueryPool(asyncCompute.commandBuffer, gpuTimings.queryPool, TIMESTAMP_PARTICLE_COMPUTE_BEGIN, 2);
+			}
+			asyncCompute.graph.execute(asyncCompute.commandBuffer, 0);
+			VK_CHECK_RESULT(vkEndCommandBuffer(asyncCompute.commandBuffer));
 		}
 	}
 
@@ -943,9 +2581,11 @@ public:
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes = {
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 16),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 16),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 40),
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 16),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 2),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1)
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, descriptorSets.count);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
@@ -961,13 +2601,15 @@ public:
 				// Binding 1 : Shader view data uniform buffer
 				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 1),
 				// Binding 2 : Instance data
-				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 2),
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 2),
 				// Binding 3 : material texture
 				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),
 				// Binding 4 : Append buffer
 				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 4),
 				// Binding 5 : Dispatch buffer
-				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 5)
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 5),
+				// Binding 6 : Particle system uniform buffer
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 6)
 			};
 
 			VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
@@ -980,14 +2622,28 @@ public:
 
 		// Particle pass
 		{
+			// The sprites may be expanded by a mesh shader
+			const VkShaderStageFlags geometryStages = VK_SHADER_STAGE_VERTEX_BIT | (particleSprites.meshShader ? VK_SHADER_STAGE_MESH_BIT_EXT : 0);
 			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
 				// Binding 0 : Shader model data uniform buffer
 				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0),
 				// Binding 1 : Shader view data uniform buffer
-				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, geometryStages | VK_SHADER_STAGE_FRAGMENT_BIT, 1),
 				// Binding 2 : Particle system uniform buffer
 				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 2)
 			};
+			if (blendedParticles || particleRaster.available) {
+				// Binding 3 : Depth of the depth only pass, written with the attachments
+				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_SHADER_STAGE_FRAGMENT_BIT, 3));
+			}
+			if (particleRaster.available) {
+				// Binding 4 : Particle buffer
+				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, geometryStages, 4));
+				// Binding 5 : Sprite texture
+				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 5));
+				// Binding 6 : Sprite draw commands
+				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, geometryStages, 6));
+			}
 
 			VkDescriptorSetLayoutCreateInfo descriptorLayout =
 				vks::initializers::descriptorSetLayoutCreateInfo(
@@ -1005,9 +2661,9 @@ public:
 		{
 			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
 				// Binding 0 : Scene color buffer
-				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),
+				vks::initializers::descriptorSetLayoutBinding(compositionDescriptorType(), VK_SHADER_STAGE_FRAGMENT_BIT, 0),
 				// Binding 1 : Particle color buffer
-				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+				vks::initializers::descriptorSetLayoutBinding(compositionDescriptorType(), VK_SHADER_STAGE_FRAGMENT_BIT, 1),
 			};
 
 			VkDescriptorSetLayoutCreateInfo descriptorLayout =
@@ -1029,6 +2685,10 @@ public:
 				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
 				// Binding 1 : Global data
 				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+				// Binding 2 : Particle system uniform buffer
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+				// Binding 3 : Per-frame statistics
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
 			};
 
 			VkDescriptorSetLayoutCreateInfo descriptorLayout =
@@ -1043,6 +2703,33 @@ public:
 			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.gpuCmd));
 		}
 
+		// Surface emit pass
+		{
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+				// Binding 0 : Particle system uniform buffer
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+				// Binding 1 : Instance data
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+				// Binding 2 : Surface points
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+				// Binding 3 : Append buffer
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+				// Binding 4 : GPU command
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+			};
+
+			VkDescriptorSetLayoutCreateInfo descriptorLayout =
+				vks::initializers::descriptorSetLayoutCreateInfo(
+					setLayoutBindings.data(),
+					static_cast<uint32_t>(setLayoutBindings.size()));
+
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayouts.emit));
+
+			VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo =
+				vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.emit, 1);
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.emit));
+		}
+
 		// Compute pass
 		{
 			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
@@ -1062,11 +2749,13 @@ public:
 				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 6),
 				// Binding 7 : GPU indirect command
 				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 7),
-				// Binding 8 : Depth buffer
-				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 8),
-				// Binding 9 : Color texture
+				// Binding 9 : Turbulence field
 				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 9),
 			};
+			if (particleCollision.available) {
+				// Binding 8 : Depth of the depth only pass, written with the attachments
+				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 8));
+			}
 
 			VkDescriptorSetLayoutCreateInfo descriptorLayout =
 				vks::initializers::descriptorSetLayoutCreateInfo(
@@ -1079,6 +2768,42 @@ public:
 				vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.compute, 1);
 			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.compute));
 		}
+
+		// Compute rasterizer passes
+		if (particleRaster.available)
+		{
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+				// Binding 0 : Shader view data uniform buffer
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+				// Binding 1 : Depth of the depth only pass
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+				// Binding 2 : Particle buffer
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+				// Binding 3 : GPU indirect command
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+				// Binding 4 : Tile counts
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+				// Binding 5 : Tile offsets
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
+				// Binding 6 : Raster entries
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 6),
+				// Binding 7 : Particle color buffer
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 7),
+				// Binding 8 : Sprite draw commands
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 8),
+			};
+
+			VkDescriptorSetLayoutCreateInfo descriptorLayout =
+				vks::initializers::descriptorSetLayoutCreateInfo(
+					setLayoutBindings.data(),
+					static_cast<uint32_t>(setLayoutBindings.size()));
+
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &particleRaster.descriptorSetLayout));
+
+			VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo =
+				vks::initializers::pipelineLayoutCreateInfo(&particleRaster.descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &particleRaster.pipelineLayout));
+		}
 	}
 
 	void setupDescriptorSet()
@@ -1097,13 +2822,15 @@ public:
 				// Binding 1: Shader view data uniform buffer
 				vks::initializers::writeDescriptorSet(descriptorSets.scene, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &uniformBuffers.viewData.descriptor),
 				// Binding 2: Shader instance buffer
-				vks::initializers::writeDescriptorSet(descriptorSets.scene, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &uniformBuffers.instancing.descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSets.scene, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &resourceBuffers.instances.descriptor),
 				// Binding 3 : Material texture
 				vks::initializers::writeDescriptorSet(descriptorSets.scene, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &particlespawn.descriptor),
 				// Binding 4 : Append buffer
 				vks::initializers::writeDescriptorSet(descriptorSets.scene, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &resourceBuffers.append.descriptor),
 				// Binding 5 : Dispatch buffer
-				vks::initializers::writeDescriptorSet(descriptorSets.scene, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &resourceBuffers.gpucmd.descriptor)
+				vks::initializers::writeDescriptorSet(descriptorSets.scene, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &resourceBuffers.gpucmd.descriptor),
+				// Binding 6 : Particle system
+				vks::initializers::writeDescriptorSet(descriptorSets.scene, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 6, &uniformBuffers.particleSystem.descriptor)
 			};
 			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 		}
@@ -1131,19 +2858,7 @@ public:
 			std::vector<VkWriteDescriptorSet> writeDescriptorSets;
 			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.composition, 1);
 			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.composition));
-			std::vector<VkDescriptorImageInfo> imageDescriptors =
-			{
-				vks::initializers::descriptorImageInfo(sampler, offscreenFrameBuffers.scene.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-				vks::initializers::descriptorImageInfo(sampler, offscreenFrameBuffers.particle.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			};
-			writeDescriptorSets =
-			{
-				// Binding 0: Scene color buffer
-				vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),
-				// Binding 1: Particle color buffer
-				vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),
-			};
-			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+			// The attachments are written by updateAttachmentDescriptors, as they are recreated on resize
 		}
 
 		// Gpu command calculate pass
@@ -1156,7 +2871,32 @@ public:
 				// Binding 0 : GPU command
 				vks::initializers::writeDescriptorSet(descriptorSets.gpuCmd, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &resourceBuffers.gpucmd.descriptor),
 				// Binding 1 : Global data
-				vks::initializers::writeDescriptorSet(descriptorSets.gpuCmd, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &resourceBuffers.global.descriptor)
+				vks::initializers::writeDescriptorSet(descriptorSets.gpuCmd, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &resourceBuffers.global.descriptor),
+				// Binding 2 : Particle system
+				vks::initializers::writeDescriptorSet(descriptorSets.gpuCmd, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &uniformBuffers.particleSystem.descriptor),
+				// Binding 3 : Per-frame statistics
+				vks::initializers::writeDescriptorSet(descriptorSets.gpuCmd, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &resourceBuffers.stats.descriptor)
+			};
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
+		}
+
+		// Surface emit pass
+		{
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.emit, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.emit));
+
+			std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
+			{
+				// Binding 0 : Particle system
+				vks::initializers::writeDescriptorSet(descriptorSets.emit, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.particleSystem.descriptor),
+				// Binding 1 : Instance data
+				vks::initializers::writeDescriptorSet(descriptorSets.emit, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &resourceBuffers.instances.descriptor),
+				// Binding 2 : Surface points
+				vks::initializers::writeDescriptorSet(descriptorSets.emit, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &resourceBuffers.surfacePoints.descriptor),
+				// Binding 3 : Append buffer
+				vks::initializers::writeDescriptorSet(descriptorSets.emit, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &resourceBuffers.append.descriptor),
+				// Binding 4 : GPU command
+				vks::initializers::writeDescriptorSet(descriptorSets.emit, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &resourceBuffers.gpucmd.descriptor)
 			};
 			vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
 		}
@@ -1165,11 +2905,6 @@ public:
 		{
 			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.compute,1);
 			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.compute));
-			std::vector<VkDescriptorImageInfo> imageDescriptors =
-			{
-				vks::initializers::descriptorImageInfo(sampler, depthStencil.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-				vks::initializers::descriptorImageInfo(sampler, particlespawn.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			};
 			std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
 			{
 				// Binding 0: Shader model data uniform buffer
@@ -1188,13 +2923,46 @@ public:
 				vks::initializers::writeDescriptorSet(descriptorSets.compute, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &resourceBuffers.global.descriptor),
 				// Binding 7 : GPU indirect command
 				vks::initializers::writeDescriptorSet(descriptorSets.compute, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7, &resourceBuffers.gpucmd.descriptor),
-				// Binding 8 : Depth buffer
-				vks::initializers::writeDescriptorSet(descriptorSets.compute, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 8, &imageDescriptors[0]),
-				// Binding 9 : Color texture
-				vks::initializers::writeDescriptorSet(descriptorSets.compute, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9, &imageDescriptors[1]),
+				// Binding 9 : Turbulence field
+				vks::initializers::writeDescriptorSet(descriptorSets.compute, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9, &turbulence.texture.descriptor),
 			};
 			vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
 		}
+
+		// Compute rasterizer passes
+		if (particleRaster.available)
+		{
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &particleRaster.descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &particleRaster.descriptorSet));
+			std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
+			{
+				// Binding 0 : Shader view data uniform buffer
+				vks::initializers::writeDescriptorSet(particleRaster.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.viewData.descriptor),
+				// Binding 2 : Particle buffer
+				vks::initializers::writeDescriptorSet(particleRaster.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &resourceBuffers.particle.descriptor),
+				// Binding 3 : GPU indirect command
+				vks::initializers::writeDescriptorSet(particleRaster.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &resourceBuffers.gpucmd.descriptor),
+				// Binding 4 : Tile counts
+				vks::initializers::writeDescriptorSet(particleRaster.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &particleRaster.tileCounts.descriptor),
+				// Binding 5 : Tile offsets
+				vks::initializers::writeDescriptorSet(particleRaster.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &particleRaster.tileOffsets.descriptor),
+				// Binding 6 : Raster entries
+				vks::initializers::writeDescriptorSet(particleRaster.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &particleRaster.entries.descriptor),
+				// Binding 8 : Sprite draw commands
+				vks::initializers::writeDescriptorSet(particleRaster.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8, &particleSprites.commands.descriptor),
+				// Particle pass
+				// Binding 4 : Particle buffer
+				vks::initializers::writeDescriptorSet(descriptorSets.particle, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &resourceBuffers.particle.descriptor),
+				// Binding 5 : Sprite texture
+				vks::initializers::writeDescriptorSet(descriptorSets.particle, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5, &particleSprites.texture.descriptor),
+				// Binding 6 : Sprite draw commands
+				vks::initializers::writeDescriptorSet(descriptorSets.particle, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &particleSprites.commands.descriptor),
+			};
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
+		}
+
+		// The attachments of the composition and the compute rasterizer
+		updateAttachmentDescriptors();
 	}
 
 	void prepareGraphicsPipelines()
@@ -1211,6 +2979,25 @@ public:
 		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
 
 		VkGraphicsPipelineCreateInfo pipelineCreateInfo = vks::initializers::pipelineCreateInfo(pipelineLayouts.scene, renderPass, 0);
+
+		// With dynamic rendering the offscreen pipelines are created for the attachment formats instead of a render pass
+		const VkFormat sceneColorFormat = offscreenFrameBuffers.scene.color.format;
+		const VkFormat particleColorFormat = offscreenFrameBuffers.particle.color.format;
+		VkPipelineRenderingCreateInfoKHR pipelineRenderingCreateInfo{};
+		pipelineRenderingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+		auto setOffscreenTarget = [&](VkRenderPass offscreenRenderPass, uint32_t subpass, const VkFormat* colorAttachmentFormat, VkFormat depthAttachmentFormat) {
+			if (dynamicRendering) {
+				pipelineRenderingCreateInfo.colorAttachmentCount = colorAttachmentFormat ? 1 : 0;
+				pipelineRenderingCreateInfo.pColorAttachmentFormats = colorAttachmentFormat;
+				pipelineRenderingCreateInfo.depthAttachmentFormat = depthAttachmentFormat;
+				pipelineCreateInfo.pNext = &pipelineRenderingCreateInfo;
+				pipelineCreateInfo.renderPass = VK_NULL_HANDLE;
+				pipelineCreateInfo.subpass = 0;
+			} else {
+				pipelineCreateInfo.renderPass = mergedRenderPass ? renderPass : offscreenRenderPass;
+				pipelineCreateInfo.subpass = mergedRenderPass ? subpass : 0;
+			}
+		};
 		pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
 		pipelineCreateInfo.pRasterizationState = &rasterizationState;
 		pipelineCreateInfo.pColorBlendState = &colorBlendState;
@@ -1230,13 +3017,41 @@ public:
 
 			// Vertex input state from glTF model loader
 			pipelineCreateInfo.pVertexInputState = &vertexState.inputState;
-			pipelineCreateInfo.renderPass = offscreenFrameBuffers.particle.renderPass;
+			setOffscreenTarget(offscreenFrameBuffers.particle.renderPass, SUBPASS_PARTICLE, &particleColorFormat, VK_FORMAT_UNDEFINED);
 			pipelineCreateInfo.layout = pipelineLayouts.particle;
 			rasterizationState.cullMode = VK_CULL_MODE_NONE;
-			// Final composition pipeline
-			shaderStages[0] = loadShader(getShadersPath() + "meshparticles/particle.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-			shaderStages[1] = loadShader(getShadersPath() + "meshparticles/particle.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+
+			// Blended particles add the weighted gray and weight to red and green and multiply alpha by the transmittance
+			VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
+			blendAttachmentState.blendEnable = VK_TRUE;
+			blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+			blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+			blendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+			blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+			blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+			blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
+			VkPipelineColorBlendStateCreateInfo blendedColorBlendState = vks::initializers::pipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
+			pipelineCreateInfo.pColorBlendState = blendedParticles ? &blendedColorBlendState : &colorBlendState;
+
+			shaderStages[0] = loadShader(shaderFile("particle.vert"), VK_SHADER_STAGE_VERTEX_BIT);
+			shaderStages[1] = loadShader(shaderFile(blendedParticles ? "particle_blend.frag" : "particle.frag"), VK_SHADER_STAGE_FRAGMENT_BIT);
 			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.particle));
+			pipelineCreateInfo.pColorBlendState = &colorBlendState;
+		}
+
+		// Particle sprite pipeline, the particles are read from the storage buffer
+		if (particleRaster.available)
+		{
+			inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+			VkPipelineVertexInputStateCreateInfo emptyVertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
+			pipelineCreateInfo.pVertexInputState = &emptyVertexInputState;
+			if (particleSprites.meshShader) {
+				shaderStages[0] = loadShader(shaderFile("particle_sprite.mesh"), VK_SHADER_STAGE_MESH_BIT_EXT);
+			} else {
+				shaderStages[0] = loadShader(shaderFile("particle_sprite.vert"), VK_SHADER_STAGE_VERTEX_BIT);
+			}
+			shaderStages[1] = loadShader(shaderFile("particle_sprite.frag"), VK_SHADER_STAGE_FRAGMENT_BIT);
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &particleSprites.pipeline));
 		}
 
 		// Scene pipeline
@@ -1252,12 +3067,12 @@ public:
 			// Vertex input state from glTF model loader
 			pipelineCreateInfo.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState(
 				{ vkglTF::VertexComponent::Position, vkglTF::VertexComponent::UV, vkglTF::VertexComponent::Color, vkglTF::VertexComponent::Normal });
-			pipelineCreateInfo.renderPass = offscreenFrameBuffers.scene.renderPass;
+			setOffscreenTarget(offscreenFrameBuffers.scene.renderPass, SUBPASS_SCENE, &sceneColorFormat, depthFormat);
 			pipelineCreateInfo.layout = pipelineLayouts.scene;
 			rasterizationState.cullMode = VK_CULL_MODE_BACK_BIT;
 			// Final composition pipeline
-			shaderStages[0] = loadShader(getShadersPath() + "meshparticles/scene.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-			shaderStages[1] = loadShader(getShadersPath() + "meshparticles/scene.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+			shaderStages[0] = loadShader(shaderFile("scene.vert"), VK_SHADER_STAGE_VERTEX_BIT);
+			shaderStages[1] = loadShader(shaderFile("scene.frag"), VK_SHADER_STAGE_FRAGMENT_BIT);
 			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.scene));
 		}
 
@@ -1271,14 +3086,14 @@ public:
 			// Vertex input state from glTF model loader
 			pipelineCreateInfo.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState(
 				{ vkglTF::VertexComponent::Position, vkglTF::VertexComponent::UV, vkglTF::VertexComponent::Color, vkglTF::VertexComponent::Normal });
-			pipelineCreateInfo.renderPass = offscreenFrameBuffers.depthOnly.renderPass;
+			setOffscreenTarget(offscreenFrameBuffers.depthOnly.renderPass, SUBPASS_DEPTH_ONLY, nullptr, depthFormat);
 			pipelineCreateInfo.layout = pipelineLayouts.scene;
 
 			// We don't need color attachments
 			colorBlendState.attachmentCount = 0;
 			colorBlendState.pAttachments = nullptr;
 
-			shaderStages[1] = loadShader(getShadersPath() + "meshparticles/depth.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+			shaderStages[1] = loadShader(shaderFile("depth.frag"), VK_SHADER_STAGE_FRAGMENT_BIT);
 			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.depthOnly));
 		}
 
@@ -1305,41 +3120,101 @@ public:
 			VkPipelineVertexInputStateCreateInfo emptyVertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
 			pipelineCreateInfo.pVertexInputState = &emptyVertexInputState;
 			rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
+			// The composition always renders to the swap chain in the render pass of the example base
+			pipelineCreateInfo.pNext = nullptr;
 			pipelineCreateInfo.renderPass = renderPass;
+			pipelineCreateInfo.subpass = mergedRenderPass ? SUBPASS_COMPOSITION : 0;
 			pipelineCreateInfo.layout = pipelineLayouts.composition;
 
-			shaderStages[0] = loadShader(getShadersPath() + "meshparticles/fullscreen.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-			shaderStages[1] = loadShader(getShadersPath() + "meshparticles/composition.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+			shaderStages[0] = loadShader(shaderFile("fullscreen.vert"), VK_SHADER_STAGE_VERTEX_BIT);
+			shaderStages[1] = loadShader(shaderFile(mergedRenderPass ? "composition_input.frag" : "composition.frag"), VK_SHADER_STAGE_FRAGMENT_BIT);
+			// PARTICLE_BLENDED resolves the accumulated particles of particle_blend.frag
+			const VkBool32 particleBlended = blendedParticles;
+			VkSpecializationMapEntry specializationEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(VkBool32));
+			VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationEntry, sizeof(VkBool32), &particleBlended);
+			if (!mergedRenderPass) {
+				shaderStages[1].pSpecializationInfo = &specializationInfo;
+			}
 			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.composition));
 		}
 	}
 
+	// Device local buffer shared concurrently by the graphics and the compute queue family, see asyncCompute
+	void createSharedBuffer(VkBufferUsageFlags usageFlags, vks::Buffer* buffer, VkDeviceSize size)
+	{
+		const std::array<uint32_t, 2> queueFamilyIndices = { vulkanDevice->queueFamilyIndices.graphics, vulkanDevice->queueFamilyIndices.compute };
+		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(usageFlags, size);
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferCreateInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilyIndices.size());
+		bufferCreateInfo.pQueueFamilyIndices = queueFamilyIndices.data();
+		VK_CHECK_RESULT(vkCreateBuffer(device, &bufferCreateInfo, nullptr, &buffer->buffer));
+
+		VkMemoryRequirements memReqs;
+		vkGetBufferMemoryRequirements(device, buffer->buffer, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &buffer->memory));
+
+		buffer->device = device;
+		buffer->size = size;
+		buffer->alignment = memReqs.alignment;
+		buffer->usageFlags = usageFlags;
+		buffer->memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		buffer->setupDescriptor();
+		VK_CHECK_RESULT(buffer->bind());
+	}
+
 	void prepareResourceBuffers()
 	{
+		// The particle state is copied for the validation against the CPU reference and for dumps
+		const VkBufferUsageFlags readbackUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
 		// Dispatch buffer
+		const VkBufferUsageFlags gpucmdUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | readbackUsage;
+		if (asyncCompute.enabled) {
+			createSharedBuffer(gpucmdUsage, &resourceBuffers.gpucmd, sizeof(GpuCmdBuffer));
+		} else {
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(gpucmdUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &resourceBuffers.gpucmd, sizeof(GpuCmdBuffer)));
+		}
+
+		// The candidate slots start out empty and accept all candidates, the slot counts
+		// and the draw command are reset by gpu_cmd.comp from then on
+		GpuCmdBuffer initGpuCmd = {};
+		for (uint32_t slot = 0; slot < SPAWN_CANDIDATE_SLOTS; slot++) {
+			initGpuCmd.spawnProbability[slot] = 1.0f;
+		}
+		vks::Buffer gpuCmdStagingBuffer;
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&resourceBuffers.gpucmd,
-			sizeof(GpuCmdBuffer)));
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&gpuCmdStagingBuffer,
+			sizeof(initGpuCmd),
+			&initGpuCmd));
+		vulkanDevice->copyBuffer(&gpuCmdStagingBuffer, &resourceBuffers.gpucmd, queue);
+		gpuCmdStagingBuffer.destroy();
 
 		// Append buffer
-		VkDeviceSize appendBufferSize = width * height * sizeof(AppendJob);
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&resourceBuffers.append,
-			appendBufferSize));
+		// Appending stops at the spawn budget, so a slot only has to hold the largest budget
+		// instead of one job per pixel, and its size does not depend on the screen resolution
+		const uint32_t candidateSlots = asyncCompute.enabled ? SPAWN_CANDIDATE_SLOTS : 1;
+		VkDeviceSize appendBufferSize = candidateSlots * spawnBudget.maxBudget * sizeof(AppendJob);
+		if (asyncCompute.enabled) {
+			createSharedBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | readbackUsage, &resourceBuffers.append, appendBufferSize);
+		} else {
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | readbackUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &resourceBuffers.append, appendBufferSize));
+		}
 
 		// Global particle information
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | readbackUsage,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			&resourceBuffers.global,
 			sizeof(GlobalParticleData)));
 
 		vks::Buffer stagingBuffer;
-		GlobalParticleData initGlobal = {};
+		GlobalParticleData initGlobal;
+		initGlobal.particleCountMax = PARTICLE_COUNT_MAX;
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
 			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
@@ -1350,16 +3225,26 @@ public:
 		vulkanDevice->copyBuffer(&stagingBuffer, &resourceBuffers.global, queue);
 		stagingBuffer.destroy();
 
+		// Per-frame statistics, read by the host without staging
+		std::array<ParticleStats, PARTICLE_STATS_FRAMES> initStats{};
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&resourceBuffers.stats,
+			sizeof(initStats),
+			initStats.data()));
+		VK_CHECK_RESULT(resourceBuffers.stats.map());
+
 		// Particle buffer
 		VkDeviceSize particleBufferSize = PARTICLE_COUNT_MAX * sizeof(Particle);
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | readbackUsage,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			&resourceBuffers.spawn,
 			particleBufferSize));
 
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | readbackUsage,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			&resourceBuffers.particle,
 			particleBufferSize));
@@ -1390,12 +3275,191 @@ public:
 				VK_FORMAT_R32G32B32A32_SFLOAT,
 				offsetof(Particle, color));
 
-		// Assign to vertex buffer
-		vertexState.inputState = vks::initializers::pipelineVertexInputStateCreateInfo();
-		vertexState.inputState.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexState.bindingDescriptions.size());
-		vertexState.inputState.pVertexBindingDescriptions = vertexState.bindingDescriptions.data();
-		vertexState.inputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexState.attributeDescriptions.size());
-		vertexState.inputState.pVertexAttributeDescriptions = vertexState.attributeDescriptions.data();
+		// Assign to vertex buffer
+		vertexState.inputState = vks::initializers::pipelineVertexInputStateCreateInfo();
+		vertexState.inputState.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexState.bindingDescriptions.size());
+		vertexState.inputState.pVertexBindingDescriptions = vertexState.bindingDescriptions.data();
+		vertexState.inputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexState.attributeDescriptions.size());
+		vertexState.inputState.pVertexAttributeDescriptions = vertexState.attributeDescriptions.data();
+	}
+
+	// Buffers of the compute rasterizer, sized for the largest frame buffer so that they don't depend on the resolution
+	void prepareParticleRasterBuffers()
+	{
+		const uint32_t maxTiles = (deviceProperties.limits.maxImageDimension2D + PARTICLE_RASTER_TILE_SIZE - 1) / PARTICLE_RASTER_TILE_SIZE;
+		const VkDeviceSize tileBufferSize = (VkDeviceSize)maxTiles * maxTiles * sizeof(uint32_t);
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&particleRaster.tileCounts,
+			tileBufferSize));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&particleRaster.tileOffsets,
+			tileBufferSize));
+
+		// A particle covers at most 2x2 pixels, an entry is the packed value and the pixel within the tile (std430)
+		const VkDeviceSize entrySize = particleRaster.atomic64 ? 2 * sizeof(uint64_t) : 2 * sizeof(uint32_t);
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&particleRaster.entries,
+			PARTICLE_COUNT_MAX * 4 * entrySize));
+	}
+
+	// Sprite draw commands and the sprite shape, a disc with a soft edge in a small single channel texture
+	void prepareParticleSprites()
+	{
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&particleSprites.commands,
+			sizeof(SpriteCmdBuffer)));
+
+		const uint32_t size = 64;
+		std::vector<uint8_t> coverage(size * size);
+		for (uint32_t y = 0; y < size; y++) {
+			for (uint32_t x = 0; x < size; x++) {
+				const glm::vec2 position = (glm::vec2(x, y) + 0.5f) / (float)size * 2.0f - 1.0f;
+				const float value = glm::clamp((1.0f - glm::length(position)) * 2.0f, 0.0f, 1.0f);
+				coverage[y * size + x] = static_cast<uint8_t>(value * 255.0f + 0.5f);
+			}
+		}
+		particleSprites.texture.fromBuffer(coverage.data(), coverage.size(), VK_FORMAT_R8_UNORM, size, size, vulkanDevice, queue);
+
+		if (particleSprites.meshShader) {
+			particleSprites.vkCmdDrawMeshTasksIndirectEXT = reinterpret_cast<PFN_vkCmdDrawMeshTasksIndirectEXT>(vkGetDeviceProcAddr(device, "vkCmdDrawMeshTasksIndirectEXT"));
+		}
+	}
+
+	// Bake the turbulence field and upload it as a 3D texture, the CPU reference samples the same field
+	void prepareTurbulence()
+	{
+		turbulence.field = ParticleReference::bakeTurbulence(TURBULENCE_SIZE, TURBULENCE_PERIOD, TURBULENCE_SEED);
+		const std::vector<uint16_t>& texels = turbulence.field.halfs;
+		turbulence.texture.fromBuffer((void*)texels.data(), texels.size() * sizeof(uint16_t), VK_FORMAT_R16G16B16A16_SFLOAT,
+			TURBULENCE_SIZE, TURBULENCE_SIZE, TURBULENCE_SIZE, vulkanDevice, queue);
+	}
+
+	// Generate the surface point set for object space spawning
+	// Points are distributed over the mesh surface by triangle area and store the spawn texture value at their position
+	void prepareSurfacePoints()
+	{
+		// Read back the mesh, vertices are pre-transformed into model space by the glTF loader
+		const VkDeviceSize vertexBufferSize = sphere.vertices.count * sizeof(vkglTF::Vertex);
+		const VkDeviceSize indexBufferSize = sphere.indices.count * sizeof(uint32_t);
+		vks::Buffer vertexStaging, indexStaging;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&vertexStaging,
+			vertexBufferSize));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&indexStaging,
+			indexBufferSize));
+
+		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkBufferCopy copyRegion = { 0, 0, vertexBufferSize };
+		vkCmdCopyBuffer(copyCmd, sphere.vertices.buffer, vertexStaging.buffer, 1, &copyRegion);
+		copyRegion.size = indexBufferSize;
+		vkCmdCopyBuffer(copyCmd, sphere.indices.buffer, indexStaging.buffer, 1, &copyRegion);
+		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+
+		VK_CHECK_RESULT(vertexStaging.map());
+		VK_CHECK_RESULT(indexStaging.map());
+		const vkglTF::Vertex* vertices = static_cast<const vkglTF::Vertex*>(vertexStaging.mapped);
+		const uint32_t* indices = static_cast<const uint32_t*>(indexStaging.mapped);
+
+		// Base level of the spawn texture, which is sampled by scene.frag and depth.frag
+		ktxTexture* spawnTexture;
+		if (particlespawn.loadKTXFile(getAssetPath() + "textures/particlespawn.ktx", &spawnTexture) != KTX_SUCCESS) {
+			vks::tools::exitFatal("Could not load the particle spawn texture", -1);
+		}
+		ktx_size_t texelOffset;
+		ktxTexture_GetImageOffset(spawnTexture, 0, 0, 0, &texelOffset);
+		const uint8_t* texels = ktxTexture_GetData(spawnTexture) + texelOffset;
+		const int32_t texWidth = static_cast<int32_t>(spawnTexture->baseWidth);
+		const int32_t texHeight = static_cast<int32_t>(spawnTexture->baseHeight);
+
+		// Bilinear lookup of the red channel with repeat addressing, matching the texture sampler
+		auto sampleSpawnTexture = [&](glm::vec2 uv) -> float {
+			const float x = uv.x * texWidth - 0.5f;
+			const float y = uv.y * texHeight - 0.5f;
+			const float fx = floor(x);
+			const float fy = floor(y);
+			float value = 0.0f;
+			for (int32_t j = 0; j < 2; j++) {
+				for (int32_t i = 0; i < 2; i++) {
+					int32_t tx = (static_cast<int32_t>(fx) + i) % texWidth;
+					int32_t ty = (static_cast<int32_t>(fy) + j) % texHeight;
+					tx = tx < 0 ? tx + texWidth : tx;
+					ty = ty < 0 ? ty + texHeight : ty;
+					const float weight = (i ? x - fx : 1.0f - (x - fx)) * (j ? y - fy : 1.0f - (y - fy));
+					value += weight * texels[(ty * texWidth + tx) * 4] / 255.0f;
+				}
+			}
+			return value;
+		};
+
+		// Cumulative triangle areas, used to pick triangles proportional to their area
+		const uint32_t triangleCount = sphere.indices.count / 3;
+		std::vector<float> areaSums(triangleCount);
+		float totalArea = 0.0f;
+		for (uint32_t t = 0; t < triangleCount; t++)
+		{
+			const glm::vec3& p0 = vertices[indices[t * 3 + 0]].pos;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+			totalArea += 0.5f * glm::length(glm::cross(p1 - p0, p2 - p0));
+			areaSums[t] = totalArea;
+		}
+
+		std::vector<glm::vec4> points(surfaceSpawn.pointCount);
+		for (uint32_t i = 0; i < surfaceSpawn.pointCount; i++)
+		{
+			// Stratified selection of the triangle, uniformly distributed position within it
+			const float area = ((float)i + rnd(1.0f)) / (float)surfaceSpawn.pointCount * totalArea;
+			uint32_t t = static_cast<uint32_t>(std::upper_bound(areaSums.begin(), areaSums.end(), area) - areaSums.begin());
+			t = std::min(t, triangleCount - 1);
+
+			const float r0 = sqrt(rnd(1.0f));
+			const float r1 = rnd(1.0f);
+			const glm::vec3 barycentrics = glm::vec3(1.0f - r0, r0 * (1.0f - r1), r0 * r1);
+
+			const vkglTF::Vertex& v0 = vertices[indices[t * 3 + 0]];
+			const vkglTF::Vertex& v1 = vertices[indices[t * 3 + 1]];
+			const vkglTF::Vertex& v2 = vertices[indices[t * 3 + 2]];
+			const glm::vec3 pos = v0.pos * barycentrics.x + v1.pos * barycentrics.y + v2.pos * barycentrics.z;
+			const glm::vec2 uv = v0.uv * barycentrics.x + v1.uv * barycentrics.y + v2.uv * barycentrics.z;
+			points[i] = glm::vec4(pos, sampleSpawnTexture(uv));
+		}
+
+		// Sort by spawn texture value, so that emit.comp can find the points disappearing in a frame with a binary search
+		std::sort(points.begin(), points.end(), [](const glm::vec4& a, const glm::vec4& b) { return a.w < b.w; });
+
+		ktxTexture_Destroy(spawnTexture);
+		vertexStaging.destroy();
+		indexStaging.destroy();
+
+		// Upload to device local memory
+		const VkDeviceSize pointBufferSize = points.size() * sizeof(glm::vec4);
+		vks::Buffer stagingBuffer;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&stagingBuffer,
+			pointBufferSize,
+			points.data()));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&resourceBuffers.surfacePoints,
+			pointBufferSize));
+		vulkanDevice->copyBuffer(&stagingBuffer, &resourceBuffers.surfacePoints, queue);
+		stagingBuffer.destroy();
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
@@ -1426,38 +3490,755 @@ public:
 			&empty);
 
 		// Instance buffer
-		for (size_t i = 0; i != INSTANCE_COUNT; ++i)
+		// Sized at runtime and kept mapped, so that only changed instances are written
+		instances.resize(instanceCount);
+		instanceDirty.assign(instanceCount, true);
+		for (size_t i = 0; i != instanceCount; ++i)
 		{
-			uboInstanceData.transform[i] = glm::mat4(1.0);
+			instances[i].transform = glm::mat4(1.0);
 		}
+		resetDissolve();
 
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.instancing,
-			sizeof(uboInstanceData),
-			&uboInstanceData));
+			&resourceBuffers.instances,
+			instanceCount * sizeof(InstanceData),
+			instances.data()));
+		VK_CHECK_RESULT(resourceBuffers.instances.map());
 
 		// Update
 		updateUniformBufferModel();
 		updateUniformBufferView();
 	}
 
+	// Specialization map of KernelConstants, the constant ids of particle_constants.h
+	static std::array<VkSpecializationMapEntry, 4> kernelConstantEntries()
+	{
+		return {{
+			vks::initializers::specializationMapEntry(0, offsetof(KernelConstants, workgroupSize), sizeof(uint32_t)),
+			vks::initializers::specializationMapEntry(1, offsetof(KernelConstants, particleCountMax), sizeof(uint32_t)),
+			vks::initializers::specializationMapEntry(2, offsetof(KernelConstants, gravity), sizeof(float)),
+			vks::initializers::specializationMapEntry(3, offsetof(KernelConstants, lifetimeScale), sizeof(float))
+		}};
+	}
+
+	uint32_t maxParticleWorkgroupSize() const
+	{
+		return std::min(deviceProperties.limits.maxComputeWorkGroupSize[0], deviceProperties.limits.maxComputeWorkGroupInvocations);
+	}
+
+	// Zeroed if the device doesn't support Vulkan 1.1
+	VkPhysicalDeviceSubgroupProperties getSubgroupProperties()
+	{
+		VkPhysicalDeviceSubgroupProperties subgroupProperties{};
+		subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+		// VkPhysicalDeviceSubgroupProperties is core in Vulkan 1.1, VK_KHR_get_physical_device_properties2 is enabled for the feature chain
+		if (deviceProperties.apiVersion >= VK_API_VERSION_1_1) {
+			PFN_vkGetPhysicalDeviceProperties2KHR vkGetPhysicalDeviceProperties2KHR =
+				reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR"));
+			if (vkGetPhysicalDeviceProperties2KHR) {
+				VkPhysicalDeviceProperties2KHR deviceProperties2{};
+				deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+				deviceProperties2.pNext = &subgroupProperties;
+				vkGetPhysicalDeviceProperties2KHR(physicalDevice, &deviceProperties2);
+			}
+		}
+		return subgroupProperties;
+	}
+
+	// Work group size of particle.comp, from --workgroupsize or the subgroup size of the device
+	void selectParticleWorkgroupSize()
+	{
+		particleKernel.constants.particleCountMax = PARTICLE_COUNT_MAX;
+
+		particleKernel.subgroupSize = getSubgroupProperties().subgroupSize;
+
+		// Otherwise at least the 64 invocations the kernel was written for, and two subgroups per work group
+		// so that one of them can run while the other waits for the ring buffer
+		uint32_t size = particleKernel.requestedWorkgroupSize;
+		if (size == 0) {
+			size = std::max(64u, particleKernel.subgroupSize * 2);
+		}
+		size = std::min(size, maxParticleWorkgroupSize());
+		if (particleKernel.requestedWorkgroupSize > 0 && size != particleKernel.requestedWorkgroupSize) {
+			std::cout << "Work group size " << particleKernel.requestedWorkgroupSize << " exceeds the device limits, using " << size << "\n";
+		}
+		if (particleKernel.subgroupSize > 0 && size % particleKernel.subgroupSize != 0) {
+			std::cout << "Work group size " << size << " is not a multiple of the subgroup size " << particleKernel.subgroupSize << "\n";
+		}
+		particleKernel.constants.workgroupSize = size;
+	}
+
+	// Time particle.comp on a full ring buffer of live particles for each work group size of a sweep and keep the fastest
+	// The sweep runs on scratch buffers, so the particle state of the example is not touched
+	void autotuneParticleWorkgroupSize()
+	{
+		if (!gpuTimings.supported) {
+			std::cout << "Timestamps are not supported, the particle work group size is not autotuned\n";
+			return;
+		}
+
+		std::vector<uint32_t> sizes;
+		const uint32_t maxSize = std::min(maxParticleWorkgroupSize(), 1024u);
+		for (uint32_t size = std::max(32u, particleKernel.subgroupSize); size <= maxSize; size *= 2) {
+			sizes.push_back(size);
+		}
+		if (sizes.empty()) {
+			return;
+		}
+
+		// A zeroed ring buffer holds particles emitted at frame 0, which are all alive at frame 0,
+		// so every invocation animates its particle and appends it to the particle buffer
+		vks::Buffer uniform, append, spawn, particle, global, gpucmd;
+		const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniform, sizeof(ParticleSystem)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &append, sizeof(AppendJob)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &spawn, resourceBuffers.spawn.size));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &particle, resourceBuffers.particle.size));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &global, sizeof(GlobalParticleData)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &gpucmd, sizeof(GpuCmdBuffer)));
+
+		ParticleSystem system;
+		system.deltaT = 1.0f / 60.0f;
+		system.seed = 1;
+		system.wind = glm::vec3(1.0f, 0.5f, 0.0f);
+		VK_CHECK_RESULT(uniform.map());
+		uniform.copyTo(&system, sizeof(system));
+		uniform.unmap();
+
+		GlobalParticleData initGlobal;
+		initGlobal.particleCountMax = PARTICLE_COUNT_MAX;
+		initGlobal.renderCount = PARTICLE_COUNT_MAX;
+		initGlobal.cachedCount = PARTICLE_COUNT_MAX;
+
+		VkDescriptorPool scratchPool;
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &scratchPool));
+		VkDescriptorSet descriptorSet;
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(scratchPool, &descriptorSetLayouts.compute, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets =
+		{
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.modelData.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &uniformBuffers.viewData.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &uniform.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &append.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &spawn.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &particle.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &global.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7, &gpucmd.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9, &turbulence.texture.descriptor)
+		};
+		// The sweep runs without collisions, the depth is bound but not read
+		VkDescriptorImageInfo depthDescriptor = vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, sampledDepthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		if (particleCollision.available) {
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 8, &depthDescriptor));
+		}
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+		// The first run of each size is a warm-up, the fastest of the others counts
+		const uint32_t runs = 5;
+		VkQueryPool queryPool;
+		VkQueryPoolCreateInfo queryPoolInfo = {};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = runs * 2;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+
+		const VkPipelineShaderStageCreateInfo shaderStage = loadShader(shaderFile("particle.comp"), VK_SHADER_STAGE_COMPUTE_BIT);
+		const std::array<VkSpecializationMapEntry, 4> specializationMapEntries = kernelConstantEntries();
+		const double period = deviceProperties.limits.timestampPeriod / 1000000.0;
+
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		const VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+		particleKernel.sweep.clear();
+		std::cout << "Particle work group size autotune, " << PARTICLE_COUNT_MAX << " particles:\n";
+		for (uint32_t size : sizes) {
+			KernelConstants constants = particleKernel.constants;
+			constants.workgroupSize = size;
+			VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(static_cast<uint32_t>(specializationMapEntries.size()),
+				specializationMapEntries.data(), sizeof(constants), &constants);
+			VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayouts.compute, 0);
+			computePipelineCreateInfo.stage = shaderStage;
+			computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+			VkPipeline pipeline;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &pipeline));
+
+			VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vkCmdResetQueryPool(commandBuffer, queryPool, 0, runs * 2);
+			vkCmdFillBuffer(commandBuffer, spawn.buffer, 0, VK_WHOLE_SIZE, 0);
+			vkCmdFillBuffer(commandBuffer, gpucmd.buffer, 0, VK_WHOLE_SIZE, 0);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.compute, 0, 1, &descriptorSet, 0, nullptr);
+			for (uint32_t run = 0; run < runs; run++) {
+				// Each run compacts the particles from the start of the particle buffer again
+				vkCmdUpdateBuffer(commandBuffer, global.buffer, 0, sizeof(initGlobal), &initGlobal);
+				vkCmdPipelineBarrier(commandBuffer, stages, stages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, run * 2);
+				vkCmdDispatch(commandBuffer, (PARTICLE_COUNT_MAX + size - 1) / size, 1, 1);
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, run * 2 + 1);
+				vkCmdPipelineBarrier(commandBuffer, stages, stages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
+			vulkanDevice->flushCommandBuffer(commandBuffer, queue, true);
+			vkDestroyPipeline(device, pipeline, nullptr);
+
+			std::vector<uint64_t> timestamps(runs * 2);
+			VK_CHECK_RESULT(vkGetQueryPoolResults(device, queryPool, 0, runs * 2, sizeof(uint64_t) * timestamps.size(), timestamps.data(),
+				sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+			double time = std::numeric_limits<double>::max();
+			for (uint32_t run = 1; run < runs; run++) {
+				time = std::min(time, (double)(timestamps[run * 2 + 1] - timestamps[run * 2]) * period);
+			}
+			particleKernel.sweep.push_back(std::make_pair(size, (float)time));
+			std::cout << "  " << size << ": " << time << " ms\n";
+		}
+
+		auto fastest = std::min_element(particleKernel.sweep.begin(), particleKernel.sweep.end(),
+			[](const std::pair<uint32_t, float>& a, const std::pair<uint32_t, float>& b) { return a.second < b.second; });
+		particleKernel.constants.workgroupSize = fastest->first;
+		std::cout << "Using work group size " << fastest->first << "\n";
+
+		vkDestroyQueryPool(device, queryPool, nullptr);
+		vkDestroyDescriptorPool(device, scratchPool, nullptr);
+		uniform.destroy();
+		append.destroy();
+		spawn.destroy();
+		particle.destroy();
+		global.destroy();
+		gpucmd.destroy();
+	}
+
 	void prepareComputePipelines()
 	{
 		// Create pipelines
 
+		// particle.comp and gpu_cmd.comp share the kernel configuration, constants a shader doesn't declare are ignored
+		const std::array<VkSpecializationMapEntry, 4> specializationMapEntries = kernelConstantEntries();
+		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(static_cast<uint32_t>(specializationMapEntries.size()),
+			specializationMapEntries.data(), sizeof(particleKernel.constants), &particleKernel.constants);
+
 		{
 			VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayouts.compute, 0);
-			computePipelineCreateInfo.stage = loadShader(getShadersPath() + "meshparticles/particle.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			computePipelineCreateInfo.stage = loadShader(shaderFile("particle.comp"), VK_SHADER_STAGE_COMPUTE_BIT);
+			computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
 			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &pipelines.compute));
 		}
 
 		{
 			VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayouts.gpuCmd, 0);
-			computePipelineCreateInfo.stage = loadShader(getShadersPath() + "meshparticles/gpu_cmd.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			computePipelineCreateInfo.stage = loadShader(shaderFile("gpu_cmd.comp"), VK_SHADER_STAGE_COMPUTE_BIT);
+			computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
 			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &pipelines.gpuCmd));
 		}
+
+		{
+			VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayouts.emit, 0);
+			computePipelineCreateInfo.stage = loadShader(shaderFile("emit.comp"), VK_SHADER_STAGE_COMPUTE_BIT);
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &pipelines.emit));
+		}
+
+		if (particleRaster.available)
+		{
+			prepareParticleRasterPipelines();
+		}
+	}
+
+	// The binning is dispatched like the simulation, so it shares the kernel constants and only adds PARTICLE_RASTER_SCATTER
+	void prepareParticleRasterPipelines()
+	{
+		const std::array<VkSpecializationMapEntry, 4> kernelEntries = kernelConstantEntries();
+		std::vector<VkSpecializationMapEntry> specializationMapEntries(kernelEntries.begin(), kernelEntries.end());
+		specializationMapEntries.push_back(vks::initializers::specializationMapEntry(4, offsetof(RasterBinConstants, scatter), sizeof(VkBool32)));
+
+		for (VkBool32 scatter : { VK_FALSE, VK_TRUE })
+		{
+			RasterBinConstants constants;
+			constants.kernel = particleKernel.constants;
+			constants.scatter = scatter;
+			VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(static_cast<uint32_t>(specializationMapEntries.size()),
+				specializationMapEntries.data(), sizeof(constants), &constants);
+
+			VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(particleRaster.pipelineLayout, 0);
+			computePipelineCreateInfo.stage = loadShader(shaderFile("raster_bin.comp"), VK_SHADER_STAGE_COMPUTE_BIT);
+			computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, scatter ? &particleRaster.pipelines.scatter : &particleRaster.pipelines.count));
+		}
+
+		{
+			VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(particleRaster.pipelineLayout, 0);
+			computePipelineCreateInfo.stage = loadShader(shaderFile("raster_scan.comp"), VK_SHADER_STAGE_COMPUTE_BIT);
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &particleRaster.pipelines.scan));
+		}
+
+		{
+			VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(particleRaster.pipelineLayout, 0);
+			computePipelineCreateInfo.stage = loadShader(shaderFile("raster_tile.comp"), VK_SHADER_STAGE_COMPUTE_BIT);
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &particleRaster.pipelines.tile));
+		}
+
+		{
+			VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(particleRaster.pipelineLayout, 0);
+			computePipelineCreateInfo.stage = loadShader(shaderFile("sprite_cmd.comp"), VK_SHADER_STAGE_COMPUTE_BIT);
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &particleSprites.commandPipeline));
+		}
+	}
+
+	// Create the compute queue objects and hand the buffers written by the simulation over to the compute queue family
+	void prepareAsyncCompute()
+	{
+		const uint32_t graphicsQueueFamily = vulkanDevice->queueFamilyIndices.graphics;
+		const uint32_t computeQueueFamily = vulkanDevice->queueFamilyIndices.compute;
+
+		vkGetDeviceQueue(device, computeQueueFamily, 0, &asyncCompute.queue);
+		asyncCompute.commandPool = vulkanDevice->createCommandPool(computeQueueFamily);
+		asyncCompute.commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, asyncCompute.commandPool);
+
+		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &asyncCompute.simulationComplete));
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &asyncCompute.candidatesReady));
+
+		// The global data has been uploaded on the graphics queue. The particle buffer is released as well, so that
+		// the acquire of the first simulation has a matching release. The spawn ring buffer has no contents yet.
+		std::array<VkBufferMemoryBarrier, 2> barriers;
+		for (auto& barrier : barriers)
+		{
+			barrier = vks::initializers::bufferMemoryBarrier();
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = 0;
+			barrier.srcQueueFamilyIndex = graphicsQueueFamily;
+			barrier.dstQueueFamilyIndex = computeQueueFamily;
+			barrier.offset = 0;
+			barrier.size = VK_WHOLE_SIZE;
+		}
+		barriers[0].buffer = resourceBuffers.global.buffer;
+		barriers[1].buffer = resourceBuffers.particle.buffer;
+		VkCommandBuffer releaseCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vkCmdPipelineBarrier(releaseCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+		vulkanDevice->flushCommandBuffer(releaseCmd, queue, true);
+
+		// Only the global data is acquired here, the particle buffer by the first simulation
+		barriers[0].srcAccessMask = 0;
+		barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		VkCommandBuffer acquireCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, asyncCompute.commandPool, true);
+		vkCmdPipelineBarrier(acquireCmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barriers[0], 0, nullptr);
+		vulkanDevice->flushCommandBuffer(acquireCmd, asyncCompute.queue, asyncCompute.commandPool, true);
+	}
+
+	// Create the host visible copies of the particle state the simulation step is replayed on, see cpuReference
+	void prepareCpuReference()
+	{
+		cpuReference.reference.reset(new ParticleReference());
+		cpuReference.reference->setKernelConstants(particleKernel.constants);
+		cpuReference.reference->setTurbulence(&turbulence.field);
+
+		const VkMemoryPropertyFlags hostMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, hostMemory, &cpuReference.buffers.gpucmd, sizeof(GpuCmdBuffer)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, hostMemory, &cpuReference.buffers.global, sizeof(GlobalParticleData)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, hostMemory, &cpuReference.buffers.spawn, resourceBuffers.spawn.size));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, hostMemory, &cpuReference.buffers.particle, resourceBuffers.particle.size));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, hostMemory, &cpuReference.buffers.append, resourceBuffers.append.size));
+		// Keeps the replay from changing the statistics of the running simulation
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, hostMemory, &cpuReference.buffers.stats, resourceBuffers.stats.size));
+		VK_CHECK_RESULT(cpuReference.buffers.gpucmd.map());
+		VK_CHECK_RESULT(cpuReference.buffers.global.map());
+		VK_CHECK_RESULT(cpuReference.buffers.spawn.map());
+		VK_CHECK_RESULT(cpuReference.buffers.particle.map());
+		VK_CHECK_RESULT(cpuReference.buffers.append.map());
+
+		// The replay uses the gpu command and simulation pipelines with the copies bound
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.gpuCmd, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &cpuReference.gpuCmdDescriptorSet));
+		allocInfo.pSetLayouts = &descriptorSetLayouts.compute;
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &cpuReference.computeDescriptorSet));
+
+		const VkDescriptorSet gpuCmdSet = cpuReference.gpuCmdDescriptorSet;
+		const VkDescriptorSet computeSet = cpuReference.computeDescriptorSet;
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets =
+		{
+			vks::initializers::writeDescriptorSet(gpuCmdSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &cpuReference.buffers.gpucmd.descriptor),
+			vks::initializers::writeDescriptorSet(gpuCmdSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &cpuReference.buffers.global.descriptor),
+			vks::initializers::writeDescriptorSet(gpuCmdSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &uniformBuffers.particleSystem.descriptor),
+			vks::initializers::writeDescriptorSet(gpuCmdSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &cpuReference.buffers.stats.descriptor),
+			vks::initializers::writeDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.modelData.descriptor),
+			vks::initializers::writeDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &uniformBuffers.viewData.descriptor),
+			vks::initializers::writeDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &uniformBuffers.particleSystem.descriptor),
+			vks::initializers::writeDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &cpuReference.buffers.append.descriptor),
+			vks::initializers::writeDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &cpuReference.buffers.spawn.descriptor),
+			vks::initializers::writeDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &cpuReference.buffers.particle.descriptor),
+			vks::initializers::writeDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &cpuReference.buffers.global.descriptor),
+			vks::initializers::writeDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7, &cpuReference.buffers.gpucmd.descriptor),
+			vks::initializers::writeDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9, &turbulence.texture.descriptor)
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+		// The depth of the collisions is written with the attachments
+		updateAttachmentDescriptors();
+	}
+
+	// Copy the depth buffer of the last frame to host memory as floats and return the depth quantization of its format
+	// All pass structures which store the depth buffer leave it in the depth attachment layout at the end of a frame
+	float readDepthBuffer(std::vector<float>& depth)
+	{
+		const VkDeviceSize texelCount = (VkDeviceSize)width * height;
+		const VkDeviceSize size = texelCount * vks::Readback::texelSize(depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+		if (cpuReference.buffers.depth.size < size) {
+			cpuReference.buffers.depth.destroy();
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &cpuReference.buffers.depth, size));
+			VK_CHECK_RESULT(cpuReference.buffers.depth.map());
+		}
+
+		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		const VkImageSubresourceRange subresourceRange = { depthAspectMask(), 0, 1, 0, 1 };
+		vks::tools::setImageLayout(copyCmd, depthStencil.image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			subresourceRange, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		VkBufferImageCopy region{};
+		region.imageSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1 };
+		region.imageExtent = { width, height, 1 };
+		vkCmdCopyImageToBuffer(copyCmd, depthStencil.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, cpuReference.buffers.depth.buffer, 1, &region);
+		vks::tools::setImageLayout(copyCmd, depthStencil.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			subresourceRange, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT);
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+
+		return convertDepth(cpuReference.buffers.depth.mapped, depthFormat, (size_t)texelCount, depth);
+	}
+
+	// Convert the depth aspect of a depth buffer copied to host memory to floats and return the depth quantization of its format
+	static float convertDepth(const void* data, VkFormat format, size_t texelCount, std::vector<float>& depth)
+	{
+		depth.resize(texelCount);
+		if (format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_D16_UNORM_S8_UINT) {
+			const uint16_t* texels = static_cast<const uint16_t*>(data);
+			for (size_t i = 0; i < texelCount; i++) {
+				depth[i] = (float)texels[i] / 65535.0f;
+			}
+			return 1.0f / 65535.0f;
+		}
+		// The depth aspect of the packed 24 bit formats is copied to the lower bits of 32 bit texels
+		if (format == VK_FORMAT_X8_D24_UNORM_PACK32 || format == VK_FORMAT_D24_UNORM_S8_UINT) {
+			const uint32_t* texels = static_cast<const uint32_t*>(data);
+			for (size_t i = 0; i < texelCount; i++) {
+				depth[i] = (float)(texels[i] & 0xffffff) / 16777215.0f;
+			}
+			return 1.0f / 16777215.0f;
+		}
+		memcpy(depth.data(), data, texelCount * sizeof(float));
+		return FLT_EPSILON;
+	}
+
+	// Number of screen spawn candidates a frame has appended to its write slot
+	static uint32_t appendedScreenSpawns(const ParticleSystem& system, const GpuCmdBuffer& gpuCmd, const GlobalParticleData& global)
+	{
+		if (system.spawnSource != SPAWN_SOURCE_SCREEN) {
+			return 0;
+		}
+		// The slots only differ with async compute. Without it the simulation of the frame has already consumed
+		// the candidates of the single slot, and spawned all of them.
+		if (system.candidateWriteSlot != system.candidateReadSlot) {
+			return std::min(gpuCmd.particleCount[system.candidateWriteSlot], gpuCmd.appendBudget[system.candidateWriteSlot]);
+		}
+		return global.newEmiitedCount;
+	}
+
+	// Replay the simulation step of the last frame on copies of the particle state and compare the result with the CPU reference
+	// run on the same inputs. The replay runs on the queue of the simulation, which owns the spawn ring buffer and the global data.
+	void validateCpuReference()
+	{
+		const VkQueue simulationQueue = asyncCompute.enabled ? asyncCompute.queue : queue;
+		const VkCommandPool simulationCommandPool = asyncCompute.enabled ? asyncCompute.commandPool : cmdPool;
+		VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+		VK_CHECK_RESULT(vkQueueWaitIdle(simulationQueue));
+
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, simulationCommandPool, true);
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		const std::array<std::pair<vks::Buffer*, vks::Buffer*>, 4> copies = { {
+			{ &resourceBuffers.gpucmd, &cpuReference.buffers.gpucmd },
+			{ &resourceBuffers.global, &cpuReference.buffers.global },
+			{ &resourceBuffers.spawn, &cpuReference.buffers.spawn },
+			{ &resourceBuffers.append, &cpuReference.buffers.append }
+		} };
+		for (auto& copy : copies) {
+			VkBufferCopy region = { 0, 0, copy.first->size };
+			vkCmdCopyBuffer(copyCmd, copy.first->buffer, copy.second->buffer, 1, &region);
+		}
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		vulkanDevice->flushCommandBuffer(copyCmd, simulationQueue, simulationCommandPool, true);
+
+		ParticleReference::State input;
+		memcpy(&input.gpuCmd, cpuReference.buffers.gpucmd.mapped, sizeof(GpuCmdBuffer));
+		memcpy(&input.global, cpuReference.buffers.global.mapped, sizeof(GlobalParticleData));
+		const Particle* ring = static_cast<const Particle*>(cpuReference.buffers.spawn.mapped);
+		input.ring.assign(ring, ring + input.global.particleCountMax);
+		const AppendJob* appendJobs = static_cast<const AppendJob*>(cpuReference.buffers.append.mapped);
+
+		// Screen spawn candidates appended by this frame, which match its depth buffer
+		const uint32_t screenSpawnCount = mergedRenderPass ? 0 : appendedScreenSpawns(particleSystem, input.gpuCmd, input.global);
+
+		// The frame has usually consumed the candidates of the read slot. They are still in the append buffer,
+		// so their count is restored for the replay to spawn them again.
+		const uint32_t readSlot = particleSystem.candidateReadSlot;
+		if (input.gpuCmd.particleCount[readSlot] == 0) {
+			input.gpuCmd.particleCount[readSlot] = input.global.newEmiitedCount;
+			memcpy(cpuReference.buffers.gpucmd.mapped, &input.gpuCmd, sizeof(GpuCmdBuffer));
+		}
+
+		VkCommandBuffer replayCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, simulationCommandPool, true);
+		vkCmdBindPipeline(replayCmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.gpuCmd);
+		vkCmdBindDescriptorSets(replayCmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.gpuCmd, 0, 1, &cpuReference.gpuCmdDescriptorSet, 0, nullptr);
+		vkCmdDispatch(replayCmd, 1, 1, 1);
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(replayCmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		vkCmdBindPipeline(replayCmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.compute);
+		vkCmdBindDescriptorSets(replayCmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.compute, 0, 1, &cpuReference.computeDescriptorSet, 0, nullptr);
+		vkCmdDispatchIndirect(replayCmd, cpuReference.buffers.gpucmd.buffer, offsetof(GpuCmdBuffer, dispatchCmd));
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(replayCmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		vulkanDevice->flushCommandBuffer(replayCmd, simulationQueue, simulationCommandPool, true);
+
+		ParticleReference::State expected = input;
+		auto tStart = std::chrono::high_resolution_clock::now();
+		cpuReference.reference->step(particleSystem, appendJobs, expected);
+		cpuReference.cpuTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+		ParticleReference::Report report = cpuReference.reference->compare(particleSystem, input, expected,
+			*static_cast<const GpuCmdBuffer*>(cpuReference.buffers.gpucmd.mapped),
+			*static_cast<const GlobalParticleData*>(cpuReference.buffers.global.mapped),
+			static_cast<const Particle*>(cpuReference.buffers.spawn.mapped),
+			static_cast<const Particle*>(cpuReference.buffers.particle.mapped));
+		if (screenSpawnCount > 0) {
+			std::vector<float> depth;
+			const float depthTolerance = readDepthBuffer(depth);
+			cpuReference.reference->compareScreenSpawns(appendJobs + particleSystem.candidateWriteSlot * particleSystem.candidateSlotSize, screenSpawnCount,
+				depth.data(), width, height, depthTolerance, uboViewData.viewProj, uboViewData.invViewProj, report);
+		}
+
+		cpuReference.passed = report.passed();
+		cpuReference.summary = report.summary();
+		std::cout << "CPU reference, frame " << particleSystem.frameNum << " " << cpuReference.summary << "\n";
+		for (auto& message : report.messages) {
+			std::cout << "  " << message << "\n";
+		}
+	}
+
+	// Dump the particle state left by the last frame together with the inputs of its simulation step
+	// Each resource is captured on the queue that owns it. With async compute the simulation of the next frame waits
+	// for the copies of the shared buffers on the graphics queue, and the particle buffer is left out, as it has been
+	// released by the graphics queue and is only acquired by the next simulation.
+	void dumpParticleState()
+	{
+		const vks::Readback::Source graphics = { queue, cmdPool, asyncCompute.enabled ? particleDump.captured : VK_NULL_HANDLE };
+		const vks::Readback::Source simulation = asyncCompute.enabled ? vks::Readback::Source{ asyncCompute.queue, asyncCompute.commandPool, VK_NULL_HANDLE } : graphics;
+		vks::Readback::Request request("meshparticles_frame" + std::to_string(submittedFrames) + ".bin", submittedFrames);
+		request.addHostData("particleSystem", &particleSystem, sizeof(ParticleSystem));
+		request.addHostData("viewData", &uboViewData, sizeof(uboViewData));
+		request.addHostData("kernelConstants", &particleKernel.constants, sizeof(KernelConstants));
+		request.addBuffer(graphics, "gpucmd", resourceBuffers.gpucmd.buffer, sizeof(GpuCmdBuffer));
+		request.addBuffer(graphics, "append", resourceBuffers.append.buffer, resourceBuffers.append.size);
+		request.addBuffer(simulation, "global", resourceBuffers.global.buffer, sizeof(GlobalParticleData));
+		request.addBuffer(simulation, "spawn", resourceBuffers.spawn.buffer, resourceBuffers.spawn.size);
+		if (!asyncCompute.enabled) {
+			request.addBuffer(graphics, "particle", resourceBuffers.particle.buffer, resourceBuffers.particle.size);
+		}
+		// The merged render pass doesn't store the depth buffer
+		if (!mergedRenderPass) {
+			request.addImage(graphics, "depth", depthStencil.image, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, width, height, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+		}
+		particleDump.readback.submit(request);
+		particleDump.capturePending = asyncCompute.enabled;
+	}
+
+	// Run the CPU reference simulation step on a particle state dump and print the particle counts before and after it
+	// As in validateCpuReference(), the consumed spawn candidates of the dumped frame are restored and spawned again.
+	// Screen spawn positions are checked against the dumped depth buffer. Static, as it runs before any Vulkan object is created.
+	static bool replayParticleDump(const std::string& path)
+	{
+		vks::ReadbackFile file;
+		if (!file.load(path)) {
+			return false;
+		}
+		// Chunks may be shorter down to minSize for structures that were extended, the rest keeps its defaults
+		auto readChunk = [&](const char* name, void* data, size_t size, size_t minSize) -> bool {
+			const vks::ReadbackFile::Chunk* chunk = file.find(name);
+			if (!chunk || chunk->data.size() < minSize || chunk->data.size() > size) {
+				std::cerr << "Error: \"" << path << "\" has no " << name << " chunk of " << size << " bytes\n";
+				return false;
+			}
+			memcpy(data, chunk->data.data(), chunk->data.size());
+			return true;
+		};
+
+		// Dumps from before the tick based simulation have birth frames rather than ticks, their particle system is too short
+		ParticleSystem system;
+		ParticleReference::State state;
+		UBOViewlData viewData;
+		if (!readChunk("particleSystem", &system, sizeof(system), sizeof(system)) || !readChunk("viewData", &viewData, sizeof(viewData), offsetof(UBOViewlData, spriteSize)) ||
+			!readChunk("gpucmd", &state.gpuCmd, sizeof(state.gpuCmd), sizeof(state.gpuCmd)) || !readChunk("global", &state.global, sizeof(state.global), sizeof(state.global))) {
+			return false;
+		}
+		// The simulation is replayed with the kernel configuration of the dump, dumps without one used the defaults
+		KernelConstants constants;
+		const vks::ReadbackFile::Chunk* constantsChunk = file.find("kernelConstants");
+		if (constantsChunk && constantsChunk->data.size() == sizeof(constants)) {
+			memcpy(&constants, constantsChunk->data.data(), sizeof(constants));
+		}
+		const vks::ReadbackFile::Chunk* spawn = file.find("spawn");
+		const vks::ReadbackFile::Chunk* append = file.find("append");
+		if (!spawn || spawn->data.size() < state.global.particleCountMax * sizeof(Particle) ||
+			!append || append->data.size() < (std::max(system.candidateWriteSlot, system.candidateReadSlot) + 1) * system.candidateSlotSize * sizeof(AppendJob)) {
+			std::cerr << "Error: \"" << path << "\" has no spawn and append chunks matching its particle system\n";
+			return false;
+		}
+		const Particle* ring = reinterpret_cast<const Particle*>(spawn->data.data());
+		state.ring.assign(ring, ring + state.global.particleCountMax);
+		std::vector<AppendJob> appendJobs(append->data.size() / sizeof(AppendJob));
+		memcpy(appendJobs.data(), append->data.data(), appendJobs.size() * sizeof(AppendJob));
+
+		std::cout << "Replay of frame " << file.frame << " (particle system frame " << system.frameNum << ")\n";
+		std::cout << "  dumped: " << state.global.renderCount << " live particles, " << state.global.newEmiitedCount << " emitted, ring index "
+			<< state.global.particleIndex << ", " << state.gpuCmd.drawCmd.vertexCount << " drawn\n";
+
+		const vks::ReadbackFile::Chunk* depth = file.find("depth");
+		const uint32_t screenSpawnCount = depth ? appendedScreenSpawns(system, state.gpuCmd, state.global) : 0;
+		if (screenSpawnCount > 0) {
+			ParticleReference reference;
+			ParticleReference::Report report;
+			std::vector<float> depthValues;
+			const float depthTolerance = convertDepth(depth->data.data(), (VkFormat)depth->header.format, (size_t)depth->header.width * depth->header.height, depthValues);
+			reference.compareScreenSpawns(appendJobs.data() + system.candidateWriteSlot * system.candidateSlotSize, screenSpawnCount,
+				depthValues.data(), depth->header.width, depth->header.height, depthTolerance, viewData.viewProj, viewData.invViewProj, report);
+			std::cout << "  screen spawns: " << report.spawnsCompared << " checked against the depth buffer, " << report.spawnMismatches << " mismatches\n";
+			for (auto& message : report.messages) {
+				std::cout << "    " << message << "\n";
+			}
+		}
+
+		const uint32_t readSlot = system.candidateReadSlot;
+		if (state.gpuCmd.particleCount[readSlot] == 0) {
+			state.gpuCmd.particleCount[readSlot] = state.global.newEmiitedCount;
+		}
+		ParticleReference reference;
+		reference.setKernelConstants(constants);
+		// The field is baked the same way on every run, dumps without the turbulence parameters have none
+		const ParticleReference::TurbulenceField field = ParticleReference::bakeTurbulence(TURBULENCE_SIZE, TURBULENCE_PERIOD, TURBULENCE_SEED);
+		reference.setTurbulence(&field);
+		auto tStart = std::chrono::high_resolution_clock::now();
+		reference.step(system, appendJobs.data(), state);
+		const float cpuTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		std::cout << "  replayed: " << state.global.renderCount << " live particles, " << state.global.newEmiitedCount << " emitted, ring index "
+			<< state.global.particleIndex << ", " << state.gpuCmd.drawCmd.vertexCount << " drawn, " << state.gpuCmd.dispatchCmd.x << " work groups\n";
+		std::cout << "  CPU step: " << cpuTime << " ms (" << reference.getThreadCount() << " threads)\n";
+		return true;
+	}
+
+	void prepareTimestampQueries()
+	{
+		// Timestamps are written from the graphics queue, which needs to support them
+		gpuTimings.supported = (deviceProperties.limits.timestampComputeAndGraphics == VK_TRUE);
+		if (!gpuTimings.supported) {
+			spawnBudget.adaptive = false;
+			return;
+		}
+
+		VkQueryPoolCreateInfo queryPoolInfo = {};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = TIMESTAMP_COUNT;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &gpuTimings.queryPool));
+	}
+
+	// Read back the timestamps of the last frame
+	void updateGpuTimings()
+	{
+		if (!gpuTimings.supported) {
+			return;
+		}
+
+		std::array<uint64_t, TIMESTAMP_COUNT> timestamps;
+		VkResult result = vkGetQueryPoolResults(device, gpuTimings.queryPool, 0, TIMESTAMP_COUNT,
+			sizeof(uint64_t) * timestamps.size(), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) {
+			return;
+		}
+
+		const double period = deviceProperties.limits.timestampPeriod / 1000000.0;
+		gpuTimings.frameTime = (float)((double)(timestamps[TIMESTAMP_FRAME_END] - timestamps[TIMESTAMP_FRAME_BEGIN]) * period);
+		gpuTimings.frameTimeSum += gpuTimings.frameTime;
+		gpuTimings.frameTimeSamples++;
+
+		// With async compute the frame time only covers the graphics queue, so the simulation time hidden behind
+		// the depth only and scene passes no longer counts. Timestamps of different queues are not compared.
+		double computeTime = (double)(timestamps[TIMESTAMP_PARTICLE_COMPUTE_END] - timestamps[TIMESTAMP_PARTICLE_COMPUTE_BEGIN]) * period;
+		double renderTime = (double)(timestamps[TIMESTAMP_PARTICLE_RENDER_END] - timestamps[TIMESTAMP_PARTICLE_RENDER_BEGIN]) * period;
+		gpuTimings.computeTime = (float)computeTime;
+		gpuTimings.computeTimeSum += computeTime;
+		gpuTimings.renderTime = (float)renderTime;
+		gpuTimings.renderTimeSum += renderTime;
+		gpuTimings.particleTime = (float)(computeTime + renderTime);
+	}
+
+	// Read the statistics of the frame PARTICLE_STATS_LATENCY frames before the one just submitted
+	void updateParticleStats()
+	{
+		if (particleSystem.frameNum < PARTICLE_STATS_LATENCY) {
+			return;
+		}
+		const uint32_t frame = particleSystem.frameNum - PARTICLE_STATS_LATENCY;
+		const ParticleStats& stats = static_cast<const ParticleStats*>(resourceBuffers.stats.mapped)[frame % PARTICLE_STATS_FRAMES];
+		if (stats.frame != frame) {
+			return;
+		}
+		particleStats.last = stats;
+		particleStats.valid = true;
+
+		const std::array<float, 4> values = { (float)stats.drawVertexCount, (float)stats.renderCount, (float)stats.newEmittedCount, (float)stats.cachedCount };
+		std::array<std::vector<float>*, 4> histories = { &particleStats.liveParticles, &particleStats.renderCount, &particleStats.newEmitted, &particleStats.cachedCount };
+		for (size_t i = 0; i < values.size(); i++) {
+			std::vector<float>& history = *histories[i];
+			if (history.size() == PARTICLE_STATS_HISTORY) {
+				history.erase(history.begin());
+			}
+			history.push_back(values[i]);
+			particleStats.sums[i] += values[i];
+		}
+		particleStats.samples++;
+
+		if (benchmark.active) {
+			benchmark.frameValues = { (double)stats.drawVertexCount, (double)stats.renderCount, (double)stats.newEmittedCount,
+				(double)stats.cachedCount, (double)stats.ringWraps, (double)stats.dispatchGroups };
+		}
+	}
+
+	// Adapt the spawn budget to the target particle pass time
+	// The particle cost follows the spawn rate with a delay of the particle lifetime,
+	// so the budget is only changed by a small step each frame.
+	void updateSpawnBudget()
+	{
+		if (!spawnBudget.adaptive || gpuTimings.particleTime <= 0.0f) {
+			return;
+		}
+		float ratio = glm::clamp(spawnBudget.targetTime / gpuTimings.particleTime, 0.95f, 1.05f);
+		int32_t budget = (int32_t)((float)spawnBudget.budget * ratio);
+		spawnBudget.budget = glm::clamp(budget, spawnBudget.minBudget, spawnBudget.maxBudget);
 	}
 
 	float rnd(float range)
@@ -1468,26 +4249,95 @@ public:
 
 	void updateUniformBufferModel()
 	{
-		static float lastTimer = 0.0;
+		static float lastTime = 0.0;
 
 		uboModelData.alphaReference = timer;
-		uboModelData.deltaAlphaEstimation = timer - lastTimer;
-		lastTimer = timer;
+		uboModelData.deltaAlphaEstimation = dissolve.time - lastTime;
+		lastTime = dissolve.time;
 
 		VK_CHECK_RESULT(uniformBuffers.modelData.map());
 		uniformBuffers.modelData.copyTo(&uboModelData, sizeof(uboModelData));
 		uniformBuffers.modelData.unmap();
 
 		// Instance buffer
-		for (size_t i = 0; i != INSTANCE_COUNT; ++i)
+		// Instances are laid out on a grid, the first row runs diagonally away from the camera
+		const uint32_t columns = static_cast<uint32_t>(ceil(sqrt((float)instanceCount)));
+		for (size_t i = 0; i != instanceCount; ++i)
+		{
+			InstanceData& instance = instances[i];
+
+			if (instanceTransformsChanged)
+			{
+				const float column = (float)(i % columns);
+				const float row = (float)(i / columns);
+				glm::vec3 pos = glm::vec3(-3.0f * column, 3.0f * row, -4.0f * column);
+				instance.transform = glm::translate(matModel, pos);
+				instanceDirty[i] = true;
+			}
+
+			// Each instance dissolves from its own start time at its own speed,
+			// stays fully dissolved for a while and then starts over
+			float alphaReference = 0.0f;
+			float alphaDelta = 0.0f;
+			float phase = dissolve.time - instance.dissolveStart;
+			if (phase > 0.0f)
+			{
+				const float cycle = 1.0f / instance.dissolveSpeed + dissolve.hold;
+				alphaReference = glm::min(fmodf(phase, cycle) * instance.dissolveSpeed, 1.0f);
+				// Only instances which are still dissolving spawn particles
+				if (alphaReference < 1.0f)
+				{
+					alphaDelta = uboModelData.deltaAlphaEstimation * instance.dissolveSpeed;
+				}
+			}
+			if (alphaReference != instance.alphaReference || alphaDelta != instance.alphaDelta)
+			{
+				instance.alphaReference = alphaReference;
+				instance.alphaDelta = alphaDelta;
+				instanceDirty[i] = true;
+			}
+		}
+		instanceTransformsChanged = false;
+
+		updateInstanceBuffer();
+	}
+
+	// Assign staggered start times and varying speeds to all instances
+	// Start times are jittered within one stratum per instance, which spreads them evenly over the stagger window
+	void resetDissolve()
+	{
+		for (size_t i = 0; i != instanceCount; ++i)
 		{
-			glm::vec3 pos = glm::vec3(-3.0, 0.0, -4.0) * glm::vec3((float)i);
-			uboInstanceData.transform[i] = glm::translate(matModel, pos);
+			InstanceData& instance = instances[i];
+			instance.dissolveStart = dissolve.time + dissolve.stagger * ((float)i + rnd(1.0f)) / (float)instanceCount;
+			instance.dissolveSpeed = 1.0f + dissolve.speedVariation * (rnd(2.0f) - 1.0f);
+			instance.dissolveSpeed = glm::max(instance.dissolveSpeed, 0.05f);
+			instanceDirty[i] = true;
 		}
+	}
 
-		VK_CHECK_RESULT(uniformBuffers.instancing.map());
-		uniformBuffers.instancing.copyTo(&uboInstanceData, sizeof(uboInstanceData));
-		uniformBuffers.instancing.unmap();
+	// Write changed instances to the mapped instance buffer,
+	// neighbouring changes are coalesced into a single copy
+	void updateInstanceBuffer()
+	{
+		uint8_t* dst = static_cast<uint8_t*>(resourceBuffers.instances.mapped);
+		uint32_t first = 0;
+		while (first < instanceCount)
+		{
+			if (!instanceDirty[first])
+			{
+				first++;
+				continue;
+			}
+			uint32_t last = first;
+			while (last < instanceCount && instanceDirty[last])
+			{
+				instanceDirty[last] = false;
+				last++;
+			}
+			memcpy(dst + first * sizeof(InstanceData), &instances[first], (last - first) * sizeof(InstanceData));
+			first = last;
+		}
 	}
 
 	void updateUniformBufferView()
@@ -1496,22 +4346,66 @@ public:
 		uboViewData.viewProj = camera.matrices.perspective * camera.matrices.view;
 		uboViewData.invViewProj = glm::inverse(uboViewData.viewProj);
 		uboViewData.viewport = glm::vec2(width, height);
+		// The pixels per world unit at a clip space w of one, from the vertical scale of the projection
+		uboViewData.spriteSize = (particleRaster.mode == PARTICLE_RASTER_SPRITES) ? particleSprites.size : 0.0f;
+		uboViewData.spritePixelScale = fabsf(camera.matrices.perspective[1][1]) * (float)height * 0.5f;
 
 		VK_CHECK_RESULT(uniformBuffers.viewData.map());
 		uniformBuffers.viewData.copyTo(&uboViewData, sizeof(uboViewData));
 		uniformBuffers.viewData.unmap();
 	}
 
-	void updateUniformBufferParticleSystem()
+	// Advance the simulation by the whole ticks that fit into the frame time, the rest is interpolated when the particles
+	// are drawn. Lifetimes, motion and emission are measured in ticks, so the particle count and cost per second don't
+	// depend on the frame rate. The spawn budget is per tick, frames emit it for the ticks that have passed, including
+	// fractions of ticks, so frames faster than a tick still emit.
+	// Also advances the per frame state of the particle system, only called once per rendered frame, as the frame
+	// number selects the spawn candidate and statistics slots the submitted frames alternate between.
+	void advanceSimulationClock()
 	{
 		particleSystem.deltaT = frameTimer;
-		particleSystem.random = rnd(1.0f);
 		particleSystem.frameNum += 1;
-
+		// With async compute the simulation consumes the slot the previous frame has appended to
+		particleSystem.candidateWriteSlot = asyncCompute.enabled ? particleSystem.frameNum % SPAWN_CANDIDATE_SLOTS : 0;
+		particleSystem.candidateReadSlot = asyncCompute.enabled ? (particleSystem.frameNum + 1) % SPAWN_CANDIDATE_SLOTS : 0;
+		// Wrapped, the field tiles every texture coordinate unit
+		particleSystem.turbulenceOffset = glm::fract(particleSystem.turbulenceOffset + turbulence.scrollDirection * (turbulence.scrollSpeed * frameTimer));
 		float windX = glm::radians<float>(timer * 360.0 + 60.0);
 		float windY = glm::sin(windX);
 		particleSystem.wind = glm::vec3(windX, windY, 0.0) * glm::vec3(rnd(1.0f));
 
+		const float tickTime = particleSystem.tickTime;
+		const float previousInterpolation = particleSystem.interpolation;
+		particleSystem.tick += particleSystem.substeps;
+
+		simulationClock.accumulator += frameTimer;
+		const uint32_t ticks = static_cast<uint32_t>(simulationClock.accumulator / tickTime);
+		particleSystem.substeps = std::min(ticks, PARTICLE_MAX_SUBSTEPS);
+		simulationClock.accumulator = std::fmod(simulationClock.accumulator, tickTime);
+		particleSystem.interpolation = simulationClock.accumulator / tickTime;
+
+		const float budget = (float)spawnBudget.budget * particleQualityLevel(particleQuality).budgetScale;
+		simulationClock.spawnCredit += budget * ((float)particleSystem.substeps + particleSystem.interpolation - previousInterpolation);
+		const float emitted = std::max(std::floor(simulationClock.spawnCredit), 0.0f);
+		simulationClock.spawnCredit -= emitted;
+		particleSystem.spawnBudget = std::min((uint32_t)emitted, (uint32_t)spawnBudget.maxBudget);
+	}
+
+	// Uploads the particle system with the current settings, the per frame state is advanced by advanceSimulationClock
+	void updateUniformBufferParticleSystem()
+	{
+		particleSystem.spawnSampling = (uint32_t)spawnBudget.sampling;
+		particleSystem.spawnSource = (uint32_t)surfaceSpawn.source;
+		particleSystem.candidateSlotSize = (uint32_t)spawnBudget.maxBudget;
+		particleSystem.collision = (particleCollision.available && particleCollision.enabled) ? 1 : 0;
+		// The emission level of detail compares radius / distance of an instance with the projected radius of the level
+		const ParticleQuality& quality = particleQualityLevel(particleQuality);
+		particleSystem.lodCamera = glm::vec3(glm::inverse(camera.matrices.view)[3]);
+		particleSystem.instanceRadius = sphere.dimensions.radius;
+		particleSystem.emissionLodSize = quality.emissionLodPixels / (fabsf(camera.matrices.perspective[1][1]) * (float)height * 0.5f);
+		particleSystem.simulationLodLevels = quality.simulationLodLevels;
+		particleSystem.simulationLodDistance = quality.simulationLodDistance;
+
 		VK_CHECK_RESULT(uniformBuffers.particleSystem.map());
 		uniformBuffers.particleSystem.copyTo(&particleSystem, sizeof(particleSystem));
 		uniformBuffers.particleSystem.unmap();
@@ -1535,6 +4429,7 @@ public:
 			matModel = glm::translate(matModel, glm::vec3(speed, 0.0f, 0.0f));
 			break;
 		}
+		instanceTransformsChanged = true;
 
 		updateUniformBufferView();
 	}
@@ -1542,25 +4437,124 @@ public:
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		if (asyncCompute.enabled)
+		{
+			submitAsyncCompute();
+		}
+		else
+		{
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		}
 		VulkanExampleBase::submitFrame();
+		submittedFrames++;
+	}
+
+	// The simulation waits for the previous frame to finish with the particle buffer and its spawn candidates.
+	// The first graphics submit runs concurrently, the second one waits for the simulation and the swap chain image.
+	void submitAsyncCompute()
+	{
+		const std::array<VkPipelineStageFlags, 2> computeWaitStages = { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+		std::vector<VkSemaphore> computeWaitSemaphores;
+		if (asyncCompute.candidatesPending)
+		{
+			computeWaitSemaphores.push_back(asyncCompute.candidatesReady);
+		}
+		// A dump of the last frame reads the shared buffers on the graphics queue
+		if (particleDump.capturePending)
+		{
+			computeWaitSemaphores.push_back(particleDump.captured);
+			particleDump.capturePending = false;
+		}
+		VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
+		computeSubmitInfo.waitSemaphoreCount = static_cast<uint32_t>(computeWaitSemaphores.size());
+		computeSubmitInfo.pWaitSemaphores = computeWaitSemaphores.data();
+		computeSubmitInfo.pWaitDstStageMask = computeWaitStages.data();
+		computeSubmitInfo.commandBufferCount = 1;
+		computeSubmitInfo.pCommandBuffers = &asyncCompute.commandBuffer;
+		computeSubmitInfo.signalSemaphoreCount = 1;
+		computeSubmitInfo.pSignalSemaphores = &asyncCompute.simulationComplete;
+		VK_CHECK_RESULT(vkQueueSubmit(asyncCompute.queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
+
+		const std::array<VkSemaphore, 2> waitSemaphores = { semaphores.presentComplete, asyncCompute.simulationComplete };
+		const std::array<VkPipelineStageFlags, 2> waitStages = { submitPipelineStages, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
+		const std::array<VkSemaphore, 2> signalSemaphores = { semaphores.renderComplete, asyncCompute.candidatesReady };
+		std::array<VkSubmitInfo, 2> graphicsSubmitInfos;
+		graphicsSubmitInfos[0] = vks::initializers::submitInfo();
+		graphicsSubmitInfos[0].commandBufferCount = 1;
+		graphicsSubmitInfos[0].pCommandBuffers = &drawCmdBuffers[currentBuffer];
+		graphicsSubmitInfos[1] = vks::initializers::submitInfo();
+		graphicsSubmitInfos[1].waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+		graphicsSubmitInfos[1].pWaitSemaphores = waitSemaphores.data();
+		graphicsSubmitInfos[1].pWaitDstStageMask = waitStages.data();
+		graphicsSubmitInfos[1].commandBufferCount = 1;
+		graphicsSubmitInfos[1].pCommandBuffers = &asyncCompute.particleCommandBuffers[currentBuffer];
+		graphicsSubmitInfos[1].signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+		graphicsSubmitInfos[1].pSignalSemaphores = signalSemaphores.data();
+		VK_CHECK_RESULT(vkQueueSubmit(queue, static_cast<uint32_t>(graphicsSubmitInfos.size()), graphicsSubmitInfos.data(), VK_NULL_HANDLE));
+		asyncCompute.candidatesPending = true;
 	}
 
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
+		if (dynamicRendering)
+		{
+			vkCmdBeginRenderingKHR = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(vkGetDeviceProcAddr(device, "vkCmdBeginRenderingKHR"));
+			vkCmdEndRenderingKHR = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(vkGetDeviceProcAddr(device, "vkCmdEndRenderingKHR"));
+		}
+		if (synchronization2)
+		{
+			vkCmdPipelineBarrier2KHR = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(vkGetDeviceProcAddr(device, "vkCmdPipelineBarrier2KHR"));
+		}
+		// The simulation shares the graphics queue if there is no separate compute queue family
+		if (asyncCompute.enabled && vulkanDevice->queueFamilyIndices.compute == vulkanDevice->queueFamilyIndices.graphics)
+		{
+			std::cout << "No dedicated compute queue family, running the particle simulation on the graphics queue\n";
+			asyncCompute.enabled = false;
+		}
+		particleCollision.available = !mergedRenderPass && !asyncCompute.enabled;
 		loadAssets();
-		prepareOffscreenFramebuffers();
 		prepareUniformBuffers();
 		prepareResourceBuffers();
+		if (particleRaster.available) {
+			prepareParticleRasterBuffers();
+			prepareParticleSprites();
+		}
+		if (asyncCompute.enabled) {
+			prepareAsyncCompute();
+		}
+		prepareSurfacePoints();
+		prepareTurbulence();
+		prepareTimestampQueries();
+		// Creates the offscreen color attachments with dynamic rendering
+		setupRenderGraph();
+		prepareOffscreenFramebuffers();
 		setupDescriptorPool();
 		setupDescriptorSetLayout();
 		setupDescriptorSet();
 		prepareGraphicsPipelines();
+		selectParticleWorkgroupSize();
+		if (particleKernel.autotune) {
+			autotuneParticleWorkgroupSize();
+		}
 		prepareComputePipelines();
+		if (cpuReference.enabled) {
+			prepareCpuReference();
+		}
+		particleDump.readback.create(vulkanDevice);
+		if (asyncCompute.enabled) {
+			VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+			VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &particleDump.captured));
+		}
 		buildCommandBuffers();
+		if (printBarrierPlan) {
+			std::cout << "Render graph (" << (synchronization2 ? "vkCmdPipelineBarrier2KHR" : "vkCmdPipelineBarrier") << "):\n" << renderGraph.getPlan();
+			if (asyncCompute.enabled) {
+				std::cout << "Compute queue graph:\n" << asyncCompute.graph.getPlan();
+			}
+		}
 		prepared = true;
 	}
 
@@ -1571,8 +4565,26 @@ public:
 		}
 
 		draw();
+		if (particleDump.requested || submittedFrames == particleDump.frame) {
+			dumpParticleState();
+			particleDump.requested = false;
+		}
+		particleDump.readback.update();
+		// Validate before the uniform buffers are updated for the next frame
+		if (cpuReference.enabled && submittedFrames % cpuReference.interval == 0) {
+			validateCpuReference();
+		}
 
+		updateGpuTimings();
+		updateParticleStats();
+		updateSpawnBudget();
+
+		if (!paused)
+		{
+			dissolve.time += timerSpeed * frameTimer;
+		}
 		updateUniformBufferModel();
+		advanceSimulationClock();
 		updateUniformBufferParticleSystem();
 		if (camera.updated) {
 			updateUniformBufferView();
@@ -1588,12 +4600,100 @@ public:
 	virtual void OnUpdateUIOverlay(vks::UIOverlay* overlay)
 	{
 		if (overlay->header("Settings")) {
-			if (overlay->sliderFloat("Alpha Reference", &uboModelData.alphaReference, 0.0f, 1.0f)) {
+			if (overlay->sliderFloat("Dissolve Stagger", &dissolve.stagger, 0.0f, 4.0f)) {
+				resetDissolve();
+				updateUniformBufferModel();
+			}
+			if (overlay->sliderFloat("Speed Variation", &dissolve.speedVariation, 0.0f, 1.0f)) {
+				resetDissolve();
 				updateUniformBufferModel();
 			}
 			if (overlay->sliderFloat("Hide Speed", &particleSystem.speed, 0.0f, 100.0f)) {
 				updateUniformBufferParticleSystem();
 			}
+			overlay->text("Simulation: %.1f ms ticks, %u this frame", particleSystem.tickTime * 1000.0f, particleSystem.substeps);
+			std::vector<std::string> qualityNames;
+			for (int32_t level = 0; level < PARTICLE_QUALITY_LEVELS; level++) {
+				qualityNames.push_back(particleQualityLevel(level).name);
+			}
+			if (overlay->comboBox("Quality", &particleQuality, qualityNames)) {
+				updateUniformBufferParticleSystem();
+			}
+		}
+		if (overlay->header("Spawn budget")) {
+			overlay->sliderInt("Budget", &spawnBudget.budget, spawnBudget.minBudget, spawnBudget.maxBudget);
+			overlay->comboBox("Sampling", &spawnBudget.sampling, { "Stochastic", "Stratified" });
+			if (overlay->comboBox("Source", &surfaceSpawn.source, { "Screen", "Surface" })) {
+				updateUniformBufferParticleSystem();
+			}
+			if (gpuTimings.supported) {
+				overlay->checkBox("Adaptive", &spawnBudget.adaptive);
+				overlay->sliderFloat("Target (ms)", &spawnBudget.targetTime, 0.1f, 8.0f);
+				overlay->text("Particle passes: %.3f ms", gpuTimings.particleTime);
+			}
+		}
+		if (overlay->header("Particle collision")) {
+			if (particleCollision.available) {
+				bool changed = overlay->checkBox("Collide with depth", &particleCollision.enabled);
+				changed |= overlay->sliderFloat("Restitution", &particleSystem.restitution, 0.0f, 1.0f);
+				changed |= overlay->sliderFloat("Friction", &particleSystem.friction, 0.0f, 1.0f);
+				if (changed) {
+					updateUniformBufferParticleSystem();
+				}
+			} else {
+				overlay->text("Not available with %s", mergedRenderPass ? "subpasses" : "async compute");
+			}
+		}
+		if (overlay->header("Turbulence")) {
+			overlay->sliderFloat("Amplitude", &particleSystem.turbulenceAmplitude, 0.0f, 2.0f);
+			overlay->sliderFloat("Frequency", &particleSystem.turbulenceFrequency, 0.05f, 2.0f);
+			overlay->sliderFloat("Scroll speed", &turbulence.scrollSpeed, 0.0f, 0.5f);
+		}
+		if ((particleRaster.available || blendedParticles) && overlay->header("Particle rendering")) {
+			if (particleRaster.available) {
+				// Rebuilds the command buffers with the passes of the selected rasterizer
+				if (overlay->comboBox("Rasterizer", &particleRaster.mode, { "Points", "Compute tiles", "Sprites" })) {
+					updateUniformBufferView();
+				}
+				if (particleRaster.mode == PARTICLE_RASTER_SPRITES) {
+					if (overlay->sliderFloat("Sprite size", &particleSprites.size, 0.001f, 0.05f)) {
+						updateUniformBufferView();
+					}
+					overlay->text("Sprite expansion: %s", particleSprites.meshShader ? "mesh shader" : "vertex shader");
+				}
+				overlay->text("Packing: %s", particleRaster.atomic64 ? "64 bit depth and color" : "16 bit depth, 8 bit gray and lifetime");
+			} else {
+				overlay->text("Blending: weighted blended, depth tested");
+			}
+			if (gpuTimings.supported) {
+				overlay->text("Render passes: %.3f ms", gpuTimings.renderTime);
+			}
+		}
+		if (gpuTimings.supported && overlay->header("GPU timings")) {
+			overlay->text("Structure: %s", frameStructure().c_str());
+			overlay->text("Frame: %.3f ms", gpuTimings.frameTime);
+			overlay->text("Simulation work group size: %u", particleKernel.constants.workgroupSize);
+			if (asyncCompute.enabled) {
+				overlay->text("Compute queue: %.3f ms", gpuTimings.computeTime);
+			}
+		}
+		if (cpuReference.enabled && overlay->header("CPU reference")) {
+			overlay->text("Validation: %s", cpuReference.summary.empty() ? "pending" : (cpuReference.passed ? "passed" : "FAILED"));
+			overlay->text("CPU step: %.3f ms (%u threads)", cpuReference.cpuTime, cpuReference.reference->getThreadCount());
+		}
+		if (particleStats.valid && overlay->header("Particle statistics")) {
+			const ParticleStats& stats = particleStats.last;
+			overlay->text("Frame %u, %u ring wraps, %u work groups", stats.frame, stats.ringWraps, stats.dispatchGroups);
+			overlay->plotLines("Live", particleStats.liveParticles, std::to_string(stats.drawVertexCount).c_str());
+			overlay->plotLines("Simulated", particleStats.renderCount, std::to_string(stats.renderCount).c_str());
+			overlay->plotLines("Emitted", particleStats.newEmitted, std::to_string(stats.newEmittedCount).c_str());
+			overlay->plotLines("Cached", particleStats.cachedCount, std::to_string(stats.cachedCount).c_str());
+		}
+		if (overlay->header("Particle dump")) {
+			if (overlay->button("Dump next frame")) {
+				particleDump.requested = true;
+			}
+			overlay->text("Pending: %u", particleDump.readback.pending());
 		}
 	}
 };
@@ -0,0 +1,773 @@
+/*
+* CPU reference of the meshparticles particle pipeline
+*
+* Mirrors the spawn position reconstruction of scene.frag, gpu_cmd.comp and particle.comp on the CPU, so that
+* the GPU results of a frame can be validated from the same inputs, and gives a CPU throughput baseline
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vulkan/vulkan.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include "threadpool.hpp"
+
+/**
+* @brief CPU implementation of the particle simulation step
+*
+* The structures are the std430/std140 layouts of gpu_cmd.h, so buffers read back from the GPU can be used as they are.
+* step() runs gpu_cmd.comp and particle.comp on a copy of the particle state. The simulation is split into one range
+* of the ring buffer per thread, the live particles are compacted in ring order, whereas the GPU appends them in
+* the order its invocations finish. compare() takes this into account and checks the GPU state against the result.
+*/
+class ParticleReference
+{
+public:
+	// Spawn candidates are double buffered with async compute, see gpu_cmd.h
+	static const uint32_t SPAWN_CANDIDATE_SLOTS = 2;
+
+	/** @brief Specialization constants of particle.comp and gpu_cmd.comp, see particle_constants.h */
+	struct KernelConstants {
+		uint32_t workgroupSize = 64;		// Work group size of particle.comp
+		uint32_t particleCountMax = 0;		// Ring buffer size, the reference takes it from GlobalParticleData
+		float gravity = 0.2f;				// Upward velocity, scaled by the random number of a particle
+		float lifetimeScale = 0.01f;		// Lifetime a particle loses per tick at speed 1
+	};
+
+	struct AppendJob {
+		// World space spawn position, and the spawn texture value in w
+		glm::vec4 position;
+		// Index of the instance the particle is spawned from
+		glm::uint instance;
+		// std430 rounds the struct size up to the alignment of the vec4
+		glm::uint pad[3];
+	};
+
+	struct Particle {
+		glm::vec4 pos;
+		glm::vec4 color;
+		glm::uint birthTick;				// Simulation tick the particle was spawned at, 0 once it died
+		glm::uint instance;
+		// Velocity added by collisions as half floats, not modelled by the reference
+		glm::uint response[2];
+	};
+
+	struct GpuCmdBuffer {
+		uint32_t particleCount[SPAWN_CANDIDATE_SLOTS];
+		float spawnProbability[SPAWN_CANDIDATE_SLOTS];
+		uint32_t appendBudget[SPAWN_CANDIDATE_SLOTS];
+		VkDispatchIndirectCommand dispatchCmd;
+		VkDrawIndirectCommand drawCmd;
+	};
+
+	struct GlobalParticleData {
+		uint32_t particleCountMax = 0;
+		uint32_t particleIndex = 0;
+		uint32_t renderCount = 0;
+		uint32_t cachedCount = 0;
+		uint32_t newEmiitedCount = 0;
+	};
+
+	struct ParticleSystem {
+		glm::vec3 wind = glm::vec3(0.0f);
+		float deltaT = 0.0f;				// Frame delta time, the simulation advances in ticks
+		float speed = 100.0f;				// Lifetime in ticks is speed / KernelConstants::lifetimeScale
+		glm::uint seed = 0;					// Seed of the random numbers, offset by the tick, see particleHash()
+		glm::uint frameNum = 0;
+		glm::uint spawnBudget = 0;			// Maximum particle count emitted per frame
+		glm::uint spawnSampling = 0;		// SPAWN_SAMPLING_* of gpu_cmd.h
+		glm::uint spawnSource = 0;			// SPAWN_SOURCE_* of gpu_cmd.h
+		glm::uint candidateWriteSlot = 0;	// Spawn candidate slot appended to this frame
+		glm::uint candidateReadSlot = 0;	// Spawn candidate slot consumed by the simulation this frame
+		glm::uint candidateSlotSize = 0;	// Append jobs per slot
+		glm::uint collision = 0;			// Nonzero to collide the particles with the depth only pass
+		float restitution = 0.5f;			// Fraction of the normal velocity a collision reflects
+		float friction = 0.2f;				// Fraction of the tangential velocity a collision removes
+		glm::vec3 turbulenceOffset = glm::vec3(0.0f);	// Scroll of the turbulence field in texture coordinates
+		float turbulenceAmplitude = 0.0f;	// Turbulence velocity scale, 0 disables it
+		float turbulenceFrequency = 1.0f;	// Turbulence field repetitions per world space unit
+		glm::uint tick = 0;					// Simulation ticks before this frame
+		glm::uint substeps = 1;				// Ticks simulated this frame
+		float tickTime = 1.0f / 60.0f;		// Fixed tick length in seconds
+		float interpolation = 0.0f;			// Fraction of the next tick that has passed at the frame time
+		float emissionLodSize = 0.0f;		// Projected instance radius below which emission thins out, 0 disables it
+		float instanceRadius = 1.0f;		// Object space bounding radius of an instance
+		glm::uint simulationLodLevels = 0;	// Halvings of the simulation rate of far particles, see simulationPeriod()
+		glm::vec3 lodCamera = glm::vec3(0.0f);	// World space camera position of the level of detail
+		float simulationLodDistance = 0.0f;	// Camera distance beyond which the simulation rate halves, again at twice it
+	};
+
+	/** @brief Tileable velocity field sampled by particle.comp, see bakeTurbulence() */
+	struct TurbulenceField {
+		uint32_t size = 0;
+		// RGBA16F texels of the 3D texture, slice after slice
+		std::vector<uint16_t> halfs;
+		// The same texels as floats
+		std::vector<glm::vec3> texels;
+
+		/** @brief Trilinear sample at normalized coordinates with repeat addressing, as the sampler of particle.comp does */
+		glm::vec3 sample(const glm::vec3& coord) const
+		{
+			const glm::vec3 uvw = coord * float(size) - 0.5f;
+			const glm::vec3 base = glm::floor(uvw);
+			const glm::vec3 f = uvw - base;
+			glm::vec3 result = glm::vec3(0.0f);
+			for (uint32_t corner = 0; corner < 8; corner++) {
+				const glm::ivec3 offset = glm::ivec3(corner & 1, (corner >> 1) & 1, corner >> 2);
+				const glm::vec3 weight = glm::mix(glm::vec3(1.0f) - f, f, glm::vec3(offset));
+				result += texel(glm::ivec3(base) + offset) * (weight.x * weight.y * weight.z);
+			}
+			return result;
+		}
+
+		const glm::vec3& texel(const glm::ivec3& position) const
+		{
+			const glm::ivec3 n = glm::ivec3(size);
+			const glm::ivec3 p = ((position % n) + n) % n;
+			return texels[(p.z * size + p.y) * size + p.x];
+		}
+	};
+
+	/** @brief Particle state changed by a simulation step */
+	struct State {
+		GpuCmdBuffer gpuCmd{};
+		GlobalParticleData global;
+		// Ring buffer of global.particleCountMax particles
+		std::vector<Particle> ring;
+		// Compacted live particles, drawCmd.vertexCount of them are valid
+		std::vector<Particle> particles;
+	};
+
+	/** @brief Result of a comparison, mismatches are errors, see compare() */
+	struct Report {
+		uint32_t compared = 0;
+		uint32_t exact = 0;
+		uint32_t withinTolerance = 0;
+		uint32_t collided = 0;
+		uint32_t mismatches = 0;
+		uint32_t spawnsCompared = 0;
+		uint32_t spawnMismatches = 0;
+		// Details of the first mismatches
+		std::vector<std::string> messages;
+
+		bool passed() const
+		{
+			return mismatches == 0 && spawnMismatches == 0;
+		}
+
+		std::string summary() const
+		{
+			std::stringstream ss;
+			ss << (passed() ? "passed" : "FAILED") << ": " << compared << " particles, " << exact << " exact, "
+				<< withinTolerance << " within tolerance, ";
+			if (collided > 0) {
+				ss << collided << " collided, ";
+			}
+			ss << mismatches << " mismatches";
+			if (spawnsCompared > 0) {
+				ss << ", " << spawnsCompared << " screen spawns, " << spawnMismatches << " mismatches";
+			}
+			return ss.str();
+		}
+	};
+
+	explicit ParticleReference(uint32_t threadCount = std::thread::hardware_concurrency())
+	{
+		setThreadCount(threadCount);
+	}
+
+	void setThreadCount(uint32_t threadCount)
+	{
+		threadCount = std::max(threadCount, 1u);
+		// The calling thread simulates the first range
+		threadPool.setThreadCount(threadCount - 1);
+	}
+
+	uint32_t getThreadCount() const
+	{
+		return static_cast<uint32_t>(threadPool.threads.size()) + 1;
+	}
+
+	/** @brief Use the specialization constants the GPU pipelines were created with */
+	void setKernelConstants(const KernelConstants& constants)
+	{
+		kernelConstants = constants;
+	}
+
+	const KernelConstants& getKernelConstants() const
+	{
+		return kernelConstants;
+	}
+
+	/** @brief Position of a fragment reconstructed from its depth, see fragmentWorldPosition() in scene.frag */
+	static glm::vec3 unproject(const glm::vec2& fragCoord, float depth, const glm::vec2& viewport, const glm::mat4& invViewProj)
+	{
+		const glm::vec2 xy = glm::mix(glm::vec2(-1.0f), glm::vec2(1.0f), fragCoord / viewport);
+		const glm::vec4 position = invViewProj * glm::vec4(xy, depth, 1.0f);
+		return glm::vec3(position) / position.w;
+	}
+
+	/** @brief Frame buffer coordinates in xy and depth in z of a world space position */
+	static glm::vec3 project(const glm::vec3& position, const glm::vec2& viewport, const glm::mat4& viewProj)
+	{
+		const glm::vec4 clip = viewProj * glm::vec4(position, 1.0f);
+		const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		return glm::vec3((glm::vec2(ndc) * 0.5f + 0.5f) * viewport, ndc.z);
+	}
+
+	/**
+	* @brief Bake a curl noise velocity field of size^3 texels
+	*
+	* The vector potential is gradient noise with period lattice cells across the volume, one noise per component.
+	* The velocity is its curl from central differences on the texel grid, which keeps the field divergence free on that
+	* grid and tileable, so particles swirl without gathering in sinks. The field is scaled to a maximum speed of 1 and
+	* rounded to half floats, the texels of the reference are those of the texture.
+	*/
+	static TurbulenceField bakeTurbulence(uint32_t size, uint32_t period, uint32_t seed)
+	{
+		TurbulenceField field;
+		field.size = size;
+		const uint32_t texelCount = size * size * size;
+		std::vector<glm::vec3> potential(texelCount);
+		for (uint32_t z = 0; z < size; z++) {
+			for (uint32_t y = 0; y < size; y++) {
+				for (uint32_t x = 0; x < size; x++) {
+					const glm::vec3 p = glm::vec3(x, y, z) * (float(period) / float(size));
+					potential[(z * size + y) * size + x] = glm::vec3(gradientNoise(p, period, seed), gradientNoise(p, period, seed + 1), gradientNoise(p, period, seed + 2));
+				}
+			}
+		}
+
+		auto psi = [&](int32_t x, int32_t y, int32_t z) -> const glm::vec3& {
+			const int32_t n = static_cast<int32_t>(size);
+			return potential[(((z + n) % n) * size + ((y + n) % n)) * size + ((x + n) % n)];
+		};
+		field.texels.resize(texelCount);
+		float maxSpeed = 0.0f;
+		for (int32_t z = 0; z < int32_t(size); z++) {
+			for (int32_t y = 0; y < int32_t(size); y++) {
+				for (int32_t x = 0; x < int32_t(size); x++) {
+					const glm::vec3 dx = psi(x + 1, y, z) - psi(x - 1, y, z);
+					const glm::vec3 dy = psi(x, y + 1, z) - psi(x, y - 1, z);
+					const glm::vec3 dz = psi(x, y, z + 1) - psi(x, y, z - 1);
+					const glm::vec3 curl = glm::vec3(dy.z - dz.y, dz.x - dx.z, dx.y - dy.x);
+					field.texels[(z * size + y) * size + x] = curl;
+					maxSpeed = std::max(maxSpeed, glm::length(curl));
+				}
+			}
+		}
+
+		field.halfs.resize(texelCount * 4);
+		const float scale = maxSpeed > 0.0f ? 1.0f / maxSpeed : 0.0f;
+		for (uint32_t i = 0; i < texelCount; i++) {
+			for (uint32_t c = 0; c < 3; c++) {
+				field.halfs[i * 4 + c] = glm::packHalf1x16(field.texels[i][c] * scale);
+				field.texels[i][c] = glm::unpackHalf1x16(field.halfs[i * 4 + c]);
+			}
+			field.halfs[i * 4 + 3] = glm::packHalf1x16(0.0f);
+		}
+		return field;
+	}
+
+	/** @brief particleHash() of random.h, the xxHash32 of a ring slot and birth tick with a seed */
+	static uint32_t particleHash(uint32_t id, uint32_t birthTick, uint32_t seed)
+	{
+		const uint32_t PRIME2 = 2246822519u;
+		const uint32_t PRIME3 = 3266489917u;
+		const uint32_t PRIME4 = 668265263u;
+		const uint32_t PRIME5 = 374761393u;
+		uint32_t h = seed + PRIME5 + 8u;
+		h = rotate(h + id * PRIME3) * PRIME4;
+		h = rotate(h + birthTick * PRIME3) * PRIME4;
+		h ^= h >> 15;
+		h *= PRIME2;
+		h ^= h >> 13;
+		h *= PRIME3;
+		h ^= h >> 16;
+		return h;
+	}
+
+	/** @brief particleRandom() of random.h, uniform in [0, 1) */
+	static float particleRandom(uint32_t id, uint32_t birthTick, uint32_t seed)
+	{
+		return float(particleHash(id, birthTick, seed) >> 8) / 16777216.0f;
+	}
+
+	/**
+	* @brief simulationPeriod() of particle.comp: ticks per simulation step of a particle at a position
+	*
+	* 1 near the camera, doubled per simulationLodDistance level passed. The operation order is that of the precise
+	* shader code, so both pick the same period.
+	*/
+	static uint32_t simulationPeriod(const ParticleSystem& system, const glm::vec3& position)
+	{
+		const glm::vec3 offset = position - system.lodCamera;
+		const float distance2 = offset.x * offset.x + offset.y * offset.y + offset.z * offset.z;
+		float lodDistance2 = system.simulationLodDistance * system.simulationLodDistance;
+		uint32_t period = 1;
+		for (uint32_t level = 0; level < system.simulationLodLevels && distance2 > lodDistance2; level++) {
+			period *= 2;
+			lodDistance2 *= 4.0f;
+		}
+		return period;
+	}
+
+	/**
+	* @brief renderParticle() of particle.comp: the particle as written to the compacted buffer that is drawn
+	*
+	* The drift of the next step is extrapolated by the ticks since the previous step and the interpolation fraction of
+	* the next tick, with the operation order of the precise shader code, so the result is bit exact. The lifetime is
+	* the current one, a ring slot keeps the lifetime of its last write, see simulationStepped().
+	*/
+	static Particle renderParticle(const KernelConstants& constants, const ParticleSystem& system, uint32_t id, uint32_t period, Particle particle)
+	{
+		particle.color.a = particleLifetime(constants, system, particle);
+		const uint32_t end = system.tick + system.substeps;
+		const uint32_t behind = (id + end) % period;
+		const float rnd = particleRandom(id, particle.birthTick, system.seed + end + period - 1 - behind);
+		glm::vec3 v = glm::vec3(0.0f, constants.gravity, 0.0f) * rnd + system.wind * rnd;
+		if (hasResponse(particle)) {
+			v += glm::vec3(glm::unpackHalf2x16(particle.response[0]), glm::unpackHalf2x16(particle.response[1]).x);
+		}
+		particle.pos = glm::vec4(glm::vec3(particle.pos) + v * ((float(behind) + system.interpolation) * system.tickTime), particle.pos.w);
+		return particle;
+	}
+
+	/** @brief Field sampled by the simulation when the turbulence amplitude is not zero, has to outlive the reference */
+	void setTurbulence(const TurbulenceField* field)
+	{
+		turbulence = field;
+	}
+
+	/** @brief gpu_cmd.comp: consume the spawn candidates of the read slot and set up the dispatch */
+	void gpuCommand(const ParticleSystem& system, State& state) const
+	{
+		GpuCmdBuffer& gpuCmd = state.gpuCmd;
+		GlobalParticleData& global = state.global;
+
+		global.cachedCount += global.newEmiitedCount;
+
+		const uint32_t slot = system.candidateReadSlot;
+		const uint32_t acceptedCount = gpuCmd.particleCount[slot];
+		const uint32_t emittedCount = std::min(acceptedCount, gpuCmd.appendBudget[slot]);
+
+		const float candidateCount = float(acceptedCount) / std::max(gpuCmd.spawnProbability[slot], 1e-6f);
+		gpuCmd.spawnProbability[slot] = candidateCount > float(system.spawnBudget) ? float(system.spawnBudget) / candidateCount : 1.0f;
+
+		gpuCmd.particleCount[slot] = 0;
+		gpuCmd.drawCmd = { 0, 1, 0, 0 };
+
+		uint32_t renderCount = global.cachedCount + emittedCount;
+		if (renderCount != 0) {
+			if (renderCount >= global.particleCountMax) {
+				renderCount = global.particleCountMax;
+				global.cachedCount = 0;
+			}
+			const uint32_t workgroupSize = kernelConstants.workgroupSize;
+			gpuCmd.dispatchCmd = { (renderCount + workgroupSize - 1) / workgroupSize, 1, 1 };
+		} else {
+			gpuCmd.dispatchCmd = { 0, 0, 0 };
+		}
+
+		global.renderCount = renderCount;
+		global.newEmiitedCount = emittedCount;
+		global.particleIndex = 0;
+	}
+
+	/** @brief particle.comp: spawn the emitted particles, animate the others and compact the live ones */
+	void simulate(const ParticleSystem& system, const AppendJob* appendJobs, State& state)
+	{
+		const uint32_t count = state.global.renderCount;
+		const uint32_t ranges = getThreadCount();
+		const uint32_t rangeSize = (count + ranges - 1) / ranges;
+		std::vector<uint32_t> liveCounts(ranges, 0);
+		std::vector<uint32_t> periods(count);
+		state.ring.resize(state.global.particleCountMax);
+		state.particles.resize(state.global.particleCountMax);
+
+		// Simulate the ring ranges and count their live particles, then write each range's live particles
+		// after those of the preceding ranges
+		parallelFor(ranges, [&](uint32_t range) {
+			const uint32_t begin = std::min(range * rangeSize, count);
+			const uint32_t end = std::min(begin + rangeSize, count);
+			liveCounts[range] = simulateRange(kernelConstants, system, turbulence, appendJobs, state, periods.data(), begin, end);
+		});
+		std::vector<uint32_t> offsets(ranges, 0);
+		for (uint32_t range = 1; range < ranges; range++) {
+			offsets[range] = offsets[range - 1] + liveCounts[range - 1];
+		}
+		parallelFor(ranges, [&](uint32_t range) {
+			const uint32_t begin = std::min(range * rangeSize, count);
+			const uint32_t end = std::min(begin + rangeSize, count);
+			Particle* dst = state.particles.data() + offsets[range];
+			for (uint32_t id = begin; id < end; id++) {
+				if (particleLifetime(kernelConstants, system, state.ring[id]) > 0.0f) {
+					*dst++ = renderParticle(kernelConstants, system, id, periods[id], state.ring[id]);
+				}
+			}
+		});
+
+		const uint32_t liveCount = offsets[ranges - 1] + liveCounts[ranges - 1];
+		state.gpuCmd.drawCmd.vertexCount = liveCount;
+		state.global.particleIndex = liveCount;
+	}
+
+	/** @brief One simulation step as recorded into the frame: gpuCommand() followed by simulate() */
+	void step(const ParticleSystem& system, const AppendJob* appendJobs, State& state)
+	{
+		gpuCommand(system, state);
+		simulate(system, appendJobs, state);
+	}
+
+	/**
+	* @brief Compare the GPU state after a step with the reference state
+	*
+	* Counters and commands have to match exactly. The random numbers are integer hashes and match exactly too, particle
+	* positions are accepted within a float tolerance. Positions of turbulent particles have a tolerance for the
+	* filtering precision of the GPU sampler, see turbulenceToleranceOf(). The reference has no depth buffer to collide
+	* with, particles with a collision response before or after the step only have to keep their state. The compacted
+	* particles have to be a permutation of the live ring particles moved on by renderParticle(), which is bit exact.
+	*/
+	Report compare(const ParticleSystem& system, const State& input, const State& reference, const GpuCmdBuffer& gpuCmd,
+		const GlobalParticleData& global, const Particle* ring, const Particle* particles) const
+	{
+		Report report;
+
+		const GpuCmdBuffer& expectedCmd = reference.gpuCmd;
+		const GlobalParticleData& expectedGlobal = reference.global;
+		for (uint32_t slot = 0; slot < SPAWN_CANDIDATE_SLOTS; slot++) {
+			if (gpuCmd.particleCount[slot] != expectedCmd.particleCount[slot]) {
+				addMismatch(report, "particleCount[" + std::to_string(slot) + "]", gpuCmd.particleCount[slot], expectedCmd.particleCount[slot]);
+			}
+			if (!nearlyEqual(gpuCmd.spawnProbability[slot], expectedCmd.spawnProbability[slot])) {
+				addMismatch(report, "spawnProbability[" + std::to_string(slot) + "]", gpuCmd.spawnProbability[slot], expectedCmd.spawnProbability[slot]);
+			}
+		}
+		addMismatch(report, "dispatchCmd.x", gpuCmd.dispatchCmd.x, expectedCmd.dispatchCmd.x);
+		addMismatch(report, "dispatchCmd.y", gpuCmd.dispatchCmd.y, expectedCmd.dispatchCmd.y);
+		addMismatch(report, "dispatchCmd.z", gpuCmd.dispatchCmd.z, expectedCmd.dispatchCmd.z);
+		addMismatch(report, "drawCmd.vertexCount", gpuCmd.drawCmd.vertexCount, expectedCmd.drawCmd.vertexCount);
+		addMismatch(report, "drawCmd.instanceCount", gpuCmd.drawCmd.instanceCount, expectedCmd.drawCmd.instanceCount);
+		addMismatch(report, "drawCmd.firstVertex", gpuCmd.drawCmd.firstVertex, expectedCmd.drawCmd.firstVertex);
+		addMismatch(report, "drawCmd.firstInstance", gpuCmd.drawCmd.firstInstance, expectedCmd.drawCmd.firstInstance);
+		addMismatch(report, "particleCountMax", global.particleCountMax, expectedGlobal.particleCountMax);
+		addMismatch(report, "particleIndex", global.particleIndex, expectedGlobal.particleIndex);
+		addMismatch(report, "renderCount", global.renderCount, expectedGlobal.renderCount);
+		addMismatch(report, "cachedCount", global.cachedCount, expectedGlobal.cachedCount);
+		addMismatch(report, "newEmiitedCount", global.newEmiitedCount, expectedGlobal.newEmiitedCount);
+
+		// Particles beyond the render count are not touched by the step
+		const float turbulenceTolerance = turbulenceToleranceOf(system);
+		const uint32_t particleCountMax = expectedGlobal.particleCountMax;
+		std::vector<uint32_t> liveRing;
+		for (uint32_t id = 0; id < particleCountMax; id++) {
+			const Particle& expected = id < expectedGlobal.renderCount ? reference.ring[id] : input.ring[id];
+			const Particle& actual = ring[id];
+			report.compared++;
+			if (id < expectedGlobal.renderCount && particleLifetime(kernelConstants, system, actual) > 0.0f) {
+				liveRing.push_back(id);
+			}
+			if (samePayload(actual, expected)) {
+				report.exact++;
+				continue;
+			}
+			const bool sameState = actual.birthTick == expected.birthTick && actual.instance == expected.instance &&
+				glm::vec3(actual.color) == glm::vec3(expected.color) && nearlyEqual(actual.color.a, expected.color.a);
+			if (sameState && (nearlyEqual(actual.pos, expected.pos) || glm::distance(actual.pos, expected.pos) <= turbulenceTolerance)) {
+				report.withinTolerance++;
+			} else if (sameState && (hasResponse(input.ring[id]) || hasResponse(actual))) {
+				report.collided++;
+			} else {
+				report.mismatches++;
+				if (report.messages.size() < MAX_MESSAGES) {
+					std::stringstream ss;
+					ss << "ring[" << id << "]: pos (" << actual.pos.x << ", " << actual.pos.y << ", " << actual.pos.z << ") birth tick " << actual.birthTick
+						<< " lifetime " << actual.color.a << ", expected (" << expected.pos.x << ", " << expected.pos.y << ", " << expected.pos.z
+						<< ") birth tick " << expected.birthTick << " lifetime " << expected.color.a;
+					report.messages.push_back(ss.str());
+				}
+			}
+		}
+
+		// The compaction order on the GPU is arbitrary, so the sorted particles are compared with the sorted live ring
+		// particles of the simulated range, as they are drawn
+		const uint32_t liveCount = std::min(gpuCmd.drawCmd.vertexCount, particleCountMax);
+		if (liveCount != liveRing.size()) {
+			addMismatch(report, "live particles", liveCount, static_cast<uint32_t>(liveRing.size()));
+		} else {
+			std::vector<Particle> rendered(liveCount);
+			std::vector<const Particle*> compacted(liveCount);
+			std::vector<const Particle*> live(liveCount);
+			for (uint32_t i = 0; i < liveCount; i++) {
+				const uint32_t id = liveRing[i];
+				rendered[i] = renderParticle(kernelConstants, system, id, periodOf(system, expectedGlobal, input.ring[id], id), ring[id]);
+				compacted[i] = &particles[i];
+				live[i] = &rendered[i];
+			}
+			auto payloadLess = [](const Particle* a, const Particle* b) { return memcmp(a, b, PAYLOAD_SIZE) < 0; };
+			std::sort(compacted.begin(), compacted.end(), payloadLess);
+			std::sort(live.begin(), live.end(), payloadLess);
+			uint32_t misplaced = 0;
+			for (uint32_t i = 0; i < liveCount; i++) {
+				misplaced += samePayload(*compacted[i], *live[i]) ? 0 : 1;
+			}
+			if (misplaced > 0) {
+				addMismatch(report, "compacted particles not in the ring", misplaced, 0u);
+			}
+		}
+
+		return report;
+	}
+
+	/**
+	* @brief Check screen spawn positions against the depth buffer they were appended from
+	*
+	* Each position is projected back to its fragment, which has to be a pixel center, and compared with the position
+	* reconstructed from the depth buffer at that pixel. The tolerance follows from the depth quantization.
+	*/
+	void compareScreenSpawns(const AppendJob* appendJobs, uint32_t count, const float* depth, uint32_t width, uint32_t height, float depthTolerance,
+		const glm::mat4& viewProj, const glm::mat4& invViewProj, Report& report) const
+	{
+		const glm::vec2 viewport = glm::vec2(width, height);
+		for (uint32_t i = 0; i < count; i++) {
+			const glm::vec3 position = glm::vec3(appendJobs[i].position);
+			const glm::vec3 fragment = project(position, viewport, viewProj);
+			const glm::vec2 pixel = glm::floor(glm::vec2(fragment));
+			const glm::vec2 center = pixel + 0.5f;
+			report.spawnsCompared++;
+
+			bool valid = pixel.x >= 0.0f && pixel.y >= 0.0f && pixel.x < viewport.x && pixel.y < viewport.y &&
+				glm::all(glm::lessThan(glm::abs(glm::vec2(fragment) - center), glm::vec2(PIXEL_CENTER_TOLERANCE)));
+			glm::vec3 reconstructed = glm::vec3(0.0f);
+			if (valid) {
+				const float pixelDepth = depth[static_cast<uint32_t>(pixel.y) * width + static_cast<uint32_t>(pixel.x)];
+				reconstructed = unproject(center, pixelDepth, viewport, invViewProj);
+				const float tolerance = glm::distance(unproject(center, pixelDepth + depthTolerance, viewport, invViewProj), reconstructed) + FLOAT_TOLERANCE;
+				valid = glm::distance(reconstructed, position) <= tolerance;
+			}
+			if (!valid) {
+				report.spawnMismatches++;
+				if (report.messages.size() < MAX_MESSAGES) {
+					std::stringstream ss;
+					ss << "spawn " << i << ": (" << position.x << ", " << position.y << ", " << position.z << ") at fragment (" << fragment.x << ", "
+						<< fragment.y << ") depth " << fragment.z << ", reconstructed (" << reconstructed.x << ", " << reconstructed.y << ", " << reconstructed.z << ")";
+					report.messages.push_back(ss.str());
+				}
+			}
+		}
+	}
+
+private:
+	static const uint32_t MAX_MESSAGES = 8;
+	// Particle members modelled by the reference, the collision response is only checked for being zero
+	static const size_t PAYLOAD_SIZE = offsetof(Particle, response);
+	static constexpr float FLOAT_TOLERANCE = 1e-5f;
+	static constexpr float PIXEL_CENTER_TOLERANCE = 1e-2f;
+
+	// Subtexel precision of the trilinear filter weights required by Vulkan
+	static constexpr float FILTER_PRECISION = 1.0f / 16.0f;
+
+	vks::ThreadPool threadPool;
+	KernelConstants kernelConstants;
+	const TurbulenceField* turbulence = nullptr;
+
+	static uint32_t rotate(uint32_t x)
+	{
+		return (x << 17) | (x >> 15);
+	}
+
+	// Lattice hash of the turbulence noise
+	static uint32_t hashLattice(const glm::ivec3& cell, uint32_t seed)
+	{
+		uint32_t h = uint32_t(cell.x) * 73856093u ^ uint32_t(cell.y) * 19349663u ^ uint32_t(cell.z) * 83492791u ^ seed * 2654435761u;
+		h ^= h >> 16;
+		h *= 0x7feb352du;
+		h ^= h >> 15;
+		h *= 0x846ca68bu;
+		h ^= h >> 16;
+		return h;
+	}
+
+	// Gradient noise whose lattice repeats every period cells
+	static float gradientNoise(const glm::vec3& p, uint32_t period, uint32_t seed)
+	{
+		static const glm::vec3 gradients[12] = {
+			{ 1, 1, 0 }, { -1, 1, 0 }, { 1, -1, 0 }, { -1, -1, 0 }, { 1, 0, 1 }, { -1, 0, 1 },
+			{ 1, 0, -1 }, { -1, 0, -1 }, { 0, 1, 1 }, { 0, -1, 1 }, { 0, 1, -1 }, { 0, -1, -1 }
+		};
+		const glm::vec3 cell = glm::floor(p);
+		const glm::vec3 f = p - cell;
+		const glm::vec3 u = f * f * f * (f * (f * 6.0f - 15.0f) + 10.0f);
+		const glm::ivec3 n = glm::ivec3(period);
+		float result = 0.0f;
+		for (uint32_t corner = 0; corner < 8; corner++) {
+			const glm::ivec3 offset = glm::ivec3(corner & 1, (corner >> 1) & 1, corner >> 2);
+			const glm::ivec3 lattice = (((glm::ivec3(cell) + offset) % n) + n) % n;
+			const float value = glm::dot(gradients[hashLattice(lattice, seed) % 12], f - glm::vec3(offset));
+			const glm::vec3 weight = glm::mix(glm::vec3(1.0f) - u, u, glm::vec3(offset));
+			result += value * weight.x * weight.y * weight.z;
+		}
+		return result;
+	}
+
+	// Turbulence velocity at a position, as sampled by animateParticle() of particle.comp
+	static glm::vec3 turbulenceVelocity(const ParticleSystem& system, const TurbulenceField* turbulence, const glm::vec4& position)
+	{
+		if (turbulence == nullptr || system.turbulenceAmplitude == 0.0f) {
+			return glm::vec3(0.0f);
+		}
+		return turbulence->sample(glm::vec3(position) * system.turbulenceFrequency + system.turbulenceOffset) * system.turbulenceAmplitude;
+	}
+
+	// Distance a particle may deviate by, as GPU filter weights may only have FILTER_PRECISION. The field has a
+	// maximum speed of 1, so a weight error moves a sample by at most FILTER_PRECISION per axis.
+	static float turbulenceToleranceOf(const ParticleSystem& system)
+	{
+		const uint32_t longestStep = (1u << system.simulationLodLevels) - 1;
+		return std::fabs(system.turbulenceAmplitude) * ((system.substeps + longestStep) * system.tickTime) * FILTER_PRECISION * 2.0f * std::sqrt(3.0f) + FLOAT_TOLERANCE;
+	}
+
+	static Particle initParticle(const ParticleSystem& system, const AppendJob* appendJobs, const GlobalParticleData& global, uint32_t id)
+	{
+		const uint32_t jobId = id - global.cachedCount;
+		const AppendJob& job = appendJobs[system.candidateReadSlot * system.candidateSlotSize + jobId];
+
+		Particle particle{};
+		const float gray = job.position.w;
+		particle.pos = glm::vec4(glm::vec3(job.position), 1.0f);
+		particle.color = glm::vec4(gray, gray, gray, 1.0f);
+		particle.birthTick = system.tick + system.substeps;
+		particle.instance = job.instance;
+		return particle;
+	}
+
+	// Simulation period of ring slot id at the start of the step, particles emitted by it are at the current tick
+	static uint32_t periodOf(const ParticleSystem& system, const GlobalParticleData& global, const Particle& particle, uint32_t id)
+	{
+		if (id >= global.cachedCount && id < global.cachedCount + global.newEmiitedCount) {
+			return 1;
+		}
+		return simulationPeriod(system, glm::vec3(particle.pos));
+	}
+
+	// simulationStepped() of particle.comp: whether a particle of the period takes a step in the ticks of the frame,
+	// otherwise its ring slot is only written back if it dies
+	static bool simulationStepped(const ParticleSystem& system, uint32_t id, uint32_t period)
+	{
+		const uint32_t first = (period - (id + system.tick + 1) % period) % period;
+		return first < system.substeps;
+	}
+
+	// Lifetime of a particle at the end of the ticks of the frame, negative once it has expired
+	static float particleLifetime(const KernelConstants& constants, const ParticleSystem& system, const Particle& particle)
+	{
+		const uint32_t age = system.tick + system.substeps - particle.birthTick;
+		const float lifetime = 1.0f - float(age) * (1.0f / system.speed) * constants.lifetimeScale;
+		return lifetime < 0.0f ? -1.0f : lifetime;
+	}
+
+	static Particle animateParticle(const KernelConstants& constants, const ParticleSystem& system, const TurbulenceField* turbulence, uint32_t id,
+		uint32_t period, Particle particle)
+	{
+		const float stepTime = float(period) * system.tickTime;
+		for (uint32_t substep = 0; substep < system.substeps; substep++) {
+			const uint32_t tick = system.tick + substep;
+			if ((id + tick + 1) % period != 0) {
+				continue;
+			}
+			const float rnd = particleRandom(id, particle.birthTick, system.seed + tick);
+			const glm::vec3 gravity = glm::vec3(0.0f, constants.gravity, 0.0f) * rnd;
+			const glm::vec3 v = gravity + system.wind * rnd + turbulenceVelocity(system, turbulence, particle.pos);
+			particle.pos = glm::vec4(glm::vec3(particle.pos) + v * stepTime, particle.pos.w);
+		}
+
+		particle.color.a = particleLifetime(constants, system, particle);
+		if (particle.color.a < 0.0f) {
+			particle.birthTick = 0;
+		}
+		return particle;
+	}
+
+	// Simulate the ring range [begin, end), store the simulation periods and return its live particle count
+	// The range scales across threads, there is no SIMD path. The particles are the interleaved std430 layout of the
+	// GPU buffer, each one takes its own number of steps depending on its simulation period and a turbulence sample is
+	// a trilinear gather at its position, so lanes would diverge in the loop count and in memory access, and would need
+	// a transposed copy of the ring in and out of every step.
+	static uint32_t simulateRange(const KernelConstants& constants, const ParticleSystem& system, const TurbulenceField* turbulence, const AppendJob* appendJobs,
+		State& state, uint32_t* periods, uint32_t begin, uint32_t end)
+	{
+		const GlobalParticleData& global = state.global;
+		uint32_t liveCount = 0;
+		for (uint32_t id = begin; id < end; id++) {
+			Particle& particle = state.ring[id];
+			periods[id] = periodOf(system, global, particle, id);
+			if (id >= global.cachedCount && id < global.cachedCount + global.newEmiitedCount) {
+				particle = initParticle(system, appendJobs, global, id);
+				liveCount++;
+				continue;
+			}
+			const Particle animated = animateParticle(constants, system, turbulence, id, periods[id], particle);
+			if (simulationStepped(system, id, periods[id]) || animated.birthTick != particle.birthTick) {
+				particle = animated;
+			}
+			liveCount += animated.color.a > 0.0f ? 1 : 0;
+		}
+		return liveCount;
+	}
+
+	// Run function(index) for index [0, count), the first one on the calling thread
+	template<typename Function>
+	void parallelFor(uint32_t count, Function function)
+	{
+		for (uint32_t index = 1; index < count; index++) {
+			threadPool.threads[(index - 1) % threadPool.threads.size()]->addJob([&function, index] { function(index); });
+		}
+		if (count > 0) {
+			function(0);
+		}
+		threadPool.wait();
+	}
+
+	static bool hasResponse(const Particle& particle)
+	{
+		return particle.response[0] != 0 || particle.response[1] != 0;
+	}
+
+	static bool samePayload(const Particle& a, const Particle& b)
+	{
+		return memcmp(&a, &b, PAYLOAD_SIZE) == 0;
+	}
+
+	static bool nearlyEqual(float a, float b)
+	{
+		return std::fabs(a - b) <= FLOAT_TOLERANCE * std::max(1.0f, std::max(std::fabs(a), std::fabs(b)));
+	}
+
+	static bool nearlyEqual(const glm::vec4& a, const glm::vec4& b)
+	{
+		return nearlyEqual(a.x, b.x) && nearlyEqual(a.y, b.y) && nearlyEqual(a.z, b.z) && nearlyEqual(a.w, b.w);
+	}
+
+	template<typename T>
+	static void addMismatch(Report& report, const std::string& name, T actual, T expected)
+	{
+		if (actual == expected) {
+			return;
+		}
+		report.mismatches++;
+		if (report.messages.size() < MAX_MESSAGES) {
+			std::stringstream ss;
+			ss << name << ": " << actual << ", expected " << expected;
+			report.messages.push_back(ss.str());
+		}
+	}
+};
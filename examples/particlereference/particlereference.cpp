@@ -0,0 +1,220 @@
+/*
+* Vulkan Example - Tests of the meshparticles CPU reference
+*
+* Checks the particle random numbers of random.h through their mirror in ParticleReference, and measures
+* the throughput of the CPU reference simulation single threaded and on all cores.
+* Runs on the CPU only, no Vulkan device is created, the result is the exit code.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../meshparticles/particlereference.hpp"
+
+// Ring buffer size, largest spawn budget and turbulence field of the meshparticles example
+static const uint32_t PARTICLE_COUNT_MAX = 128 * 1024 * 10;
+static const uint32_t SPAWN_BUDGET_MAX = PARTICLE_COUNT_MAX / 4;
+static const uint32_t TURBULENCE_SIZE = 32;
+static const uint32_t TURBULENCE_PERIOD = 4;
+static const uint32_t TURBULENCE_SEED = 1;
+
+static std::default_random_engine rndEngine(0);
+
+static float rnd(float range)
+{
+	std::uniform_real_distribution<float> rndDist(0.0f, range);
+	return rndDist(rndEngine);
+}
+
+// Test the random numbers of random.h with their bit exact mirror ParticleReference::particleHash
+// Each input is swept with the others fixed. The numbers have to fall uniformly into 1024 bins, with a chi-square
+// below the critical value at p = 0.0001, and be uncorrelated with the next one of the sweep. Flipping any input bit
+// has to flip each of the 24 bits a number is made of with a probability within 3% of one half. The tan based rand()
+// that was used before is measured the same way for comparison, it has no birth frame input.
+static bool runRandomTest()
+{
+	const uint32_t count = 1 << 20;
+	const uint32_t bins = 1024;
+	const double maxCorrelation = 5.0 / std::sqrt((double)count);
+	const double maxAvalancheBias = 0.03;
+	// Wilson-Hilferty approximation of the chi-square quantile
+	const double df = bins - 1;
+	const double criticalChiSquare = df * std::pow(1.0 - 2.0 / (9.0 * df) + 3.719 * std::sqrt(2.0 / (9.0 * df)), 3.0);
+
+	auto legacyRand = [](glm::vec2 xy, float seed) {
+		const float PHI = 1.61803398874989484820459f;
+		return glm::fract(tanf(glm::distance(xy * PHI, xy) * seed) * xy.x);
+	};
+	struct Sweep {
+		std::string name;
+		std::function<float(uint32_t)> number;
+		bool tested;
+	};
+	const std::vector<Sweep> sweeps = {
+		{ "hash, slot sweep", [](uint32_t i) { return ParticleReference::particleRandom(i, 7, 12345); }, true },
+		{ "hash, birth frame sweep", [](uint32_t i) { return ParticleReference::particleRandom(5, i, 12345); }, true },
+		{ "hash, seed sweep", [](uint32_t i) { return ParticleReference::particleRandom(5, 7, i); }, true },
+		{ "tan rand(), slot sweep", [&](uint32_t i) { return legacyRand(glm::vec2(float(i)), 0.5f); }, false },
+		{ "tan rand(), seed sweep", [&](uint32_t i) { return legacyRand(glm::vec2(5.0f), float(i) / float(count)); }, false },
+	};
+
+	bool passed = true;
+	std::cout << "Particle random number test, " << count << " numbers per sweep, chi-square critical value " << std::fixed << std::setprecision(1) << criticalChiSquare << ":\n";
+	for (const Sweep& sweep : sweeps) {
+		std::vector<uint32_t> histogram(bins, 0);
+		double sum = 0.0, sumSquares = 0.0, sumProducts = 0.0;
+		float previous = 0.0f;
+		bool inRange = true;
+		auto tStart = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < count; i++) {
+			const float value = sweep.number(i);
+			inRange &= value >= 0.0f && value < 1.0f;
+			histogram[std::min(static_cast<uint32_t>(value * bins), bins - 1)]++;
+			sum += value;
+			sumSquares += value * value;
+			sumProducts += i > 0 ? previous * value : 0.0;
+			previous = value;
+		}
+		const double time = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - tStart).count() / count;
+		const double expected = (double)count / bins;
+		double chiSquare = 0.0;
+		for (uint32_t bin : histogram) {
+			chiSquare += (bin - expected) * (bin - expected) / expected;
+		}
+		const double mean = sum / count;
+		const double variance = sumSquares / count - mean * mean;
+		const double correlation = variance > 0.0 ? (sumProducts / (count - 1) - mean * mean) / variance : 1.0;
+		const bool sweepPassed = inRange && chiSquare < criticalChiSquare && std::fabs(correlation) < maxCorrelation;
+		std::cout << "  " << std::left << std::setw(24) << sweep.name << std::right << std::setprecision(1) << " chi-square " << std::setw(8) << chiSquare
+			<< ", correlation " << std::setprecision(4) << std::setw(7) << correlation << ", " << std::setprecision(2) << time << " ns per number"
+			<< (sweep.tested ? (sweepPassed ? "" : "  FAILED") : "  (not tested)") << "\n";
+		if (sweep.tested) {
+			passed &= sweepPassed;
+		}
+	}
+
+	// Flip every bit of the three input words for random inputs
+	std::mt19937 generator(1);
+	const uint32_t trials = 20000;
+	double worstBias = 0.0;
+	for (uint32_t inputBit = 0; inputBit < 96; inputBit++) {
+		std::vector<uint32_t> flips(24, 0);
+		for (uint32_t trial = 0; trial < trials; trial++) {
+			uint32_t input[3] = { static_cast<uint32_t>(generator()), static_cast<uint32_t>(generator()), static_cast<uint32_t>(generator()) };
+			const uint32_t a = ParticleReference::particleHash(input[0], input[1], input[2]) >> 8;
+			input[inputBit / 32] ^= 1u << (inputBit % 32);
+			const uint32_t b = ParticleReference::particleHash(input[0], input[1], input[2]) >> 8;
+			for (uint32_t outputBit = 0; outputBit < 24; outputBit++) {
+				flips[outputBit] += ((a ^ b) >> outputBit) & 1;
+			}
+		}
+		for (uint32_t flipCount : flips) {
+			worstBias = std::max(worstBias, std::fabs((double)flipCount / trials - 0.5));
+		}
+	}
+	const bool avalanchePassed = worstBias < maxAvalancheBias;
+	passed &= avalanchePassed;
+	std::cout << "  avalanche: worst output bit flip probability " << std::setprecision(4) << 0.5 + worstBias << (avalanchePassed ? "" : "  FAILED") << "\n";
+	std::cout << (passed ? "Particle random number test passed" : "Particle random number test FAILED") << "\n";
+	return passed;
+}
+
+// Simulate a full ring buffer with the largest spawn budget emitted each frame, single threaded and on all cores
+static void runCpuBenchmark(float turbulenceAmplitude)
+{
+	const uint32_t frames = 100;
+	const uint32_t budget = SPAWN_BUDGET_MAX;
+	std::vector<ParticleReference::AppendJob> appendJobs(budget);
+	for (auto& job : appendJobs) {
+		job.position = glm::vec4(rnd(2.0f) - 1.0f, rnd(2.0f) - 1.0f, rnd(2.0f) - 1.0f, rnd(1.0f));
+		job.instance = 0;
+	}
+
+	const ParticleReference::TurbulenceField field = ParticleReference::bakeTurbulence(TURBULENCE_SIZE, TURBULENCE_PERIOD, TURBULENCE_SEED);
+
+	const uint32_t threadCounts[] = { 1, std::max(std::thread::hardware_concurrency(), 1u) };
+	for (uint32_t threadCount : threadCounts) {
+		ParticleReference reference(threadCount);
+		reference.setTurbulence(&field);
+		ParticleReference::State state;
+		state.global.particleCountMax = PARTICLE_COUNT_MAX;
+		state.gpuCmd.spawnProbability[0] = 1.0f;
+		ParticleReference::ParticleSystem system;
+		system.spawnBudget = budget;
+		system.candidateSlotSize = budget;
+		system.deltaT = 1.0f / 60.0f;
+		system.turbulenceAmplitude = turbulenceAmplitude;
+		system.turbulenceFrequency = 0.5f;
+
+		// Fill the ring buffer before measuring
+		double stepTime = 0.0;
+		uint64_t simulated = 0;
+		const uint32_t warmup = PARTICLE_COUNT_MAX / budget + 1;
+		for (uint32_t frame = 0; frame < warmup + frames; frame++) {
+			system.frameNum++;
+			system.tick = system.frameNum;
+			system.wind = glm::vec3(rnd(1.0f), rnd(1.0f), 0.0f);
+			state.gpuCmd.particleCount[0] = budget;
+			state.gpuCmd.appendBudget[0] = budget;
+			auto tStart = std::chrono::high_resolution_clock::now();
+			reference.step(system, appendJobs.data(), state);
+			if (frame >= warmup) {
+				stepTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+				simulated += state.global.renderCount;
+			}
+		}
+		std::cout << "CPU reference, " << threadCount << " thread(s): " << stepTime / frames << " ms per step, "
+			<< (double)simulated / (stepTime * 1000.0) << " M particles/s\n";
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	// --rng and --benchmark limit the run to those tests, --turbulence sets the amplitude of the benchmark as in the example
+	bool rng = false;
+	bool benchmark = false;
+	float turbulenceAmplitude = 0.3f;
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		if (arg == "--rng") {
+			rng = true;
+		} else if (arg == "--benchmark") {
+			benchmark = true;
+		} else if (arg == "--turbulence" && i + 1 < argc) {
+			char* end = nullptr;
+			const float amplitude = strtof(argv[++i], &end);
+			if (end == argv[i] || !std::isfinite(amplitude)) {
+				std::cerr << "Invalid turbulence amplitude \"" << argv[i] << "\"\n";
+				return 1;
+			}
+			turbulenceAmplitude = std::max(amplitude, 0.0f);
+		} else {
+			std::cerr << "Usage: particlereference [--rng] [--benchmark] [--turbulence <amplitude>]\n";
+			return 1;
+		}
+	}
+	const bool all = !rng && !benchmark;
+
+	bool passed = true;
+	if (all || rng) {
+		passed &= runRandomTest();
+	}
+	if (all || benchmark) {
+		runCpuBenchmark(turbulenceAmplitude);
+	}
+	return passed ? 0 : 1;
+}